@@ -0,0 +1,254 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#include "../core/Console.h"
+#include "../core/ContentBlockingManager.h"
+#include "../core/SessionsManager.h"
+#include "../core/SettingsManager.h"
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QUrl>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace Otter;
+
+struct CorpusEntry
+{
+	QUrl baseUrl;
+	QUrl requestUrl;
+	ContentBlockingManager::ResourceType resourceType;
+};
+
+qint64 getPeakMemoryUsage()
+{
+#ifdef Q_OS_UNIX
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+#ifdef Q_OS_MAC
+		return usage.ru_maxrss;
+#else
+		return (static_cast<qint64>(usage.ru_maxrss) * 1024);
+#endif
+	}
+#endif
+
+	return -1;
+}
+
+QVector<CorpusEntry> loadCorpus(const QString &path)
+{
+	QVector<CorpusEntry> corpus;
+	QFile file(path);
+
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		return corpus;
+	}
+
+	QTextStream stream(&file);
+
+	while (!stream.atEnd())
+	{
+		const QStringList columns(stream.readLine().split(QLatin1Char('\t')));
+
+		if (columns.count() < 3)
+		{
+			continue;
+		}
+
+		CorpusEntry entry;
+		entry.baseUrl = QUrl(columns.at(0));
+		entry.requestUrl = QUrl(columns.at(1));
+		entry.resourceType = static_cast<ContentBlockingManager::ResourceType>(columns.at(2).toInt());
+
+		corpus.append(entry);
+	}
+
+	file.close();
+
+	return corpus;
+}
+
+void replayCorpus(const QVector<CorpusEntry> &corpus, const QVector<int> &profiles, const QString &title)
+{
+	QVector<qint64> latencies;
+	latencies.reserve(corpus.count());
+
+	QElapsedTimer totalTimer;
+	QElapsedTimer requestTimer;
+	int blockedRequests(0);
+
+	totalTimer.start();
+
+	for (int i = 0; i < corpus.count(); ++i)
+	{
+		requestTimer.start();
+
+		if (ContentBlockingManager::checkUrl(profiles, corpus.at(i).baseUrl, corpus.at(i).requestUrl, corpus.at(i).resourceType).isBlocked)
+		{
+			++blockedRequests;
+		}
+
+		latencies.append(requestTimer.nsecsElapsed());
+	}
+
+	const qint64 totalTime(qMax(totalTimer.nsecsElapsed(), Q_INT64_C(1)));
+
+	qSort(latencies);
+
+	QTextStream output(stdout);
+	output << title << ":\n";
+	output << "  requests: " << corpus.count() << " (" << blockedRequests << " blocked)\n";
+	output << "  requests/s: " << qRound64((corpus.count() * 1000000000.0) / totalTime) << "\n";
+
+	if (!latencies.isEmpty())
+	{
+		output << "  p50: " << (latencies.at((latencies.count() - 1) / 2) / 1000.0) << " us\n";
+		output << "  p99: " << (latencies.at(((latencies.count() - 1) * 99) / 100) / 1000.0) << " us\n";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication application(argc, argv);
+	application.setApplicationName(QLatin1String("otter-contentblocking-benchmark"));
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QLatin1String("Replays recorded requests against content blocking profiles."));
+	parser.addHelpOption();
+	parser.addPositionalArgument(QLatin1String("lists"), QLatin1String("Adblock Plus lists to load."), QLatin1String("[lists...]"));
+	parser.addOption(QCommandLineOption(QLatin1String("corpus"), QLatin1String("Tab separated file with first party URL, request URL and resource type in each line, as recorded by debug builds into file pointed by OTTER_CONTENT_BLOCKING_CORPUS."), QLatin1String("path")));
+	parser.addOption(QCommandLineOption(QLatin1String("passes"), QLatin1String("Number of times corpus is replayed."), QLatin1String("number"), QLatin1String("2")));
+	parser.addOption(QCommandLineOption(QLatin1String("wildcards"), QLatin1String("Enables wildcards support.")));
+	parser.process(application);
+
+	const QStringList lists(parser.positionalArguments());
+
+	if (lists.isEmpty() || !parser.isSet(QLatin1String("corpus")))
+	{
+		parser.showHelp(1);
+	}
+
+	const QVector<CorpusEntry> corpus(loadCorpus(parser.value(QLatin1String("corpus"))));
+
+	if (corpus.isEmpty())
+	{
+		QTextStream(stderr) << "Failed to load corpus\n";
+
+		return 1;
+	}
+
+	QTemporaryDir profileDirectory;
+
+	if (!profileDirectory.isValid())
+	{
+		QTextStream(stderr) << "Failed to create temporary profile\n";
+
+		return 1;
+	}
+
+	Console::createInstance(&application);
+	SettingsManager::createInstance(profileDirectory.path(), &application);
+	SessionsManager::createInstance(profileDirectory.path(), profileDirectory.path(), false, false, &application);
+
+	const QString blockingPath(SessionsManager::getWritableDataPath(QLatin1String("blocking")));
+	QStringList names;
+
+	QDir().mkpath(blockingPath);
+
+	for (int i = 0; i < lists.count(); ++i)
+	{
+		const QFileInfo information(lists.at(i));
+
+		if (!QFile::copy(information.absoluteFilePath(), QDir(blockingPath).filePath(information.fileName())))
+		{
+			QTextStream(stderr) << "Failed to copy list: " << lists.at(i) << "\n";
+
+			return 1;
+		}
+
+		names.append(information.baseName());
+	}
+
+	SettingsManager::setValue(QLatin1String("ContentBlocking/EnableWildcards"), parser.isSet(QLatin1String("wildcards")));
+	SettingsManager::setValue(QLatin1String("Content/BlockingProfiles"), names);
+
+	QElapsedTimer loadingTimer;
+	loadingTimer.start();
+
+	ContentBlockingManager::createInstance(&application);
+
+	const QVector<int> profiles(ContentBlockingManager::getProfileList(names));
+
+	while (!ContentBlockingManager::areProfilesLoaded(profiles))
+	{
+		QCoreApplication::processEvents();
+		QThread::msleep(1);
+	}
+
+	const qint64 loadingTime(loadingTimer.elapsed());
+
+///NOTE First check schedules compilation of merged index for sets of multiple lists, it has to be ready before measurements start
+	ContentBlockingManager::checkUrl(profiles, corpus.at(0).baseUrl, corpus.at(0).requestUrl, corpus.at(0).resourceType);
+
+	QThreadPool::globalInstance()->waitForDone();
+	QCoreApplication::processEvents();
+
+	const qint64 mergingTime(loadingTimer.elapsed() - loadingTime);
+	const QList<ConsoleMessage> messages(Console::getMessages());
+	QTextStream output(stdout);
+
+	for (int i = 0; i < messages.count(); ++i)
+	{
+		output << QFileInfo(messages.at(i).source).baseName() << ": " << messages.at(i).note << "\n";
+	}
+
+	output << "load time: " << loadingTime << " ms\n";
+	output << "merge time: " << mergingTime << " ms\n";
+	output.flush();
+
+	const int passes(qMax(1, parser.value(QLatin1String("passes")).toInt()));
+
+	for (int i = 0; i < passes; ++i)
+	{
+		replayCorpus(corpus, profiles, ((i == 0) ? QStringLiteral("pass 1 (cold decisions cache)") : QStringLiteral("pass %1").arg(i + 1)));
+	}
+
+	const qint64 peakMemoryUsage(getPeakMemoryUsage());
+
+	if (peakMemoryUsage >= 0)
+	{
+		output << "peak RSS: " << (peakMemoryUsage / 1024) << " KiB\n";
+	}
+
+	return 0;
+}
@@ -22,25 +22,45 @@
 #include "AddressCompletionModel.h"
 #include "AddonsManager.h"
 #include "BookmarksManager.h"
+#include "Console.h"
 #include "HistoryManager.h"
 #include "SettingsManager.h"
 #include "ThemesManager.h"
 #include "Utils.h"
 
+#include <QtConcurrent/QtConcurrentRun>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDir>
+#include <QtCore/QDirIterator>
 #include <QtCore/QFileInfo>
 #include <QtCore/QMimeDatabase>
+#include <QtCore/QSet>
 #include <QtWidgets/QFileIconProvider>
 
+#include <algorithm>
+
 namespace Otter
 {
 
+const int AddressCompletionModel::m_historyCandidatesLimit(500);
+
 AddressCompletionModel::AddressCompletionModel(QObject *parent) : QAbstractListModel(parent),
+	m_sectionSizes(6, 0),
 	m_types(UnknownCompletionType),
+	m_generation(0),
 	m_updateTimer(0),
-	m_showCompletionCategories(true)
+	m_showCompletionCategories(true),
+	m_areHistoryCandidatesComplete(false),
+	m_isWaitingForLocalPaths(false),
+	m_isWaitingForPages(false)
+{
+}
+
+AddressCompletionModel::~AddressCompletionModel()
 {
+	m_generation.fetchAndAddOrdered(1);
+	m_localPathsFuture.waitForFinished();
+	m_pagesFuture.waitForFinished();
 }
 
 void AddressCompletionModel::timerEvent(QTimerEvent *event)
@@ -56,141 +76,544 @@ void AddressCompletionModel::timerEvent(QTimerEvent *event)
 			return;
 		}
 
-		QList<CompletionEntry> completions;
+		const int generation(m_generation.load());
 
-		if (m_types.testFlag(SearchSuggestionsCompletionType))
+///NOTE Sources are queried one by one, starting from the fastest ones, so results appear as soon as possible and remaining sources are skipped once filter changes again
+///NOTE Bookmarks and history are looked up in memory indexes bounded by candidates limit, which is faster than copying models for worker thread, so only sources reading from disk are queried in background
+		m_pendingSections.clear();
+		m_pendingSections.append(SearchSuggestionsSection);
+		m_pendingSections.append(SpecialPagesSection);
+		m_pendingSections.append(BookmarksSection);
+		m_pendingSections.append(HistorySection);
+
+		if (m_types.testFlag(LocalPathSuggestionsCompletionType) && m_filter.contains(QDir::separator()))
+		{
+			m_isWaitingForLocalPaths = true;
+			m_localPathsFuture = QtConcurrent::run(this, &AddressCompletionModel::findLocalPaths, m_filter, generation);
+		}
+		else
 		{
-			const QString keyword(m_filter.section(QLatin1Char(' '), 0, 0));
-			const SearchEnginesManager::SearchEngineDefinition searchEngine(SearchEnginesManager::getSearchEngine(keyword, true));
-			QString title(m_defaultSearchEngine.title);
-			QString text(m_filter);
-			QIcon icon(m_defaultSearchEngine.icon);
+			m_isWaitingForLocalPaths = false;
+
+			setSectionCompletions(LocalPathsSection, QList<CompletionEntry>());
+		}
+
+		updateCompletions(generation);
+	}
+}
+
+void AddressCompletionModel::updateCompletions(int generation)
+{
+	if (generation != m_generation.load() || m_pendingSections.isEmpty())
+	{
+		return;
+	}
+
+	const CompletionSection section(m_pendingSections.takeFirst());
+
+	switch (section)
+	{
+		case SearchSuggestionsSection:
+			setSectionCompletions(section, createSearchSuggestionCompletions());
+
+			break;
+		case BookmarksSection:
+			setSectionCompletions(section, createBookmarkCompletions());
 
-			if (!searchEngine.identifier.isEmpty())
+			break;
+		case HistorySection:
+			setSectionCompletions(section, createHistoryCompletions());
+
+			if (m_types.testFlag(HistoryCompletionType) && m_filter.length() > 2 && HistoryManager::getFullTextIndex())
 			{
-				title = searchEngine.title;
-				text = m_filter.section(QLatin1Char(' '), 1, -1);
-				icon = searchEngine.icon;
+				m_isWaitingForPages = true;
+				m_pagesFuture = QtConcurrent::run(this, &AddressCompletionModel::findPages, HistoryManager::getFullTextIndex(), m_filter, generation);
 			}
-			else if (keyword == QLatin1String("?"))
+			else
 			{
-				text = m_filter.section(QLatin1Char(' '), 1, -1);
-			}
+				m_isWaitingForPages = false;
 
-			if (icon.isNull())
-			{
-				icon = ThemesManager::getIcon(QLatin1String("edit-find"));
+				setSectionCompletions(PagesSection, QList<CompletionEntry>());
 			}
 
-			if (m_showCompletionCategories)
-			{
-				completions.append(CompletionEntry(QUrl(), tr("Search with %1").arg(title), QString(), QIcon(), HeaderType));
+			break;
+		case SpecialPagesSection:
+			setSectionCompletions(section, createSpecialPageCompletions());
 
-				title = QString();
-			}
+			break;
+		default:
+			break;
+	}
+
+	if (!m_pendingSections.isEmpty())
+	{
+		QMetaObject::invokeMethod(this, "updateCompletions", Qt::QueuedConnection, Q_ARG(int, generation));
+	}
+
+	if (!m_completions.isEmpty() || (m_pendingSections.isEmpty() && !m_isWaitingForLocalPaths && !m_isWaitingForPages))
+	{
+		updateLatencyStatistics();
+
+		emit completionReady(m_filter);
+	}
+}
 
-			CompletionEntry completionEntry(QUrl(), title, QString(), icon, SearchSuggestionType);
-			completionEntry.text = text;
+bool AddressCompletionModel::compareBookmarkMatches(const BookmarksModel::BookmarkMatch &first, const BookmarksModel::BookmarkMatch &second)
+{
+	return (first.bookmark->data(BookmarksModel::TimeVisitedRole).toDateTime() > second.bookmark->data(BookmarksModel::TimeVisitedRole).toDateTime());
+}
 
-			completions.append(completionEntry);
+bool AddressCompletionModel::compareLocalPaths(const QFileInfo &first, const QFileInfo &second)
+{
+	return (first.fileName().compare(second.fileName(), Qt::CaseInsensitive) < 0);
+}
+
+void AddressCompletionModel::findLocalPaths(const QString &filter, int generation)
+{
+	const QString directory(filter.section(QDir::separator(), 0, -2) + QDir::separator());
+	const QString prefix(filter.section(QDir::separator(), -1, -1));
+	QDirIterator iterator(Utils::normalizePath(directory), (QDir::AllEntries | QDir::NoDotAndDotDot));
+	QList<QFileInfo> entries;
+
+	while (iterator.hasNext())
+	{
+		if (generation != m_generation.load())
+		{
+			return;
 		}
 
-		if (m_types.testFlag(BookmarksCompletionType))
+		iterator.next();
+
+		if (iterator.fileName().startsWith(prefix, Qt::CaseInsensitive))
 		{
-			const QList<BookmarksModel::BookmarkMatch> bookmarks = BookmarksManager::findBookmarks(m_filter);
+			entries.append(iterator.fileInfo());
+		}
+	}
 
-			if (m_showCompletionCategories && !bookmarks.isEmpty())
-			{
-				completions.append(CompletionEntry(QUrl(), tr("Bookmarks"), QString(), QIcon(), HeaderType));
-			}
+	std::sort(entries.begin(), entries.end(), compareLocalPaths);
 
-			for (int i = 0; i < bookmarks.count(); ++i)
-			{
-				CompletionEntry completionEntry(bookmarks.at(i).bookmark->data(BookmarksModel::UrlRole).toUrl(), bookmarks.at(i).bookmark->data(BookmarksModel::TitleRole).toString(), bookmarks.at(i).match, bookmarks.at(i).bookmark->data(Qt::DecorationRole).value<QIcon>(), BookmarkType);
-				completionEntry.keyword = bookmarks.at(i).bookmark->data(BookmarksModel::KeywordRole).toString();
+	const QMimeDatabase mimeDatabase;
+	QStringList paths;
+	QStringList iconNames;
 
-				if (completionEntry.keyword.startsWith(m_filter))
-				{
-					completionEntry.match = completionEntry.keyword;
-				}
+	for (int i = 0; i < entries.count(); ++i)
+	{
+		if (generation != m_generation.load())
+		{
+			return;
+		}
 
-				completions.append(completionEntry);
-			}
+		paths.append(directory + entries.at(i).fileName());
+		iconNames.append(mimeDatabase.mimeTypeForFile(entries.at(i), QMimeDatabase::MatchExtension).iconName());
+	}
+
+	QMetaObject::invokeMethod(this, "handleLocalPaths", Qt::QueuedConnection, Q_ARG(QStringList, paths), Q_ARG(QStringList, iconNames), Q_ARG(int, generation));
+}
+
+void AddressCompletionModel::handleLocalPaths(const QStringList &paths, const QStringList &iconNames, int generation)
+{
+	if (generation != m_generation.load())
+	{
+		return;
+	}
+
+	m_isWaitingForLocalPaths = false;
+
+	QList<CompletionEntry> completions;
+
+	if (m_showCompletionCategories && !paths.isEmpty())
+	{
+		completions.append(CompletionEntry(QUrl(), tr("Local files"), QString(), QIcon(), HeaderType));
+	}
+
+	const QFileIconProvider iconProvider;
+
+	for (int i = 0; i < paths.count(); ++i)
+	{
+		const QString iconName(iconNames.value(i));
+
+		completions.append(CompletionEntry(paths.at(i), paths.at(i), QString(), QIcon::fromTheme(iconName, iconProvider.icon((iconName == QLatin1String("inode-directory")) ? QFileIconProvider::Folder : QFileIconProvider::File)), LocalPathType));
+	}
+
+	setSectionCompletions(LocalPathsSection, completions);
+
+	if (!m_completions.isEmpty() || (m_pendingSections.isEmpty() && !m_isWaitingForPages))
+	{
+		updateLatencyStatistics();
+
+		emit completionReady(m_filter);
+	}
+}
+
+void AddressCompletionModel::findPages(FullTextIndex *index, const QString &filter, int generation)
+{
+	const QList<FullTextIndex::DocumentMatch> pages(index->findDocuments(filter, 10));
+	QStringList urls;
+	QStringList titles;
+
+	if (generation != m_generation.load())
+	{
+		return;
+	}
+
+	for (int i = 0; i < pages.count(); ++i)
+	{
+		urls.append(pages.at(i).url.toString());
+		titles.append(pages.at(i).title);
+	}
+
+	QMetaObject::invokeMethod(this, "handlePages", Qt::QueuedConnection, Q_ARG(QStringList, urls), Q_ARG(QStringList, titles), Q_ARG(int, generation));
+}
+
+void AddressCompletionModel::handlePages(const QStringList &urls, const QStringList &titles, int generation)
+{
+	if (generation != m_generation.load())
+	{
+		return;
+	}
+
+	m_isWaitingForPages = false;
+
+	int offset(0);
+
+	for (int i = 0; i < HistorySection; ++i)
+	{
+		offset += m_sectionSizes.at(i);
+	}
+
+	QSet<QUrl> historyUrls;
+
+	for (int i = offset; i < (offset + m_sectionSizes.at(HistorySection)); ++i)
+	{
+		historyUrls.insert(Utils::normalizeUrl(m_completions.at(i).url));
+	}
+
+///NOTE Pages containing typed words are suggested after entries matching by address or title
+	QList<CompletionEntry> completions;
+	int amount(0);
+
+	for (int i = 0; (i < urls.count() && amount < 5); ++i)
+	{
+		const QUrl url(urls.at(i));
+
+		if (historyUrls.contains(url))
+		{
+			continue;
 		}
 
-		if (m_types.testFlag(LocalPathSuggestionsCompletionType) && m_filter.contains(QDir::separator()))
+		if (m_showCompletionCategories && m_sectionSizes.at(HistorySection) == 0 && amount == 0)
 		{
-			const QString directory(m_filter.section(QDir::separator(), 0, -2) + QDir::separator());
-			const QString prefix(m_filter.section(QDir::separator(), -1, -1));
-			const QList<QFileInfo> entries(QDir(Utils::normalizePath(directory)).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot));
-			const QFileIconProvider iconProvider;
-			bool wasAdded(!m_showCompletionCategories);
+			completions.append(CompletionEntry(QUrl(), tr("History"), QString(), QIcon(), HeaderType));
+		}
 
-			for (int i = 0; i < entries.count(); ++i)
-			{
-				if (entries.at(i).fileName().startsWith(prefix, Qt::CaseInsensitive))
-				{
-					const QString path(directory + entries.at(i).fileName());
-					const QMimeType type(QMimeDatabase().mimeTypeForFile(entries.at(i), QMimeDatabase::MatchExtension));
+		completions.append(CompletionEntry(url, titles.value(i), QString(), HistoryManager::getIcon(url), HistoryType));
 
-					if (!wasAdded)
-					{
-						completions.append(CompletionEntry(QUrl(), tr("Local files"), QString(), QIcon(), HeaderType));
+		historyUrls.insert(url);
 
-						wasAdded = true;
-					}
+		++amount;
+	}
 
-					completions.append(CompletionEntry(path, path, QString(), QIcon::fromTheme(type.iconName(), iconProvider.icon(entries.at(i))), LocalPathType));
-				}
-			}
+	setSectionCompletions(PagesSection, completions);
+
+	if (!m_completions.isEmpty() || (m_pendingSections.isEmpty() && !m_isWaitingForLocalPaths))
+	{
+		updateLatencyStatistics();
+
+		emit completionReady(m_filter);
+	}
+}
+
+void AddressCompletionModel::updateLatencyStatistics()
+{
+	if (!m_latencyTimer.isValid() || m_completions.isEmpty())
+	{
+		return;
+	}
+
+	m_latencies.append(m_latencyTimer.elapsed());
+
+	m_latencyTimer.invalidate();
+
+	if (m_latencies.count() < 50)
+	{
+		return;
+	}
+
+	const int middle(m_latencies.count() / 2);
+
+	std::nth_element(m_latencies.begin(), (m_latencies.begin() + middle), m_latencies.end());
+
+	Console::addMessage(tr("Median time from keystroke to address completion: %1 ms").arg(m_latencies.at(middle)), OtherMessageCategory, LogMessageLevel);
+
+	m_latencies.clear();
+}
+
+void AddressCompletionModel::setSectionCompletions(CompletionSection section, const QList<CompletionEntry> &completions)
+{
+	int offset(0);
+
+	for (int i = 0; i < section; ++i)
+	{
+		offset += m_sectionSizes.at(i);
+	}
+
+	if (m_sectionSizes.at(section) > 0)
+	{
+		beginRemoveRows(QModelIndex(), offset, (offset + m_sectionSizes.at(section) - 1));
+
+		m_completions.erase((m_completions.begin() + offset), (m_completions.begin() + offset + m_sectionSizes.at(section)));
+
+		m_sectionSizes[section] = 0;
+
+		endRemoveRows();
+	}
+
+	if (!completions.isEmpty())
+	{
+		beginInsertRows(QModelIndex(), offset, (offset + completions.count() - 1));
+
+		for (int i = 0; i < completions.count(); ++i)
+		{
+			m_completions.insert((offset + i), completions.at(i));
 		}
 
-		if (m_types.testFlag(HistoryCompletionType))
+		m_sectionSizes[section] = completions.count();
+
+		endInsertRows();
+	}
+}
+
+QList<AddressCompletionModel::CompletionEntry> AddressCompletionModel::createSearchSuggestionCompletions() const
+{
+	QList<CompletionEntry> completions;
+
+	if (!m_types.testFlag(SearchSuggestionsCompletionType))
+	{
+		return completions;
+	}
+
+	const QString keyword(m_filter.section(QLatin1Char(' '), 0, 0));
+	const SearchEnginesManager::SearchEngineDefinition searchEngine(SearchEnginesManager::getSearchEngine(keyword, true));
+	QString title(m_defaultSearchEngine.title);
+	QString text(m_filter);
+	QIcon icon(m_defaultSearchEngine.icon);
+
+	if (!searchEngine.identifier.isEmpty())
+	{
+		title = searchEngine.title;
+		text = m_filter.section(QLatin1Char(' '), 1, -1);
+		icon = searchEngine.icon;
+	}
+	else if (keyword == QLatin1String("?"))
+	{
+		text = m_filter.section(QLatin1Char(' '), 1, -1);
+	}
+
+	if (icon.isNull())
+	{
+		icon = ThemesManager::getIcon(QLatin1String("edit-find"));
+	}
+
+	if (m_showCompletionCategories)
+	{
+		completions.append(CompletionEntry(QUrl(), tr("Search with %1").arg(title), QString(), QIcon(), HeaderType));
+
+		title = QString();
+	}
+
+	CompletionEntry completionEntry(QUrl(), title, QString(), icon, SearchSuggestionType);
+	completionEntry.text = text;
+
+	completions.append(completionEntry);
+
+	return completions;
+}
+
+void AddressCompletionModel::updateBookmarkCandidates()
+{
+	if (m_bookmarkCandidatesFilter.isEmpty() || !m_filter.startsWith(m_bookmarkCandidatesFilter, Qt::CaseInsensitive))
+	{
+		m_bookmarkCandidates = BookmarksManager::findBookmarks(m_filter);
+		m_bookmarkCandidatesFilter = m_filter;
+
+		connect(BookmarksManager::getModel(), SIGNAL(modelModified()), this, SLOT(clearCandidates()), Qt::UniqueConnection);
+
+		return;
+	}
+
+///NOTE Longer filter can only match subset of previous matches, so these are checked again instead of searching all bookmarks
+	QList<BookmarksModel::BookmarkMatch> keywordMatches;
+	QList<BookmarksModel::BookmarkMatch> urlMatches;
+	QSet<QUrl> urls;
+
+	for (int i = 0; i < m_bookmarkCandidates.count(); ++i)
+	{
+		BookmarksModel::BookmarkMatch match(m_bookmarkCandidates.at(i));
+		const QString keyword(match.bookmark->data(BookmarksModel::KeywordRole).toString());
+		const QUrl url(match.bookmark->data(BookmarksModel::UrlRole).toUrl());
+
+		if (!keyword.isEmpty() && keyword.startsWith(m_filter, Qt::CaseInsensitive))
 		{
-			const QList<HistoryModel::HistoryEntryMatch> entries = HistoryManager::findEntries(m_filter);
+			match.match = keyword;
 
-			if (m_showCompletionCategories && !entries.isEmpty())
-			{
-				completions.append(CompletionEntry(QUrl(), tr("History"), QString(), QIcon(), HeaderType));
-			}
+			keywordMatches.append(match);
 
-			for (int i = 0; i < entries.count(); ++i)
-			{
-				completions.append(CompletionEntry(entries.at(i).entry->data(HistoryModel::UrlRole).toUrl(), entries.at(i).entry->data(HistoryModel::TitleRole).toString(), entries.at(i).match, entries.at(i).entry->data(Qt::DecorationRole).value<QIcon>(), (entries.at(i).isTypedIn ? TypedInHistoryType : HistoryType)));
-			}
+			continue;
 		}
 
-		if (m_types.testFlag(SpecialPagesCompletionType))
+		if (urls.contains(url))
 		{
-			const QStringList specialPages = AddonsManager::getSpecialPages();
-			bool wasAdded(!m_showCompletionCategories);
+			continue;
+		}
 
-			for (int i = 0; i < specialPages.count(); ++i)
-			{
-				const AddonsManager::SpecialPageInformation information = AddonsManager::getSpecialPage(specialPages.at(i));
+		match.match = Utils::matchUrl(url, m_filter);
 
-				if (information.url.toString().startsWith(m_filter))
-				{
-					if (!wasAdded)
-					{
-						completions.append(CompletionEntry(QUrl(), tr("Special pages"), QString(), QIcon(), HeaderType));
+		if (!match.match.isEmpty())
+		{
+			urlMatches.append(match);
 
-						wasAdded = true;
-					}
+			urls.insert(url);
+		}
+	}
 
-					completions.append(CompletionEntry(information.url, information.getTitle(), QString(), information.icon, SpecialPageType));
-				}
-			}
+	std::stable_sort(urlMatches.begin(), urlMatches.end(), compareBookmarkMatches);
+
+	m_bookmarkCandidates = (keywordMatches + urlMatches);
+	m_bookmarkCandidatesFilter = m_filter;
+}
+
+void AddressCompletionModel::updateHistoryCandidates()
+{
+	if (m_historyCandidatesFilter.isEmpty() || !m_areHistoryCandidatesComplete || !m_filter.startsWith(m_historyCandidatesFilter, Qt::CaseInsensitive))
+	{
+		m_historyCandidates = HistoryManager::findEntries(m_filter, m_historyCandidatesLimit);
+		m_historyCandidatesFilter = m_filter;
+		m_areHistoryCandidatesComplete = (m_historyCandidates.count() < m_historyCandidatesLimit);
+
+		connect(HistoryManager::getBrowsingHistoryModel(), SIGNAL(modelModified()), this, SLOT(clearCandidates()), Qt::UniqueConnection);
+		connect(HistoryManager::getTypedHistoryModel(), SIGNAL(modelModified()), this, SLOT(clearCandidates()), Qt::UniqueConnection);
+		connect(HistoryManager::getBrowsingHistoryModel(), SIGNAL(entryAdded(quint64)), this, SLOT(clearCandidates()), Qt::UniqueConnection);
+		connect(HistoryManager::getTypedHistoryModel(), SIGNAL(entryAdded(quint64)), this, SLOT(clearCandidates()), Qt::UniqueConnection);
+
+		return;
+	}
+
+///NOTE Candidates are already sorted by score, which does not depend on filter, so filtering them keeps the order
+	QList<HistoryModel::HistoryEntryMatch> matches;
+
+	for (int i = 0; i < m_historyCandidates.count(); ++i)
+	{
+		HistoryModel::HistoryEntryMatch match(m_historyCandidates.at(i));
+
+		if (UrlIndex::matchUrl(match.entry.url, match.entry.title, m_filter, match.match))
+		{
+			matches.append(match);
 		}
+	}
 
-		beginResetModel();
+	m_historyCandidates = matches;
+	m_historyCandidatesFilter = m_filter;
+}
 
-		m_completions = completions;
+void AddressCompletionModel::clearCandidates()
+{
+	m_bookmarkCandidates.clear();
+	m_historyCandidates.clear();
+	m_bookmarkCandidatesFilter = QString();
+	m_historyCandidatesFilter = QString();
+	m_areHistoryCandidatesComplete = false;
+}
 
-		endResetModel();
+QList<AddressCompletionModel::CompletionEntry> AddressCompletionModel::createBookmarkCompletions()
+{
+	QList<CompletionEntry> completions;
 
-		emit completionReady(m_filter);
+	if (!m_types.testFlag(BookmarksCompletionType))
+	{
+		return completions;
+	}
+
+	updateBookmarkCandidates();
+
+	const QList<BookmarksModel::BookmarkMatch> bookmarks(m_bookmarkCandidates);
+
+	if (m_showCompletionCategories && !bookmarks.isEmpty())
+	{
+		completions.append(CompletionEntry(QUrl(), tr("Bookmarks"), QString(), QIcon(), HeaderType));
+	}
+
+	for (int i = 0; i < bookmarks.count(); ++i)
+	{
+		CompletionEntry completionEntry(bookmarks.at(i).bookmark->data(BookmarksModel::UrlRole).toUrl(), bookmarks.at(i).bookmark->data(BookmarksModel::TitleRole).toString(), bookmarks.at(i).match, bookmarks.at(i).bookmark->data(Qt::DecorationRole).value<QIcon>(), BookmarkType);
+		completionEntry.keyword = bookmarks.at(i).bookmark->data(BookmarksModel::KeywordRole).toString();
+
+		if (completionEntry.keyword.startsWith(m_filter))
+		{
+			completionEntry.match = completionEntry.keyword;
+		}
+
+		completions.append(completionEntry);
 	}
+
+	return completions;
+}
+
+QList<AddressCompletionModel::CompletionEntry> AddressCompletionModel::createHistoryCompletions()
+{
+	QList<CompletionEntry> completions;
+
+	if (!m_types.testFlag(HistoryCompletionType))
+	{
+		return completions;
+	}
+
+	updateHistoryCandidates();
+
+	const QList<HistoryModel::HistoryEntryMatch> entries(m_historyCandidates.mid(0, 20));
+
+	if (m_showCompletionCategories && !entries.isEmpty())
+	{
+		completions.append(CompletionEntry(QUrl(), tr("History"), QString(), QIcon(), HeaderType));
+	}
+
+	for (int i = 0; i < entries.count(); ++i)
+	{
+		completions.append(CompletionEntry(entries.at(i).entry.url, entries.at(i).entry.title, entries.at(i).match, entries.at(i).entry.icon, (entries.at(i).isTypedIn ? TypedInHistoryType : HistoryType)));
+	}
+
+	return completions;
+}
+
+QList<AddressCompletionModel::CompletionEntry> AddressCompletionModel::createSpecialPageCompletions() const
+{
+	QList<CompletionEntry> completions;
+
+	if (!m_types.testFlag(SpecialPagesCompletionType))
+	{
+		return completions;
+	}
+
+	const QStringList specialPages = AddonsManager::getSpecialPages();
+	bool wasAdded(!m_showCompletionCategories);
+
+	for (int i = 0; i < specialPages.count(); ++i)
+	{
+		const AddonsManager::SpecialPageInformation information = AddonsManager::getSpecialPage(specialPages.at(i));
+
+		if (information.url.toString().startsWith(m_filter))
+		{
+			if (!wasAdded)
+			{
+				completions.append(CompletionEntry(QUrl(), tr("Special pages"), QString(), QIcon(), HeaderType));
+
+				wasAdded = true;
+			}
+
+			completions.append(CompletionEntry(information.url, information.getTitle(), QString(), information.icon, SpecialPageType));
+		}
+	}
+
+	return completions;
 }
 
 void AddressCompletionModel::setFilter(const QString &filter)
@@ -227,6 +650,13 @@ void AddressCompletionModel::setFilter(const QString &filter)
 		}
 	}
 
+	if (filter != m_filter)
+	{
+		m_generation.fetchAndAddOrdered(1);
+
+		m_latencyTimer.start();
+	}
+
 	m_filter = filter;
 	m_showCompletionCategories = SettingsManager::getValue(QLatin1String("AddressField/ShowCompletionCategories")).toBool();
 
@@ -242,6 +672,15 @@ void AddressCompletionModel::setFilter(const QString &filter)
 		beginResetModel();
 
 		m_completions.clear();
+		m_pendingSections.clear();
+		m_sectionSizes.fill(0);
+
+		m_isWaitingForLocalPaths = false;
+		m_isWaitingForPages = false;
+
+		m_latencyTimer.invalidate();
+
+		clearCandidates();
 
 		endResetModel();
 
@@ -22,9 +22,14 @@
 #ifndef OTTER_ADDRESSCOMPLETIONMODEL_H
 #define OTTER_ADDRESSCOMPLETIONMODEL_H
 
+#include "../core/BookmarksModel.h"
+#include "../core/HistoryModel.h"
 #include "../core/SearchEnginesManager.h"
 
 #include <QtCore/QAbstractListModel>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFuture>
 #include <QtCore/QUrl>
 
 namespace Otter
@@ -41,8 +46,8 @@ public:
 		BookmarksCompletionType = 1,
 		HistoryCompletionType = 2,
 		SearchSuggestionsCompletionType = 4,
-		SpecialPagesCompletionType = 4,
-		LocalPathSuggestionsCompletionType = 5
+		SpecialPagesCompletionType = 8,
+		LocalPathSuggestionsCompletionType = 16
 	};
 
 	Q_DECLARE_FLAGS(CompletionTypes, CompletionType)
@@ -83,6 +88,7 @@ public:
 	};
 
 	explicit AddressCompletionModel(QObject *parent = NULL);
+	~AddressCompletionModel();
 
 	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
 	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
@@ -93,15 +99,59 @@ public slots:
 	void setFilter(const QString &filter = QString());
 
 protected:
+	enum CompletionSection
+	{
+		SearchSuggestionsSection = 0,
+		BookmarksSection,
+		LocalPathsSection,
+		HistorySection,
+		PagesSection,
+		SpecialPagesSection
+	};
+
 	void timerEvent(QTimerEvent *event);
+	void findLocalPaths(const QString &filter, int generation);
+	void findPages(FullTextIndex *index, const QString &filter, int generation);
+	void updateBookmarkCandidates();
+	void updateHistoryCandidates();
+	void updateLatencyStatistics();
+	void setSectionCompletions(CompletionSection section, const QList<CompletionEntry> &completions);
+	QList<CompletionEntry> createSearchSuggestionCompletions() const;
+	QList<CompletionEntry> createBookmarkCompletions();
+	QList<CompletionEntry> createHistoryCompletions();
+	QList<CompletionEntry> createSpecialPageCompletions() const;
+	static bool compareBookmarkMatches(const BookmarksModel::BookmarkMatch &first, const BookmarksModel::BookmarkMatch &second);
+	static bool compareLocalPaths(const QFileInfo &first, const QFileInfo &second);
+
+protected slots:
+	void clearCandidates();
+	void updateCompletions(int generation);
+	void handleLocalPaths(const QStringList &paths, const QStringList &iconNames, int generation);
+	void handlePages(const QStringList &urls, const QStringList &titles, int generation);
 
 private:
 	QList<CompletionEntry> m_completions;
+	QList<CompletionSection> m_pendingSections;
+	QList<BookmarksModel::BookmarkMatch> m_bookmarkCandidates;
+	QList<HistoryModel::HistoryEntryMatch> m_historyCandidates;
+	QVector<int> m_sectionSizes;
+	QVector<qint64> m_latencies;
 	QString m_filter;
+	QString m_bookmarkCandidatesFilter;
+	QString m_historyCandidatesFilter;
+	QElapsedTimer m_latencyTimer;
+	QFuture<void> m_localPathsFuture;
+	QFuture<void> m_pagesFuture;
 	SearchEnginesManager::SearchEngineDefinition m_defaultSearchEngine;
 	AddressCompletionModel::CompletionTypes m_types;
+	QAtomicInt m_generation;
 	int m_updateTimer;
 	bool m_showCompletionCategories;
+	bool m_areHistoryCandidatesComplete;
+	bool m_isWaitingForLocalPaths;
+	bool m_isWaitingForPages;
+
+	static const int m_historyCandidatesLimit;
 
 signals:
 	void completionReady(const QString &filter);
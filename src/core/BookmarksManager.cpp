@@ -46,7 +46,7 @@ void BookmarksManager::timerEvent(QTimerEvent *event)
 
 		if (m_model)
 		{
-			m_model->save(SessionsManager::getWritableDataPath(QLatin1String("bookmarks.xbel")));
+			m_model->save();
 		}
 	}
 }
@@ -59,6 +59,34 @@ void BookmarksManager::createInstance(QObject *parent)
 	}
 }
 
+void BookmarksManager::beginBatch()
+{
+	if (!m_model)
+	{
+		getModel();
+	}
+
+	m_model->beginBatch();
+}
+
+void BookmarksManager::endBatch()
+{
+	if (!m_model)
+	{
+		return;
+	}
+
+	m_model->endBatch();
+
+	if (!m_model->isBatching() && m_instance && m_instance->m_saveTimer != 0)
+	{
+		m_instance->killTimer(m_instance->m_saveTimer);
+		m_instance->m_saveTimer = 0;
+
+		m_model->save();
+	}
+}
+
 void BookmarksManager::scheduleSave()
 {
 	if (m_saveTimer == 0)
@@ -34,6 +34,8 @@ class BookmarksManager : public QObject
 
 public:
 	static void createInstance(QObject *parent = NULL);
+	static void beginBatch();
+	static void endBatch();
 	static void updateVisits(const QUrl &url);
 	static void removeBookmark(const QUrl &url);
 	static void setLastUsedFolder(BookmarksItem *folder);
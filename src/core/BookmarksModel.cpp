@@ -24,15 +24,20 @@
 #include "ThemesManager.h"
 #include "Utils.h"
 
+#include <QtConcurrent/QtConcurrentRun>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
 #include <QtCore/QFile>
 #include <QtCore/QMimeData>
 #include <QtCore/QSaveFile>
+#include <QtCore/QSet>
 #include <QtWidgets/QMessageBox>
 
 namespace Otter
 {
 
+const int BookmarksModel::m_streamVersion(QDataStream::Qt_5_3);
+
 BookmarksItem::BookmarksItem() : QStandardItem()
 {
 }
@@ -196,7 +201,16 @@ QList<QUrl> BookmarksItem::getUrls() const
 }
 
 BookmarksModel::BookmarksModel(const QString &path, FormatMode mode, QObject *parent) : QStandardItemModel(parent),
-	m_mode(mode)
+	m_path(path),
+	m_urlIdentifier(0),
+	m_mode(mode),
+	m_journalRecords(0),
+	m_journalStreamVersion(m_streamVersion),
+	m_batchDepth(0),
+	m_isJournaling(false),
+	m_needsCompaction(false),
+	m_isCompacting(false),
+	m_hasBatchedChanges(false)
 {
 	BookmarksItem *rootItem(new BookmarksItem());
 	rootItem->setData(RootBookmark, TypeRole);
@@ -213,12 +227,22 @@ BookmarksModel::BookmarksModel(const QString &path, FormatMode mode, QObject *pa
 	appendRow(trashItem);
 	setItemPrototype(new BookmarksItem());
 
+	connect(this, SIGNAL(itemChanged(QStandardItem*)), this, SLOT(handleModelModified()));
+	connect(this, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(handleModelModified()));
+	connect(this, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(handleModelModified()));
+	connect(this, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(handleModelModified()));
+	connect(this, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(handleStructureModified()));
+	connect(this, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(handleStructureModified()));
+	connect(this, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(handleStructureModified()));
+
 	QFile file(path);
 
 	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
 	{
 		Console::addMessage(((mode == NotesMode) ? tr("Failed to open notes file: %1") : tr("Failed to open bookmarks file: %1")).arg(file.errorString()), OtherMessageCategory, ErrorMessageLevel, path);
 
+		m_isJournaling = true;
+
 		return;
 	}
 
@@ -245,15 +269,72 @@ BookmarksModel::BookmarksModel(const QString &path, FormatMode mode, QObject *pa
 
 				QMessageBox::warning(NULL, tr("Error"), ((m_mode == NotesMode) ? tr("Failed to load notes file.") : tr("Failed to load bookmarks file.")), QMessageBox::Close);
 
+				m_isJournaling = true;
+
 				return;
 			}
 		}
 	}
 
-	connect(this, SIGNAL(itemChanged(QStandardItem*)), this, SIGNAL(modelModified()));
-	connect(this, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SIGNAL(modelModified()));
-	connect(this, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SIGNAL(modelModified()));
-	connect(this, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), this, SIGNAL(modelModified()));
+	readJournal();
+
+	m_isJournaling = true;
+}
+
+BookmarksModel::~BookmarksModel()
+{
+	if (m_isCompacting)
+	{
+		m_compactionFuture.waitForFinished();
+
+		m_isCompacting = false;
+
+		if (!m_compactionFuture.result())
+		{
+			m_needsCompaction = true;
+		}
+	}
+
+	if (!SessionsManager::isReadOnly())
+	{
+		if (m_needsCompaction)
+		{
+			writeSnapshot(createSnapshot(item(0, 0)).children);
+		}
+		else
+		{
+			writePendingRecords();
+		}
+	}
+}
+
+void BookmarksModel::beginBatch()
+{
+	++m_batchDepth;
+}
+
+void BookmarksModel::endBatch()
+{
+	if (m_batchDepth == 0)
+	{
+		return;
+	}
+
+	--m_batchDepth;
+
+	if (m_batchDepth > 0 || !m_hasBatchedChanges)
+	{
+		return;
+	}
+
+	const QList<quint64> folders(m_batchedFolders.toList());
+
+	m_batchedFolders.clear();
+
+	m_hasBatchedChanges = false;
+
+	emit bookmarksChanged(folders);
+	emit modelModified();
 }
 
 void BookmarksModel::trashBookmark(BookmarksItem *bookmark)
@@ -274,17 +355,21 @@ void BookmarksModel::trashBookmark(BookmarksItem *bookmark)
 		else
 		{
 			BookmarksItem *trashItem(getTrashItem());
+			QStandardItem *formerParent(bookmark->parent());
 
-			m_trash[bookmark] = qMakePair(bookmark->parent()->index(), bookmark->row());
+			m_trash[bookmark] = qMakePair(formerParent->index(), bookmark->row());
 
 			trashItem->appendRow(bookmark->parent()->takeRow(bookmark->row()));
 			trashItem->setEnabled(true);
 
 			removeBookmarkUrl(bookmark);
 
-			emit bookmarkModified(bookmark);
-			emit bookmarkTrashed(bookmark);
-			emit modelModified();
+			if (!addBatchedChange(formerParent))
+			{
+				emit bookmarkModified(bookmark);
+				emit bookmarkTrashed(bookmark);
+				emit modelModified();
+			}
 		}
 	}
 }
@@ -320,9 +405,12 @@ void BookmarksModel::restoreBookmark(BookmarksItem *bookmark)
 
 	trashItem->setEnabled(trashItem->rowCount() > 0);
 
-	emit bookmarkModified(bookmark);
-	emit bookmarkRestored(bookmark);
-	emit modelModified();
+	if (!addBatchedChange(formerParent))
+	{
+		emit bookmarkModified(bookmark);
+		emit bookmarkRestored(bookmark);
+		emit modelModified();
+	}
 }
 
 void BookmarksModel::removeBookmark(BookmarksItem *bookmark)
@@ -341,16 +429,19 @@ void BookmarksModel::removeBookmark(BookmarksItem *bookmark)
 		m_identifiers.remove(identifier);
 	}
 
-	if (!bookmark->data(KeywordRole).toString().isEmpty() && m_keywords.contains(bookmark->data(KeywordRole).toString()))
-	{
-		m_keywords.remove(bookmark->data(KeywordRole).toString());
-	}
+	unregisterKeyword(bookmark->data(KeywordRole).toString());
 
+///NOTE Consumers may hold pointers to removed bookmark, so this one is never deferred
 	emit bookmarkRemoved(bookmark);
 
+	QStandardItem *parent(bookmark->parent());
+
 	bookmark->parent()->removeRow(bookmark->row());
 
-	emit modelModified();
+	if (!addBatchedChange(parent))
+	{
+		emit modelModified();
+	}
 }
 
 void BookmarksModel::readBookmark(QXmlStreamReader *reader, BookmarksItem *parent)
@@ -516,49 +607,44 @@ void BookmarksModel::readBookmark(QXmlStreamReader *reader, BookmarksItem *paren
 	}
 }
 
-void BookmarksModel::writeBookmark(QXmlStreamWriter *writer, QStandardItem *bookmark) const
+void BookmarksModel::writeBookmark(QXmlStreamWriter *writer, const BookmarkSnapshot &bookmark) const
 {
-	if (!bookmark)
-	{
-		return;
-	}
-
-	switch (static_cast<BookmarkType>(bookmark->data(TypeRole).toInt()))
+	switch (bookmark.type)
 	{
 		case FolderBookmark:
 			writer->writeStartElement(QLatin1String("folder"));
-			writer->writeAttribute(QLatin1String("id"), QString::number(bookmark->data(IdentifierRole).toULongLong()));
+			writer->writeAttribute(QLatin1String("id"), QString::number(bookmark.identifier));
 
-			if (bookmark->data(TimeAddedRole).toDateTime().isValid())
+			if (bookmark.timeAdded.isValid())
 			{
-				writer->writeAttribute(QLatin1String("added"), bookmark->data(TimeAddedRole).toDateTime().toString(Qt::ISODate));
+				writer->writeAttribute(QLatin1String("added"), bookmark.timeAdded.toString(Qt::ISODate));
 			}
 
-			if (bookmark->data(TimeModifiedRole).toDateTime().isValid())
+			if (bookmark.timeModified.isValid())
 			{
-				writer->writeAttribute(QLatin1String("modified"), bookmark->data(TimeModifiedRole).toDateTime().toString(Qt::ISODate));
+				writer->writeAttribute(QLatin1String("modified"), bookmark.timeModified.toString(Qt::ISODate));
 			}
 
-			writer->writeTextElement(QLatin1String("title"), bookmark->data(TitleRole).toString());
+			writer->writeTextElement(QLatin1String("title"), bookmark.title);
 
-			if (!bookmark->data(DescriptionRole).toString().isEmpty())
+			if (!bookmark.description.isEmpty())
 			{
-				writer->writeTextElement(QLatin1String("desc"), bookmark->data(DescriptionRole).toString());
+				writer->writeTextElement(QLatin1String("desc"), bookmark.description);
 			}
 
-			if (m_mode == BookmarksMode && !bookmark->data(KeywordRole).toString().isEmpty())
+			if (m_mode == BookmarksMode && !bookmark.keyword.isEmpty())
 			{
 				writer->writeStartElement(QLatin1String("info"));
 				writer->writeStartElement(QLatin1String("metadata"));
 				writer->writeAttribute(QLatin1String("owner"), QLatin1String("http://otter-browser.org/otter-xbel-bookmark"));
-				writer->writeTextElement(QLatin1String("keyword"), bookmark->data(KeywordRole).toString());
+				writer->writeTextElement(QLatin1String("keyword"), bookmark.keyword);
 				writer->writeEndElement();
 				writer->writeEndElement();
 			}
 
-			for (int i = 0; i < bookmark->rowCount(); ++i)
+			for (int i = 0; i < bookmark.children.count(); ++i)
 			{
-				writeBookmark(writer, bookmark->child(i, 0));
+				writeBookmark(writer, bookmark.children.at(i));
 			}
 
 			writer->writeEndElement();
@@ -566,52 +652,52 @@ void BookmarksModel::writeBookmark(QXmlStreamWriter *writer, QStandardItem *book
 			break;
 		case UrlBookmark:
 			writer->writeStartElement(QLatin1String("bookmark"));
-			writer->writeAttribute(QLatin1String("id"), QString::number(bookmark->data(IdentifierRole).toULongLong()));
+			writer->writeAttribute(QLatin1String("id"), QString::number(bookmark.identifier));
 
-			if (!bookmark->data(UrlRole).toString().isEmpty())
+			if (!bookmark.url.isEmpty())
 			{
-				writer->writeAttribute(QLatin1String("href"), bookmark->data(UrlRole).toString());
+				writer->writeAttribute(QLatin1String("href"), bookmark.url);
 			}
 
-			if (bookmark->data(TimeAddedRole).toDateTime().isValid())
+			if (bookmark.timeAdded.isValid())
 			{
-				writer->writeAttribute(QLatin1String("added"), bookmark->data(TimeAddedRole).toDateTime().toString(Qt::ISODate));
+				writer->writeAttribute(QLatin1String("added"), bookmark.timeAdded.toString(Qt::ISODate));
 			}
 
-			if (bookmark->data(TimeModifiedRole).toDateTime().isValid())
+			if (bookmark.timeModified.isValid())
 			{
-				writer->writeAttribute(QLatin1String("modified"), bookmark->data(TimeModifiedRole).toDateTime().toString(Qt::ISODate));
+				writer->writeAttribute(QLatin1String("modified"), bookmark.timeModified.toString(Qt::ISODate));
 			}
 
 			if (m_mode != NotesMode)
 			{
-				if (bookmark->data(TimeVisitedRole).toDateTime().isValid())
+				if (bookmark.timeVisited.isValid())
 				{
-					writer->writeAttribute(QLatin1String("visited"), bookmark->data(TimeVisitedRole).toDateTime().toString(Qt::ISODate));
+					writer->writeAttribute(QLatin1String("visited"), bookmark.timeVisited.toString(Qt::ISODate));
 				}
 
-				writer->writeTextElement(QLatin1String("title"), bookmark->data(TitleRole).toString());
+				writer->writeTextElement(QLatin1String("title"), bookmark.title);
 			}
 
-			if (!bookmark->data(DescriptionRole).toString().isEmpty())
+			if (!bookmark.description.isEmpty())
 			{
-				writer->writeTextElement(QLatin1String("desc"), bookmark->data(DescriptionRole).toString());
+				writer->writeTextElement(QLatin1String("desc"), bookmark.description);
 			}
 
-			if (m_mode == BookmarksMode && (!bookmark->data(KeywordRole).toString().isEmpty() || bookmark->data(VisitsRole).toInt() > 0))
+			if (m_mode == BookmarksMode && (!bookmark.keyword.isEmpty() || bookmark.visits > 0))
 			{
 				writer->writeStartElement(QLatin1String("info"));
 				writer->writeStartElement(QLatin1String("metadata"));
 				writer->writeAttribute(QLatin1String("owner"), QLatin1String("http://otter-browser.org/otter-xbel-bookmark"));
 
-				if (!bookmark->data(KeywordRole).toString().isEmpty())
+				if (!bookmark.keyword.isEmpty())
 				{
-					writer->writeTextElement(QLatin1String("keyword"), bookmark->data(KeywordRole).toString());
+					writer->writeTextElement(QLatin1String("keyword"), bookmark.keyword);
 				}
 
-				if (bookmark->data(VisitsRole).toInt() > 0)
+				if (bookmark.visits > 0)
 				{
-					writer->writeTextElement(QLatin1String("visits"), QString::number(bookmark->data(VisitsRole).toInt()));
+					writer->writeTextElement(QLatin1String("visits"), QString::number(bookmark.visits));
 				}
 
 				writer->writeEndElement();
@@ -644,17 +730,7 @@ void BookmarksModel::removeBookmarkUrl(BookmarksItem *bookmark)
 	}
 	else if (!bookmark->data(UrlRole).toUrl().isEmpty())
 	{
-		const QUrl url(Utils::normalizeUrl(bookmark->data(UrlRole).toUrl()));
-
-		if (m_urls.contains(url))
-		{
-			m_urls[url].removeAll(bookmark);
-
-			if (m_urls[url].isEmpty())
-			{
-				m_urls.remove(url);
-			}
-		}
+		unregisterUrl(Utils::normalizeUrl(bookmark->data(UrlRole).toUrl()), bookmark);
 	}
 }
 
@@ -674,14 +750,233 @@ void BookmarksModel::readdBookmarkUrl(BookmarksItem *bookmark)
 	}
 	else if (!bookmark->data(UrlRole).toUrl().isEmpty())
 	{
-		const QUrl url(Utils::normalizeUrl(bookmark->data(UrlRole).toUrl()));
+		registerUrl(Utils::normalizeUrl(bookmark->data(UrlRole).toUrl()), bookmark);
+	}
+}
+
+void BookmarksModel::registerUrl(const QUrl &url, BookmarksItem *bookmark)
+{
+	if (url.isEmpty())
+	{
+		return;
+	}
+
+	QList<BookmarksItem*> &bookmarks(m_urls[url]);
+
+	if (bookmarks.isEmpty())
+	{
+		const quint64 identifier(++m_urlIdentifier);
+
+		m_urlIdentifiers[url] = identifier;
+		m_indexedUrls[identifier] = url;
+
+		m_urlIndex.addUrl(identifier, url);
+	}
+
+	bookmarks.append(bookmark);
+}
+
+void BookmarksModel::unregisterUrl(const QUrl &url, BookmarksItem *bookmark)
+{
+	if (url.isEmpty() || !m_urls.contains(url))
+	{
+		return;
+	}
+
+	m_urls[url].removeAll(bookmark);
+
+	if (m_urls[url].isEmpty())
+	{
+		const quint64 identifier(m_urlIdentifiers.take(url));
+
+		m_urls.remove(url);
+		m_indexedUrls.remove(identifier);
+
+		m_urlIndex.removeUrl(identifier);
+	}
+}
+
+void BookmarksModel::registerKeyword(const QString &keyword, BookmarksItem *bookmark)
+{
+	if (keyword.isEmpty())
+	{
+		return;
+	}
+
+	if (m_keywords.contains(keyword))
+	{
+		m_sortedKeywords.remove(keyword.toLower(), m_keywords[keyword]);
+	}
+
+	m_keywords[keyword] = bookmark;
+
+	m_sortedKeywords.insert(keyword.toLower(), bookmark);
+}
+
+void BookmarksModel::unregisterKeyword(const QString &keyword)
+{
+	if (keyword.isEmpty() || !m_keywords.contains(keyword))
+	{
+		return;
+	}
+
+	m_sortedKeywords.remove(keyword.toLower(), m_keywords.take(keyword));
+}
+
+void BookmarksModel::readJournal()
+{
+	QFile file(getJournalPath());
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return;
+	}
+
+	QDataStream stream(&file);
+	QByteArray magic;
+	qint32 version(0);
+
+	stream >> magic >> version;
+
+///NOTE Journal written without header uses format of Qt version which wrote it, it is still read but replaced by snapshot, so no records with another format are appended to it
+	if (magic != QByteArray("OTBJ"))
+	{
+		file.seek(0);
+
+		stream.resetStatus();
+		stream.setVersion(QDataStream::Qt_DefaultCompiledVersion);
+
+		m_needsCompaction = true;
+	}
+	else if (version <= 0 || version > QDataStream::Qt_DefaultCompiledVersion)
+	{
+		Console::addMessage(tr("Failed to load journal: %1").arg(tr("unsupported format")), OtherMessageCategory, ErrorMessageLevel, getJournalPath());
 
-		if (!m_urls.contains(url))
+		file.close();
+
+		m_needsCompaction = true;
+
+		return;
+	}
+	else
+	{
+		stream.setVersion(version);
+
+		m_journalStreamVersion = version;
+	}
+
+	qint64 validLength(file.pos());
+
+	while (!stream.atEnd())
+	{
+		quint64 identifier(0);
+		int role(0);
+		QVariant value;
+
+		stream >> identifier >> role >> value;
+
+		if (stream.status() != QDataStream::Ok)
 		{
-			m_urls[url] = QList<BookmarksItem*>();
+			break;
 		}
 
-		m_urls[url].append(bookmark);
+		validLength = file.pos();
+
+		BookmarksItem *bookmark(getBookmark(identifier));
+
+		if (bookmark)
+		{
+			setData(bookmark->index(), value, role);
+		}
+
+		++m_journalRecords;
+	}
+
+	const qint64 size(file.size());
+
+	file.close();
+
+///NOTE Records appended after damaged one would never be read, so journal is cut at last valid record
+	if (validLength < size && !m_needsCompaction && !SessionsManager::isReadOnly())
+	{
+		Console::addMessage(tr("Journal was damaged, discarding %n byte(s) of invalid data", "", (size - validLength)), OtherMessageCategory, ErrorMessageLevel, getJournalPath());
+
+		if (!QFile::resize(getJournalPath(), validLength))
+		{
+			m_needsCompaction = true;
+		}
+	}
+}
+
+void BookmarksModel::appendRecord(BookmarksItem *bookmark, int role, const QVariant &value)
+{
+	const quint64 identifier(bookmark->data(IdentifierRole).toULongLong());
+
+///NOTE Changes made after structure was modified will be included in next snapshot anyway
+	if (!m_isJournaling || m_needsCompaction || identifier == 0)
+	{
+		return;
+	}
+
+///NOTE Only latest value of each field is written, so repeated edits, like typing note text, do not grow journal
+	const QPair<quint64, int> key(identifier, role);
+
+	if (!m_pendingRecords.contains(key))
+	{
+		++m_journalRecords;
+	}
+
+	m_pendingRecords[key] = value;
+}
+
+void BookmarksModel::compactJournal()
+{
+	const QList<BookmarkSnapshot> bookmarks(createSnapshot(item(0, 0)).children);
+
+	m_pendingRecords.clear();
+
+	m_journalRecords = 0;
+	m_needsCompaction = false;
+	m_isCompacting = true;
+	m_compactionFuture = QtConcurrent::run(this, &BookmarksModel::writeSnapshot, bookmarks);
+}
+
+void BookmarksModel::handleModelModified()
+{
+	if (!addBatchedChange(NULL))
+	{
+		emit modelModified();
+	}
+}
+
+void BookmarksModel::handleStructureModified()
+{
+	if (!m_isJournaling)
+	{
+		return;
+	}
+
+	m_pendingRecords.clear();
+
+	m_needsCompaction = true;
+}
+
+void BookmarksModel::handleJournalCompacted(bool isSuccess)
+{
+	if (!m_isCompacting)
+	{
+		return;
+	}
+
+	m_isCompacting = false;
+
+	if (!isSuccess)
+	{
+		m_needsCompaction = true;
+	}
+	else if (!m_needsCompaction)
+	{
+		writePendingRecords();
 	}
 }
 
@@ -693,7 +988,10 @@ void BookmarksModel::emptyTrash()
 
 	m_trash.clear();
 
-	emit modelModified();
+	if (!addBatchedChange(NULL))
+	{
+		emit modelModified();
+	}
 }
 
 BookmarksItem* BookmarksModel::addBookmark(BookmarkType type, quint64 identifier, const QUrl &url, const QString &title, BookmarksItem *parent, int index)
@@ -739,12 +1037,47 @@ BookmarksItem* BookmarksModel::addBookmark(BookmarkType type, quint64 identifier
 
 	blockSignals(false);
 
-	emit bookmarkAdded(bookmark);
-	emit modelModified();
+	handleStructureModified();
+
+	if (!addBatchedChange(bookmark->parent()))
+	{
+		emit bookmarkAdded(bookmark);
+		emit modelModified();
+	}
 
 	return bookmark;
 }
 
+BookmarksModel::BookmarkSnapshot BookmarksModel::createSnapshot(QStandardItem *bookmark) const
+{
+	BookmarkSnapshot snapshot;
+	snapshot.title = bookmark->data(TitleRole).toString();
+	snapshot.description = bookmark->data(DescriptionRole).toString();
+	snapshot.keyword = bookmark->data(KeywordRole).toString();
+	snapshot.url = bookmark->data(UrlRole).toString();
+	snapshot.timeAdded = bookmark->data(TimeAddedRole).toDateTime();
+	snapshot.timeModified = bookmark->data(TimeModifiedRole).toDateTime();
+	snapshot.timeVisited = bookmark->data(TimeVisitedRole).toDateTime();
+	snapshot.identifier = bookmark->data(IdentifierRole).toULongLong();
+	snapshot.visits = bookmark->data(VisitsRole).toInt();
+	snapshot.type = static_cast<BookmarkType>(bookmark->data(TypeRole).toInt());
+
+	for (int i = 0; i < bookmark->rowCount(); ++i)
+	{
+		if (bookmark->child(i, 0))
+		{
+			snapshot.children.append(createSnapshot(bookmark->child(i, 0)));
+		}
+	}
+
+	return snapshot;
+}
+
+QString BookmarksModel::getJournalPath() const
+{
+	return m_path + QLatin1String(".journal");
+}
+
 BookmarksItem* BookmarksModel::getBookmark(const QString &keyword) const
 {
 	if (m_keywords.contains(keyword))
@@ -863,24 +1196,29 @@ QStringList BookmarksModel::getKeywords() const
 
 QList<BookmarksModel::BookmarkMatch> BookmarksModel::findBookmarks(const QString &prefix) const
 {
-	QList<BookmarksItem*> matchedBookmarks;
+	QSet<BookmarksItem*> matchedBookmarks;
 	QList<BookmarksModel::BookmarkMatch> allMatches;
 	QList<BookmarksModel::BookmarkMatch> currentMatches;
 	QMultiMap<QDateTime, BookmarksModel::BookmarkMatch> matchesMap;
-	QHash<QString, BookmarksItem*>::const_iterator keywordsIterator;
 
-	for (keywordsIterator = m_keywords.constBegin(); keywordsIterator != m_keywords.constEnd(); ++keywordsIterator)
+	if (prefix.isEmpty())
 	{
-		if (keywordsIterator.key().startsWith(prefix, Qt::CaseInsensitive))
-		{
-			BookmarksModel::BookmarkMatch match;
-			match.bookmark = keywordsIterator.value();
-			match.match = keywordsIterator.key();
+		return allMatches;
+	}
 
-			matchesMap.insert(match.bookmark->data(TimeVisitedRole).toDateTime(), match);
+	const QString lowerCasePrefix(prefix.toLower());
+	QMultiMap<QString, BookmarksItem*>::const_iterator keywordsIterator;
 
-			matchedBookmarks.append(match.bookmark);
-		}
+///NOTE Keywords are kept sorted in lower case, so all keywords starting with prefix are next to each other
+	for (keywordsIterator = m_sortedKeywords.lowerBound(lowerCasePrefix); keywordsIterator != m_sortedKeywords.constEnd() && keywordsIterator.key().startsWith(lowerCasePrefix); ++keywordsIterator)
+	{
+		BookmarksModel::BookmarkMatch match;
+		match.bookmark = keywordsIterator.value();
+		match.match = match.bookmark->data(KeywordRole).toString();
+
+		matchesMap.insert(match.bookmark->data(TimeVisitedRole).toDateTime(), match);
+
+		matchedBookmarks.insert(match.bookmark);
 	}
 
 	currentMatches = matchesMap.values();
@@ -892,27 +1230,24 @@ QList<BookmarksModel::BookmarkMatch> BookmarksModel::findBookmarks(const QString
 		allMatches.append(currentMatches.at(i));
 	}
 
-	QHash<QUrl, QList<BookmarksItem*> >::const_iterator urlsIterator;
+	const QList<UrlIndex::UrlMatch> urlMatches(m_urlIndex.findUrls(prefix, false));
 
-	for (urlsIterator = m_urls.constBegin(); urlsIterator != m_urls.constEnd(); ++urlsIterator)
+	for (int i = 0; i < urlMatches.count(); ++i)
 	{
-		if (urlsIterator.value().isEmpty() || matchedBookmarks.contains(urlsIterator.value().first()))
+		const QList<BookmarksItem*> bookmarks(m_urls.value(m_indexedUrls.value(urlMatches.at(i).identifier)));
+
+		if (bookmarks.isEmpty() || matchedBookmarks.contains(bookmarks.first()))
 		{
 			continue;
 		}
 
-		const QString result(Utils::matchUrl(urlsIterator.key(), prefix));
+		BookmarkMatch match;
+		match.bookmark = bookmarks.first();
+		match.match = urlMatches.at(i).match;
 
-		if (!result.isEmpty())
-		{
-			BookmarkMatch match;
-			match.bookmark = urlsIterator.value().first();
-			match.match = result;
+		matchesMap.insert(match.bookmark->data(TimeVisitedRole).toDateTime(), match);
 
-			matchesMap.insert(match.bookmark->data(TimeVisitedRole).toDateTime(), match);
-
-			matchedBookmarks.append(match.bookmark);
-		}
+		matchedBookmarks.insert(match.bookmark);
 	}
 
 	currentMatches = matchesMap.values();
@@ -995,7 +1330,10 @@ bool BookmarksModel::moveBookmark(BookmarksItem *bookmark, BookmarksItem *newPar
 			newParent->insertRow(newRow, bookmark);
 		}
 
-		emit modelModified();
+		if (!addBatchedChange(newParent))
+		{
+			emit modelModified();
+		}
 
 		return true;
 	}
@@ -1006,8 +1344,11 @@ bool BookmarksModel::moveBookmark(BookmarksItem *bookmark, BookmarksItem *newPar
 	{
 		newParent->appendRow(bookmark->parent()->takeRow(bookmark->row()));
 
-		emit bookmarkMoved(bookmark, previousParent, previousRow);
-		emit modelModified();
+		if (!addBatchedChange(previousParent) || !addBatchedChange(newParent))
+		{
+			emit bookmarkMoved(bookmark, previousParent, previousRow);
+			emit modelModified();
+		}
 
 		return true;
 	}
@@ -1021,8 +1362,11 @@ bool BookmarksModel::moveBookmark(BookmarksItem *bookmark, BookmarksItem *newPar
 
 	newParent->insertRow(targetRow, bookmark->parent()->takeRow(bookmark->row()));
 
-	emit bookmarkMoved(bookmark, previousParent, previousRow);
-	emit modelModified();
+	if (!addBatchedChange(previousParent) || !addBatchedChange(newParent))
+	{
+		emit bookmarkMoved(bookmark, previousParent, previousRow);
+		emit modelModified();
+	}
 
 	return true;
 }
@@ -1058,38 +1402,128 @@ bool BookmarksModel::dropMimeData(const QMimeData *data, Qt::DropAction action,
 	return false;
 }
 
-bool BookmarksModel::save(const QString &path) const
+bool BookmarksModel::save()
 {
 	if (SessionsManager::isReadOnly())
 	{
 		return false;
 	}
 
-	QSaveFile file(path);
+	if (m_isCompacting)
+	{
+		return true;
+	}
+
+	if (m_needsCompaction || m_journalRecords > (m_identifiers.count() + 1000))
+	{
+		compactJournal();
+
+		return true;
+	}
+
+	return writePendingRecords();
+}
+
+bool BookmarksModel::writeSnapshot(const QList<BookmarkSnapshot> &bookmarks)
+{
+	QSaveFile file(m_path);
+	bool isSuccess(file.open(QIODevice::WriteOnly));
+
+	if (isSuccess)
+	{
+		QXmlStreamWriter writer(&file);
+		writer.setAutoFormatting(true);
+		writer.setAutoFormattingIndent(-1);
+		writer.writeStartDocument();
+		writer.writeDTD(QLatin1String("<!DOCTYPE xbel>"));
+		writer.writeStartElement(QLatin1String("xbel"));
+		writer.writeAttribute(QLatin1String("version"), QLatin1String("1.0"));
+
+		for (int i = 0; i < bookmarks.count(); ++i)
+		{
+			writeBookmark(&writer, bookmarks.at(i));
+		}
 
-	if (!file.open(QIODevice::WriteOnly))
+		writer.writeEndDocument();
+
+		isSuccess = file.commit();
+	}
+
+///NOTE Journal only contains changes which were made before snapshot was taken, so it is no longer needed once snapshot is saved
+	if (isSuccess && QFile::exists(getJournalPath()))
+	{
+		isSuccess = QFile::remove(getJournalPath());
+	}
+
+	QMetaObject::invokeMethod(this, "handleJournalCompacted", Qt::QueuedConnection, Q_ARG(bool, isSuccess));
+
+	return isSuccess;
+}
+
+bool BookmarksModel::writePendingRecords()
+{
+	if (m_pendingRecords.isEmpty())
+	{
+		return true;
+	}
+
+	QFile file(getJournalPath());
+	const bool needsHeader(!file.exists() || file.size() == 0);
+
+///NOTE Records are written in format stored in header, so they are decoded the same way after upgrade of Qt
+	if (needsHeader)
+	{
+		m_journalStreamVersion = m_streamVersion;
+	}
+
+	QByteArray records;
+	QDataStream stream(&records, QIODevice::WriteOnly);
+	stream.setVersion(m_journalStreamVersion);
+
+	if (needsHeader)
+	{
+		stream << QByteArray("OTBJ") << qint32(m_journalStreamVersion);
+	}
+
+	QHash<QPair<quint64, int>, QVariant>::const_iterator iterator;
+
+	for (iterator = m_pendingRecords.constBegin(); iterator != m_pendingRecords.constEnd(); ++iterator)
+	{
+		stream << iterator.key().first << iterator.key().second << iterator.value();
+	}
+
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
 	{
 		return false;
 	}
 
-	QXmlStreamWriter writer(&file);
-	writer.setAutoFormatting(true);
-	writer.setAutoFormattingIndent(-1);
-	writer.writeStartDocument();
-	writer.writeDTD(QLatin1String("<!DOCTYPE xbel>"));
-	writer.writeStartElement(QLatin1String("xbel"));
-	writer.writeAttribute(QLatin1String("version"), QLatin1String("1.0"));
+	const bool isSuccess(file.write(records) == records.size());
+
+	file.close();
+
+	if (isSuccess)
+	{
+		m_pendingRecords.clear();
+	}
 
-	QStandardItem *rootItem(item(0, 0));
+	return isSuccess;
+}
 
-	for (int i = 0; i < rootItem->rowCount(); ++i)
+bool BookmarksModel::addBatchedChange(QStandardItem *folder)
+{
+	if (m_batchDepth == 0)
 	{
-		writeBookmark(&writer, rootItem->child(i, 0));
+		return false;
 	}
 
-	writer.writeEndDocument();
+	m_hasBatchedChanges = true;
+
+	if (folder && static_cast<BookmarkType>(folder->data(TypeRole).toInt()) != TrashBookmark)
+	{
+		m_batchedFolders.insert(folder->data(IdentifierRole).toULongLong());
+	}
 
-	return file.commit();
+	return true;
 }
 
 bool BookmarksModel::setData(const QModelIndex &index, const QVariant &value, int role)
@@ -1106,40 +1540,13 @@ bool BookmarksModel::setData(const QModelIndex &index, const QVariant &value, in
 		const QUrl oldUrl(Utils::normalizeUrl(index.data(UrlRole).toUrl()));
 		const QUrl newUrl(Utils::normalizeUrl(value.toUrl()));
 
-		if (!oldUrl.isEmpty() && m_urls.contains(oldUrl))
-		{
-			m_urls[oldUrl].removeAll(bookmark);
-
-			if (m_urls[oldUrl].isEmpty())
-			{
-				m_urls.remove(oldUrl);
-			}
-		}
-
-		if (!newUrl.isEmpty())
-		{
-			if (!m_urls.contains(newUrl))
-			{
-				m_urls[newUrl] = QList<BookmarksItem*>();
-			}
-
-			m_urls[newUrl].append(bookmark);
-		}
+		unregisterUrl(oldUrl, bookmark);
+		registerUrl(newUrl, bookmark);
 	}
 	else if (role == KeywordRole && value.toString() != index.data(KeywordRole).toString())
 	{
-		const QString oldKeyword(index.data(KeywordRole).toString());
-		const QString newKeyword(value.toString());
-
-		if (!oldKeyword.isEmpty() && m_keywords.contains(oldKeyword))
-		{
-			m_keywords.remove(oldKeyword);
-		}
-
-		if (!newKeyword.isEmpty())
-		{
-			m_keywords[newKeyword] = bookmark;
-		}
+		unregisterKeyword(index.data(KeywordRole).toString());
+		registerKeyword(value.toString(), bookmark);
 	}
 	else if (m_mode == NotesMode && role == DescriptionRole)
 	{
@@ -1155,16 +1562,30 @@ bool BookmarksModel::setData(const QModelIndex &index, const QVariant &value, in
 		case TitleRole:
 		case UrlRole:
 		case DescriptionRole:
-		case IdentifierRole:
-		case TypeRole:
 		case KeywordRole:
 		case TimeAddedRole:
 		case TimeModifiedRole:
 		case TimeVisitedRole:
 		case VisitsRole:
-			emit bookmarkModified(bookmark);
-			emit modelModified();
+			appendRecord(bookmark, role, value);
+
+			if (!addBatchedChange(bookmark->parent()))
+			{
+				emit bookmarkModified(bookmark);
+				emit modelModified();
+			}
+
+			break;
+		case IdentifierRole:
+		case TypeRole:
+			if (!addBatchedChange(bookmark->parent()))
+			{
+				emit bookmarkModified(bookmark);
+				emit modelModified();
+			}
 
+			break;
+		default:
 			break;
 	}
 
@@ -1181,4 +1602,9 @@ bool BookmarksModel::hasKeyword(const QString &keyword) const
 	return m_keywords.contains(keyword);
 }
 
+bool BookmarksModel::isBatching() const
+{
+	return (m_batchDepth > 0);
+}
+
 }
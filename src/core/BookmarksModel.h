@@ -20,6 +20,11 @@
 #ifndef OTTER_BOOKMARKSMODEL_H
 #define OTTER_BOOKMARKSMODEL_H
 
+#include "UrlIndex.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFuture>
+#include <QtCore/QSet>
 #include <QtCore/QUrl>
 #include <QtCore/QXmlStreamReader>
 #include <QtCore/QXmlStreamWriter>
@@ -90,7 +95,10 @@ public:
 	};
 
 	explicit BookmarksModel(const QString &path, FormatMode mode, QObject *parent = NULL);
+	~BookmarksModel();
 
+	void beginBatch();
+	void endBatch();
 	void trashBookmark(BookmarksItem *bookmark);
 	void restoreBookmark(BookmarksItem *bookmark);
 	void removeBookmark(BookmarksItem *bookmark);
@@ -110,26 +118,79 @@ public:
 	FormatMode getFormatMode() const;
 	bool moveBookmark(BookmarksItem *bookmark, BookmarksItem *newParent, int newRow = -1);
 	bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent);
-	bool save(const QString &path) const;
+	bool save();
 	bool setData(const QModelIndex &index, const QVariant &value, int role);
 	bool hasBookmark(const QUrl &url) const;
 	bool hasKeyword(const QString &keyword) const;
+	bool isBatching() const;
 
 public slots:
 	void emptyTrash();
 
 protected:
+	struct BookmarkSnapshot
+	{
+		QList<BookmarkSnapshot> children;
+		QString title;
+		QString description;
+		QString keyword;
+		QString url;
+		QDateTime timeAdded;
+		QDateTime timeModified;
+		QDateTime timeVisited;
+		quint64 identifier;
+		int visits;
+		BookmarkType type;
+
+		BookmarkSnapshot() : identifier(0), visits(0), type(UnknownBookmark) {}
+	};
+
 	void readBookmark(QXmlStreamReader *reader, BookmarksItem *parent);
-	void writeBookmark(QXmlStreamWriter *writer, QStandardItem *bookmark) const;
+	void readJournal();
+	void writeBookmark(QXmlStreamWriter *writer, const BookmarkSnapshot &bookmark) const;
+	void appendRecord(BookmarksItem *bookmark, int role, const QVariant &value);
+	void compactJournal();
 	void removeBookmarkUrl(BookmarksItem *bookmark);
 	void readdBookmarkUrl(BookmarksItem *bookmark);
+	void registerUrl(const QUrl &url, BookmarksItem *bookmark);
+	void unregisterUrl(const QUrl &url, BookmarksItem *bookmark);
+	void registerKeyword(const QString &keyword, BookmarksItem *bookmark);
+	void unregisterKeyword(const QString &keyword);
+	BookmarkSnapshot createSnapshot(QStandardItem *bookmark) const;
+	QString getJournalPath() const;
+	bool writeSnapshot(const QList<BookmarkSnapshot> &bookmarks);
+	bool writePendingRecords();
+	bool addBatchedChange(QStandardItem *folder);
+
+protected slots:
+	void handleModelModified();
+	void handleStructureModified();
+	void handleJournalCompacted(bool isSuccess);
 
 private:
+	UrlIndex m_urlIndex;
+	QString m_path;
+	QHash<QPair<quint64, int>, QVariant> m_pendingRecords;
+	QFuture<bool> m_compactionFuture;
 	QHash<BookmarksItem*, QPair<QModelIndex, int> > m_trash;
 	QHash<QUrl, QList<BookmarksItem*> > m_urls;
+	QHash<QUrl, quint64> m_urlIdentifiers;
+	QHash<quint64, QUrl> m_indexedUrls;
 	QHash<QString, BookmarksItem*> m_keywords;
+	QMultiMap<QString, BookmarksItem*> m_sortedKeywords;
 	QMap<quint64, BookmarksItem*> m_identifiers;
+	QSet<quint64> m_batchedFolders;
+	quint64 m_urlIdentifier;
 	FormatMode m_mode;
+	int m_journalRecords;
+	int m_journalStreamVersion;
+	int m_batchDepth;
+	bool m_isJournaling;
+	bool m_needsCompaction;
+	bool m_isCompacting;
+	bool m_hasBatchedChanges;
+
+	static const int m_streamVersion;
 
 signals:
 	void bookmarkAdded(BookmarksItem *bookmark);
@@ -138,6 +199,7 @@ signals:
 	void bookmarkTrashed(BookmarksItem *bookmark);
 	void bookmarkRestored(BookmarksItem *bookmark);
 	void bookmarkRemoved(BookmarksItem *bookmark);
+	void bookmarksChanged(const QList<quint64> &folders);
 	void modelModified();
 
 friend class BookmarksItem;
@@ -0,0 +1,1287 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Jan Bajer aka bajasoft <jbajer@gmail.com>
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#include "ContentBlockingIndex.h"
+
+#include <QtCore/QSaveFile>
+#include <QtCore/QSet>
+#include <QtCore/QVarLengthArray>
+
+#include <cstring>
+
+namespace Otter
+{
+
+const quint32 ContentBlockingIndex::m_version(4);
+
+ContentBlockingIndex::ContentBlockingIndex() : m_file(NULL),
+	m_data(NULL),
+	m_header(NULL),
+	m_rulesRecords(NULL),
+	m_domainsRecords(NULL),
+	m_bucketsRecords(NULL),
+	m_ruleIndexes(NULL),
+	m_styleSheetRecords(NULL),
+	m_styleSheetRulesRecords(NULL),
+	m_strings(NULL)
+{
+}
+
+ContentBlockingIndex::~ContentBlockingIndex()
+{
+	if (m_file)
+	{
+		m_file->close();
+
+		delete m_file;
+	}
+}
+
+void ContentBlockingIndex::addRule(const ContentBlockingProfile::ContentBlockingRule &rule)
+{
+	const int index(m_patterns.value(rule.pattern, -1));
+
+	if (index >= 0)
+	{
+		m_rules[index] = rule;
+
+		return;
+	}
+
+	m_patterns.insert(rule.pattern, m_rules.count());
+
+	m_rules.append(rule);
+	m_rulesProfiles.append(0);
+}
+
+void ContentBlockingIndex::addRule(const ContentBlockingProfile::ContentBlockingRule &rule, int profile)
+{
+	m_rules.append(rule);
+	m_rulesProfiles.append(profile);
+}
+
+void ContentBlockingIndex::addStyleSheetRule(const QString &rule)
+{
+	m_styleSheet.append(rule);
+}
+
+void ContentBlockingIndex::addStyleSheetRule(const QStringList &domains, const QString &rule, bool isException)
+{
+	for (int i = 0; i < domains.count(); ++i)
+	{
+		StyleSheetRule styleSheetRule;
+		styleSheetRule.domain = domains.at(i);
+		styleSheetRule.rule = rule;
+		styleSheetRule.isException = isException;
+
+		m_styleSheetRules.append(styleSheetRule);
+	}
+}
+
+void ContentBlockingIndex::optimize(const QByteArray &checksum)
+{
+	QString strings;
+	QHash<QString, quint32> stringsOffsets;
+	QHash<uint, int> tokensFrequency;
+	QVector<QVector<uint> > rulesTokens;
+	rulesTokens.reserve(m_rules.count());
+
+	for (int i = 0; i < m_rules.count(); ++i)
+	{
+		const QVector<uint> tokens(getRuleTokens(m_rules.at(i).pattern));
+
+		for (int j = 0; j < tokens.count(); ++j)
+		{
+			++tokensFrequency[tokens.at(j)];
+		}
+
+		rulesTokens.append(tokens);
+	}
+
+	QHash<uint, QVector<quint32> > tokenizedRules;
+	QVector<quint32> ruleIndexes;
+	QVector<RuleRecord> rules;
+	QVector<StringRecord> domains;
+	rules.reserve(m_rules.count());
+
+	for (int i = 0; i < m_rules.count(); ++i)
+	{
+		const ContentBlockingProfile::ContentBlockingRule &rule(m_rules.at(i));
+		RuleRecord record;
+		record.pattern = createString(rule.pattern, strings, stringsOffsets);
+		record.domainsOffset = domains.count();
+		record.blockedDomainsAmount = rule.blockedDomains.count();
+		record.allowedDomainsAmount = rule.allowedDomains.count();
+		record.ruleOption = static_cast<quint16>(rule.ruleOption);
+		record.exceptionRuleOption = static_cast<quint16>(rule.exceptionRuleOption);
+		record.isException = rule.isException;
+		record.needsDomainCheck = rule.needsDomainCheck;
+		record.hasWildcard = rule.pattern.contains(QLatin1Char('*'));
+		record.profile = m_rulesProfiles.at(i);
+
+		for (int j = 0; j < rule.blockedDomains.count(); ++j)
+		{
+			domains.append(createString(rule.blockedDomains.at(j), strings, stringsOffsets));
+		}
+
+		for (int j = 0; j < rule.allowedDomains.count(); ++j)
+		{
+			domains.append(createString(rule.allowedDomains.at(j), strings, stringsOffsets));
+		}
+
+		rules.append(record);
+
+		const QVector<uint> &tokens(rulesTokens.at(i));
+
+		if (tokens.isEmpty())
+		{
+			ruleIndexes.append(i);
+
+			continue;
+		}
+
+		uint rarestToken(tokens.at(0));
+		int rarestTokenFrequency(tokensFrequency.value(rarestToken));
+
+		for (int j = 1; j < tokens.count(); ++j)
+		{
+			const int frequency(tokensFrequency.value(tokens.at(j)));
+
+			if (frequency < rarestTokenFrequency)
+			{
+				rarestToken = tokens.at(j);
+				rarestTokenFrequency = frequency;
+			}
+		}
+
+		tokenizedRules[rarestToken].append(i);
+	}
+
+	const quint32 untokenizedRulesAmount(ruleIndexes.count());
+	quint32 bucketsAmount(1);
+
+	while (bucketsAmount < static_cast<quint32>(tokenizedRules.count() * 2))
+	{
+		bucketsAmount *= 2;
+	}
+
+	QVector<BucketRecord> buckets(bucketsAmount);
+
+	std::memset(buckets.data(), 0, (bucketsAmount * sizeof(BucketRecord)));
+
+	QHash<uint, QVector<quint32> >::const_iterator iterator;
+
+	for (iterator = tokenizedRules.constBegin(); iterator != tokenizedRules.constEnd(); ++iterator)
+	{
+		quint32 position(iterator.key() & (bucketsAmount - 1));
+
+		while (buckets.at(position).rulesAmount > 0)
+		{
+			position = ((position + 1) & (bucketsAmount - 1));
+		}
+
+		buckets[position].token = iterator.key();
+		buckets[position].rulesOffset = ruleIndexes.count();
+		buckets[position].rulesAmount = iterator.value().count();
+
+		ruleIndexes += iterator.value();
+	}
+
+	QSet<QString> addedStyleSheetRules;
+	QVector<StringRecord> styleSheet;
+	styleSheet.reserve(m_styleSheet.count());
+
+	for (int i = 0; i < m_styleSheet.count(); ++i)
+	{
+		if (!addedStyleSheetRules.contains(m_styleSheet.at(i)))
+		{
+			addedStyleSheetRules.insert(m_styleSheet.at(i));
+
+			styleSheet.append(createString(m_styleSheet.at(i), strings, stringsOffsets));
+		}
+	}
+
+///NOTE Domains are stored with reversed labels, so entries of every parent domain precede entries of its subdomains
+	for (int i = 0; i < m_styleSheetRules.count(); ++i)
+	{
+		m_styleSheetRules[i].domain = reverseDomain(m_styleSheetRules.at(i).domain);
+	}
+
+	qSort(m_styleSheetRules.begin(), m_styleSheetRules.end(), compareStyleSheetRules);
+
+	QVector<StyleSheetRuleRecord> styleSheetRules;
+	styleSheetRules.reserve(m_styleSheetRules.count());
+
+	for (int i = 0; i < m_styleSheetRules.count(); ++i)
+	{
+		const StyleSheetRule &rule(m_styleSheetRules.at(i));
+
+		if (i > 0 && rule.domain == m_styleSheetRules.at(i - 1).domain && rule.rule == m_styleSheetRules.at(i - 1).rule && rule.isException == m_styleSheetRules.at(i - 1).isException)
+		{
+			continue;
+		}
+
+		StyleSheetRuleRecord record;
+		record.domain = createString(rule.domain, strings, stringsOffsets);
+		record.rule = createString(rule.rule, strings, stringsOffsets);
+		record.isException = rule.isException;
+
+		styleSheetRules.append(record);
+	}
+
+	IndexHeader header;
+	std::memset(&header, 0, sizeof(IndexHeader));
+	std::memcpy(header.magic, "OTCB", 4);
+	std::memcpy(header.checksum, checksum.constData(), qMin(checksum.size(), 16));
+
+	header.version = m_version;
+	header.rulesAmount = rules.count();
+	header.rulesOffset = sizeof(IndexHeader);
+	header.domainsAmount = domains.count();
+	header.domainsOffset = (header.rulesOffset + (header.rulesAmount * sizeof(RuleRecord)));
+	header.bucketsAmount = bucketsAmount;
+	header.bucketsOffset = (header.domainsOffset + (header.domainsAmount * sizeof(StringRecord)));
+	header.ruleIndexesAmount = ruleIndexes.count();
+	header.ruleIndexesOffset = (header.bucketsOffset + (header.bucketsAmount * sizeof(BucketRecord)));
+	header.untokenizedRulesAmount = untokenizedRulesAmount;
+	header.styleSheetAmount = styleSheet.count();
+	header.styleSheetOffset = (header.ruleIndexesOffset + (header.ruleIndexesAmount * sizeof(quint32)));
+	header.styleSheetRulesAmount = styleSheetRules.count();
+	header.styleSheetRulesOffset = (header.styleSheetOffset + (header.styleSheetAmount * sizeof(StringRecord)));
+	header.stringsLength = strings.length();
+	header.stringsOffset = (header.styleSheetRulesOffset + (header.styleSheetRulesAmount * sizeof(StyleSheetRuleRecord)));
+	header.size = (header.stringsOffset + (header.stringsLength * sizeof(QChar)));
+
+	m_buffer = QByteArray(header.size, 0);
+
+	char *data(m_buffer.data());
+
+	std::memcpy(data, &header, sizeof(IndexHeader));
+	std::memcpy((data + header.rulesOffset), rules.constData(), (header.rulesAmount * sizeof(RuleRecord)));
+	std::memcpy((data + header.domainsOffset), domains.constData(), (header.domainsAmount * sizeof(StringRecord)));
+	std::memcpy((data + header.bucketsOffset), buckets.constData(), (header.bucketsAmount * sizeof(BucketRecord)));
+	std::memcpy((data + header.ruleIndexesOffset), ruleIndexes.constData(), (header.ruleIndexesAmount * sizeof(quint32)));
+	std::memcpy((data + header.styleSheetOffset), styleSheet.constData(), (header.styleSheetAmount * sizeof(StringRecord)));
+	std::memcpy((data + header.styleSheetRulesOffset), styleSheetRules.constData(), (header.styleSheetRulesAmount * sizeof(StyleSheetRuleRecord)));
+	std::memcpy((data + header.stringsOffset), strings.constData(), (header.stringsLength * sizeof(QChar)));
+
+	m_rules.clear();
+	m_rulesProfiles.clear();
+	m_styleSheetRules.clear();
+	m_styleSheet.clear();
+	m_patterns.clear();
+
+	setData(m_buffer.constData());
+}
+
+void ContentBlockingIndex::setData(const char *data)
+{
+	m_data = data;
+	m_header = reinterpret_cast<const IndexHeader*>(data);
+	m_rulesRecords = reinterpret_cast<const RuleRecord*>(data + m_header->rulesOffset);
+	m_domainsRecords = reinterpret_cast<const StringRecord*>(data + m_header->domainsOffset);
+	m_bucketsRecords = reinterpret_cast<const BucketRecord*>(data + m_header->bucketsOffset);
+	m_ruleIndexes = reinterpret_cast<const quint32*>(data + m_header->ruleIndexesOffset);
+	m_styleSheetRecords = reinterpret_cast<const StringRecord*>(data + m_header->styleSheetOffset);
+	m_styleSheetRulesRecords = reinterpret_cast<const StyleSheetRuleRecord*>(data + m_header->styleSheetRulesOffset);
+	m_strings = reinterpret_cast<const QChar*>(data + m_header->stringsOffset);
+
+///NOTE Selectors are turned into strings once, lookups only share them, so no text is copied when page is loaded
+	m_compiledStyleSheet.clear();
+	m_compiledStyleSheet.reserve(m_header->styleSheetAmount);
+
+	for (quint32 i = 0; i < m_header->styleSheetAmount; ++i)
+	{
+		m_compiledStyleSheet.append(QString(getString(m_styleSheetRecords[i]), m_styleSheetRecords[i].length));
+	}
+
+	m_compiledStyleSheetRules.clear();
+	m_compiledStyleSheetRules.reserve(m_header->styleSheetRulesAmount);
+
+	for (quint32 i = 0; i < m_header->styleSheetRulesAmount; ++i)
+	{
+		m_compiledStyleSheetRules.append(QString(getString(m_styleSheetRulesRecords[i].rule), m_styleSheetRulesRecords[i].rule.length));
+	}
+}
+
+void ContentBlockingIndex::resolveRuleOptions(const RuleRecord &rule, const QString &baseUrlHost, const QStringList &requestSubdomainList, ContentBlockingManager::ResourceType resourceType, bool &isBlocked) const
+{
+	const ContentBlockingProfile::RuleOptions ruleOption(QFlag(rule.ruleOption));
+	const ContentBlockingProfile::RuleOptions exceptionRuleOption(QFlag(rule.exceptionRuleOption));
+	const bool blockedDomains = (rule.blockedDomainsAmount > 0);
+	const bool allowedDomains = (rule.allowedDomainsAmount > 0);
+
+	isBlocked = ((blockedDomains) ? resolveDomainExceptions(baseUrlHost, (m_domainsRecords + rule.domainsOffset), rule.blockedDomainsAmount) : isBlocked);
+	isBlocked = ((allowedDomains) ? !resolveDomainExceptions(baseUrlHost, (m_domainsRecords + rule.domainsOffset + rule.blockedDomainsAmount), rule.allowedDomainsAmount) : isBlocked);
+
+	if (ruleOption.testFlag(ContentBlockingProfile::ThirdPartyOption))
+	{
+		if (baseUrlHost.isEmpty() || requestSubdomainList.contains(baseUrlHost))
+		{
+			isBlocked = exceptionRuleOption.testFlag(ContentBlockingProfile::ThirdPartyOption);
+		}
+		else if (!blockedDomains && !allowedDomains)
+		{
+			isBlocked = !exceptionRuleOption.testFlag(ContentBlockingProfile::ThirdPartyOption);
+		}
+	}
+
+	if (ruleOption.testFlag(ContentBlockingProfile::ImageOption))
+	{
+		if (resourceType == ContentBlockingManager::ImageType)
+		{
+			isBlocked = (isBlocked ? !exceptionRuleOption.testFlag(ContentBlockingProfile::ImageOption) : isBlocked);
+		}
+		else
+		{
+			isBlocked = (isBlocked ? exceptionRuleOption.testFlag(ContentBlockingProfile::ImageOption) : isBlocked);
+		}
+	}
+
+	if (ruleOption.testFlag(ContentBlockingProfile::ScriptOption))
+	{
+		if (resourceType == ContentBlockingManager::ScriptType)
+		{
+			isBlocked = (isBlocked ? !exceptionRuleOption.testFlag(ContentBlockingProfile::ScriptOption) : isBlocked);
+		}
+		else
+		{
+			isBlocked = (isBlocked ? exceptionRuleOption.testFlag(ContentBlockingProfile::ScriptOption) : isBlocked);
+		}
+	}
+
+	if (ruleOption.testFlag(ContentBlockingProfile::StyleSheetOption))
+	{
+		if (resourceType == ContentBlockingManager::StyleSheetType)
+		{
+			isBlocked = (isBlocked ? !exceptionRuleOption.testFlag(ContentBlockingProfile::StyleSheetOption) : isBlocked);
+		}
+		else
+		{
+			isBlocked = (isBlocked ? exceptionRuleOption.testFlag(ContentBlockingProfile::StyleSheetOption) : isBlocked);
+		}
+	}
+
+	if (ruleOption.testFlag(ContentBlockingProfile::ObjectOption))
+	{
+		if (resourceType == ContentBlockingManager::ObjectType)
+		{
+			isBlocked = (isBlocked ? !exceptionRuleOption.testFlag(ContentBlockingProfile::ObjectOption) : isBlocked);
+		}
+		else
+		{
+			isBlocked = (isBlocked ? exceptionRuleOption.testFlag(ContentBlockingProfile::ObjectOption) : isBlocked);
+		}
+	}
+
+	if (ruleOption.testFlag(ContentBlockingProfile::SubDocumentOption))
+	{
+		// TODO
+	}
+
+	if (ruleOption.testFlag(ContentBlockingProfile::ObjectSubRequestOption))
+	{
+		// TODO
+	}
+
+	if (ruleOption.testFlag(ContentBlockingProfile::XmlHttpRequestOption))
+	{
+		if (resourceType == ContentBlockingManager::XmlHttpRequestType)
+		{
+			isBlocked = (isBlocked ? !exceptionRuleOption.testFlag(ContentBlockingProfile::XmlHttpRequestOption) : isBlocked);
+		}
+		else
+		{
+			isBlocked = (isBlocked ? exceptionRuleOption.testFlag(ContentBlockingProfile::XmlHttpRequestOption) : isBlocked);
+		}
+	}
+}
+
+ContentBlockingIndex* ContentBlockingIndex::load(const QString &path, const QByteArray &checksum)
+{
+	QFile *file(new QFile(path));
+
+	if (!file->open(QIODevice::ReadOnly) || file->size() < static_cast<qint64>(sizeof(IndexHeader)))
+	{
+		delete file;
+
+		return NULL;
+	}
+
+	const char *data(reinterpret_cast<const char*>(file->map(0, file->size())));
+
+	if (!data || !isDataValid(data, file->size(), checksum))
+	{
+		file->close();
+
+		delete file;
+
+		return NULL;
+	}
+
+	ContentBlockingIndex *index(new ContentBlockingIndex());
+	index->m_file = file;
+	index->setData(data);
+
+	return index;
+}
+
+ContentBlockingIndex* ContentBlockingIndex::createMergedIndex(const QVector<const ContentBlockingIndex*> &indexes)
+{
+	ContentBlockingIndex *mergedIndex(new ContentBlockingIndex());
+	QHash<QString, QVector<int> > patterns;
+
+///NOTE Rules are added in order of profiles and duplicates are dropped, so every rule keeps the first profile defining it and rules of each bucket end up sorted by profile
+	for (int i = 0; i < indexes.count(); ++i)
+	{
+		const ContentBlockingIndex *index(indexes.at(i));
+
+		if (!index->m_header)
+		{
+			continue;
+		}
+
+		for (quint32 j = 0; j < index->m_header->rulesAmount; ++j)
+		{
+			const ContentBlockingProfile::ContentBlockingRule rule(index->getRule(index->m_rulesRecords[j]));
+			QVector<int> &definitions(patterns[rule.pattern]);
+			bool isDuplicate(false);
+
+			for (int k = 0; k < definitions.count(); ++k)
+			{
+				if (areRulesEqual(mergedIndex->m_rules.at(definitions.at(k)), rule))
+				{
+					isDuplicate = true;
+
+					break;
+				}
+			}
+
+			if (!isDuplicate)
+			{
+				definitions.append(mergedIndex->m_rules.count());
+
+				mergedIndex->addRule(rule, i);
+			}
+		}
+
+		for (quint32 j = 0; j < index->m_header->styleSheetAmount; ++j)
+		{
+			mergedIndex->addStyleSheetRule(QString(index->getString(index->m_styleSheetRecords[j]), index->m_styleSheetRecords[j].length));
+		}
+
+		for (quint32 j = 0; j < index->m_header->styleSheetRulesAmount; ++j)
+		{
+			const StyleSheetRuleRecord &record(index->m_styleSheetRulesRecords[j]);
+			StyleSheetRule rule;
+			rule.domain = reverseDomain(QString(index->getString(record.domain), record.domain.length));
+			rule.rule = QString(index->getString(record.rule), record.rule.length);
+			rule.isException = record.isException;
+
+			mergedIndex->m_styleSheetRules.append(rule);
+		}
+	}
+
+	mergedIndex->optimize();
+
+	return mergedIndex;
+}
+
+ContentBlockingIndex* ContentBlockingIndex::createUpdatedIndex(const ContentBlockingIndex *index, const ContentBlockingIndex &removedRules, const ContentBlockingIndex &addedRules, const QSet<QString> &retainedRules, const QByteArray &checksum)
+{
+	if (!index->m_header)
+	{
+		return NULL;
+	}
+
+///NOTE Removed rule could still be defined by another unchanged line of updated list (or overridden one could take its place), such updates require full parse
+	QSet<QString> removedPatterns;
+
+	for (int i = 0; i < removedRules.m_rules.count(); ++i)
+	{
+		const QString &pattern(removedRules.m_rules.at(i).pattern);
+
+		if (pattern.isEmpty() || retainedRules.contains(pattern))
+		{
+			return NULL;
+		}
+
+		removedPatterns.insert(pattern);
+	}
+
+	QSet<QString> removedStyleSheet;
+
+	for (int i = 0; i < removedRules.m_styleSheet.count(); ++i)
+	{
+		if (retainedRules.contains(removedRules.m_styleSheet.at(i)))
+		{
+			return NULL;
+		}
+
+		removedStyleSheet.insert(removedRules.m_styleSheet.at(i));
+	}
+
+	QSet<QString> removedStyleSheetRules;
+
+	for (int i = 0; i < removedRules.m_styleSheetRules.count(); ++i)
+	{
+		const StyleSheetRule &rule(removedRules.m_styleSheetRules.at(i));
+
+		if (retainedRules.contains(rule.rule))
+		{
+			return NULL;
+		}
+
+		removedStyleSheetRules.insert(reverseDomain(rule.domain) + (rule.isException ? QLatin1String("#@#") : QLatin1String("##")) + rule.rule);
+	}
+
+	ContentBlockingIndex *updatedIndex(new ContentBlockingIndex());
+
+	for (quint32 i = 0; i < index->m_header->rulesAmount; ++i)
+	{
+		const ContentBlockingProfile::ContentBlockingRule rule(index->getRule(index->m_rulesRecords[i]));
+
+		if (!removedPatterns.contains(rule.pattern))
+		{
+			updatedIndex->addRule(rule);
+		}
+	}
+
+	for (int i = 0; i < addedRules.m_rules.count(); ++i)
+	{
+		if (updatedIndex->m_patterns.contains(addedRules.m_rules.at(i).pattern))
+		{
+			delete updatedIndex;
+
+			return NULL;
+		}
+
+		updatedIndex->addRule(addedRules.m_rules.at(i));
+	}
+
+	for (quint32 i = 0; i < index->m_header->styleSheetAmount; ++i)
+	{
+		const QString rule(index->getString(index->m_styleSheetRecords[i]), index->m_styleSheetRecords[i].length);
+
+		if (!removedStyleSheet.contains(rule))
+		{
+			updatedIndex->addStyleSheetRule(rule);
+		}
+	}
+
+	updatedIndex->m_styleSheet += addedRules.m_styleSheet;
+
+	for (quint32 i = 0; i < index->m_header->styleSheetRulesAmount; ++i)
+	{
+		const StyleSheetRuleRecord &record(index->m_styleSheetRulesRecords[i]);
+		const QString domain(index->getString(record.domain), record.domain.length);
+		StyleSheetRule rule;
+		rule.rule = QString(index->getString(record.rule), record.rule.length);
+		rule.isException = record.isException;
+
+		if (removedStyleSheetRules.contains(domain + (rule.isException ? QLatin1String("#@#") : QLatin1String("##")) + rule.rule))
+		{
+			continue;
+		}
+
+		rule.domain = reverseDomain(domain);
+
+		updatedIndex->m_styleSheetRules.append(rule);
+	}
+
+	updatedIndex->m_styleSheetRules += addedRules.m_styleSheetRules;
+	updatedIndex->optimize(checksum);
+
+	return updatedIndex;
+}
+
+const QChar* ContentBlockingIndex::getString(const StringRecord &record) const
+{
+	return (m_strings + record.offset);
+}
+
+const ContentBlockingIndex::BucketRecord* ContentBlockingIndex::getBucket(uint token) const
+{
+	if (m_header->bucketsAmount == 0)
+	{
+		return NULL;
+	}
+
+	const quint32 mask(m_header->bucketsAmount - 1);
+	quint32 position(token & mask);
+
+	for (quint32 i = 0; i < m_header->bucketsAmount; ++i)
+	{
+		const BucketRecord *bucket(m_bucketsRecords + position);
+
+		if (bucket->rulesAmount == 0)
+		{
+			return NULL;
+		}
+
+		if (bucket->token == token)
+		{
+			return bucket;
+		}
+
+		position = ((position + 1) & mask);
+	}
+
+	return NULL;
+}
+
+ContentBlockingProfile::ContentBlockingRule ContentBlockingIndex::getRule(const RuleRecord &record) const
+{
+	ContentBlockingProfile::ContentBlockingRule rule;
+	rule.pattern = QString(getString(record.pattern), record.pattern.length);
+	rule.ruleOption = ContentBlockingProfile::RuleOptions(QFlag(record.ruleOption));
+	rule.exceptionRuleOption = ContentBlockingProfile::RuleOptions(QFlag(record.exceptionRuleOption));
+	rule.isException = record.isException;
+	rule.needsDomainCheck = record.needsDomainCheck;
+
+	for (quint16 i = 0; i < record.blockedDomainsAmount; ++i)
+	{
+		const StringRecord &domain(m_domainsRecords[record.domainsOffset + i]);
+
+		rule.blockedDomains.append(QString(getString(domain), domain.length));
+	}
+
+	for (quint16 i = 0; i < record.allowedDomainsAmount; ++i)
+	{
+		const StringRecord &domain(m_domainsRecords[record.domainsOffset + record.blockedDomainsAmount + i]);
+
+		rule.allowedDomains.append(QString(getString(domain), domain.length));
+	}
+
+	return rule;
+}
+
+ContentBlockingIndex::StringRecord ContentBlockingIndex::createString(const QString &string, QString &strings, QHash<QString, quint32> &offsets)
+{
+	StringRecord record;
+	record.length = string.length();
+
+	if (offsets.contains(string))
+	{
+		record.offset = offsets.value(string);
+
+		return record;
+	}
+
+	record.offset = strings.length();
+
+	offsets.insert(string, record.offset);
+
+	strings.append(string);
+
+	return record;
+}
+
+QStringList ContentBlockingIndex::getStyleSheet() const
+{
+	return m_compiledStyleSheet;
+}
+
+void ContentBlockingIndex::getStyleSheetRules(const QString &domain, QStringList &blackList, QStringList &whiteList) const
+{
+	if (!m_header || domain.isEmpty())
+	{
+		return;
+	}
+
+	const QString reversedDomain(reverseDomain(domain));
+	quint32 begin(0);
+	int labelsAmount(0);
+
+///NOTE Host and all its parents are prefixes of reversed host, they are looked up in single pass, each search starting where previous one ended
+	for (int i = 0; i <= reversedDomain.length(); ++i)
+	{
+		if (i < reversedDomain.length() && reversedDomain.at(i) != QLatin1Char('.'))
+		{
+			continue;
+		}
+
+		++labelsAmount;
+
+		if (labelsAmount < 2 && i < reversedDomain.length())
+		{
+			continue;
+		}
+
+		quint32 end(m_header->styleSheetRulesAmount);
+
+		while (begin < end)
+		{
+			const quint32 middle(begin + ((end - begin) / 2));
+			const StringRecord &record(m_styleSheetRulesRecords[middle].domain);
+
+			if (compareStrings(getString(record), record.length, reversedDomain.constData(), i) < 0)
+			{
+				begin = (middle + 1);
+			}
+			else
+			{
+				end = middle;
+			}
+		}
+
+		for (; begin < m_header->styleSheetRulesAmount; ++begin)
+		{
+			const StyleSheetRuleRecord &record(m_styleSheetRulesRecords[begin]);
+
+			if (compareStrings(getString(record.domain), record.domain.length, reversedDomain.constData(), i) != 0)
+			{
+				break;
+			}
+
+			if (record.isException)
+			{
+				whiteList.append(m_compiledStyleSheetRules.at(begin));
+			}
+			else
+			{
+				blackList.append(m_compiledStyleSheetRules.at(begin));
+			}
+		}
+	}
+}
+
+QVector<uint> ContentBlockingIndex::getRuleTokens(const QString &pattern) const
+{
+	QVector<uint> tokens;
+	const QChar *data(pattern.constData());
+	const int length(pattern.length());
+	int tokenStart(-1);
+
+	for (int i = 0; i < length; ++i)
+	{
+		if (isTokenCharacter(data[i]))
+		{
+			if (tokenStart < 0)
+			{
+				tokenStart = i;
+			}
+
+			continue;
+		}
+
+///NOTE Only tokens enclosed by literal separators are guaranteed to be complete tokens of matching URL, edges could continue in it
+		if (tokenStart > 0 && data[tokenStart - 1] != QLatin1Char('*') && data[i] != QLatin1Char('*'))
+		{
+			tokens.append(hashToken((data + tokenStart), (i - tokenStart)));
+		}
+
+		tokenStart = -1;
+	}
+
+	return tokens;
+}
+
+uint ContentBlockingIndex::hashToken(const QChar *data, int length)
+{
+	uint hash(2166136261u);
+
+	for (int i = 0; i < length; ++i)
+	{
+		hash ^= data[i].unicode();
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+QString ContentBlockingIndex::reverseDomain(const QString &domain)
+{
+	QString reversedDomain;
+	reversedDomain.reserve(domain.length());
+
+	int end(domain.length());
+
+	for (int i = (domain.length() - 1); i >= -1; --i)
+	{
+		if (i >= 0 && domain.at(i) != QLatin1Char('.'))
+		{
+			continue;
+		}
+
+		if (!reversedDomain.isEmpty())
+		{
+			reversedDomain.append(QLatin1Char('.'));
+		}
+
+		reversedDomain.append(domain.midRef((i + 1), (end - i - 1)));
+
+		end = i;
+	}
+
+	return reversedDomain;
+}
+
+int ContentBlockingIndex::findString(const QChar *haystack, int haystackLength, const QChar *needle, int needleLength)
+{
+	if (needleLength == 0)
+	{
+		return 0;
+	}
+
+	const QChar firstCharacter(needle[0]);
+
+	for (int i = 0; i <= (haystackLength - needleLength); ++i)
+	{
+		if (haystack[i] == firstCharacter && std::memcmp((haystack + i), needle, (needleLength * sizeof(QChar))) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+int ContentBlockingIndex::compareStrings(const QChar *first, int firstLength, const QChar *second, int secondLength)
+{
+	const int length(qMin(firstLength, secondLength));
+
+	for (int i = 0; i < length; ++i)
+	{
+		if (first[i] != second[i])
+		{
+			return ((first[i].unicode() < second[i].unicode()) ? -1 : 1);
+		}
+	}
+
+	return (firstLength - secondLength);
+}
+
+int ContentBlockingIndex::getRulesAmount() const
+{
+	return (m_header ? static_cast<int>(m_header->rulesAmount) : m_rules.count());
+}
+
+bool ContentBlockingIndex::compareStyleSheetRules(const StyleSheetRule &first, const StyleSheetRule &second)
+{
+	if (first.domain != second.domain)
+	{
+		return (first.domain < second.domain);
+	}
+
+	if (first.isException != second.isException)
+	{
+		return (first.isException < second.isException);
+	}
+
+	return (first.rule < second.rule);
+}
+
+bool ContentBlockingIndex::areRulesEqual(const ContentBlockingProfile::ContentBlockingRule &first, const ContentBlockingProfile::ContentBlockingRule &second)
+{
+	return (first.pattern == second.pattern && first.blockedDomains == second.blockedDomains && first.allowedDomains == second.allowedDomains && first.ruleOption == second.ruleOption && first.exceptionRuleOption == second.exceptionRuleOption && first.isException == second.isException && first.needsDomainCheck == second.needsDomainCheck);
+}
+
+bool ContentBlockingIndex::isDataValid(const char *data, qint64 size, const QByteArray &checksum)
+{
+	const IndexHeader *header(reinterpret_cast<const IndexHeader*>(data));
+
+	if (std::memcmp(header->magic, "OTCB", 4) != 0 || header->version != m_version || header->size != size || checksum.size() != 16 || std::memcmp(header->checksum, checksum.constData(), 16) != 0 || header->bucketsAmount == 0 || (header->bucketsAmount & (header->bucketsAmount - 1)) != 0 || header->untokenizedRulesAmount > header->ruleIndexesAmount)
+	{
+		return false;
+	}
+
+///NOTE Sections are laid out back to back in fixed order, so their offsets can be verified exactly, 64 bit arithmetic prevents overflows
+	quint64 offset(sizeof(IndexHeader));
+
+	if (header->rulesOffset != offset)
+	{
+		return false;
+	}
+
+	offset += (static_cast<quint64>(header->rulesAmount) * sizeof(RuleRecord));
+
+	if (header->domainsOffset != offset)
+	{
+		return false;
+	}
+
+	offset += (static_cast<quint64>(header->domainsAmount) * sizeof(StringRecord));
+
+	if (header->bucketsOffset != offset)
+	{
+		return false;
+	}
+
+	offset += (static_cast<quint64>(header->bucketsAmount) * sizeof(BucketRecord));
+
+	if (header->ruleIndexesOffset != offset)
+	{
+		return false;
+	}
+
+	offset += (static_cast<quint64>(header->ruleIndexesAmount) * sizeof(quint32));
+
+	if (header->styleSheetOffset != offset)
+	{
+		return false;
+	}
+
+	offset += (static_cast<quint64>(header->styleSheetAmount) * sizeof(StringRecord));
+
+	if (header->styleSheetRulesOffset != offset)
+	{
+		return false;
+	}
+
+	offset += (static_cast<quint64>(header->styleSheetRulesAmount) * sizeof(StyleSheetRuleRecord));
+
+	if (header->stringsOffset != offset)
+	{
+		return false;
+	}
+
+	offset += (static_cast<quint64>(header->stringsLength) * sizeof(QChar));
+
+	if (offset != static_cast<quint64>(size))
+	{
+		return false;
+	}
+
+	const quint64 stringsLength(header->stringsLength);
+	const RuleRecord *rules(reinterpret_cast<const RuleRecord*>(data + header->rulesOffset));
+
+	for (quint32 i = 0; i < header->rulesAmount; ++i)
+	{
+		if ((static_cast<quint64>(rules[i].pattern.offset) + rules[i].pattern.length) > stringsLength || (static_cast<quint64>(rules[i].domainsOffset) + rules[i].blockedDomainsAmount + rules[i].allowedDomainsAmount) > header->domainsAmount)
+		{
+			return false;
+		}
+	}
+
+	const StringRecord *domains(reinterpret_cast<const StringRecord*>(data + header->domainsOffset));
+
+	for (quint32 i = 0; i < header->domainsAmount; ++i)
+	{
+		if ((static_cast<quint64>(domains[i].offset) + domains[i].length) > stringsLength)
+		{
+			return false;
+		}
+	}
+
+	const BucketRecord *buckets(reinterpret_cast<const BucketRecord*>(data + header->bucketsOffset));
+
+	for (quint32 i = 0; i < header->bucketsAmount; ++i)
+	{
+		if ((static_cast<quint64>(buckets[i].rulesOffset) + buckets[i].rulesAmount) > header->ruleIndexesAmount)
+		{
+			return false;
+		}
+	}
+
+	const quint32 *ruleIndexes(reinterpret_cast<const quint32*>(data + header->ruleIndexesOffset));
+
+	for (quint32 i = 0; i < header->ruleIndexesAmount; ++i)
+	{
+		if (ruleIndexes[i] >= header->rulesAmount)
+		{
+			return false;
+		}
+	}
+
+	const StringRecord *styleSheet(reinterpret_cast<const StringRecord*>(data + header->styleSheetOffset));
+
+	for (quint32 i = 0; i < header->styleSheetAmount; ++i)
+	{
+		if ((static_cast<quint64>(styleSheet[i].offset) + styleSheet[i].length) > stringsLength)
+		{
+			return false;
+		}
+	}
+
+	const StyleSheetRuleRecord *styleSheetRules(reinterpret_cast<const StyleSheetRuleRecord*>(data + header->styleSheetRulesOffset));
+
+	for (quint32 i = 0; i < header->styleSheetRulesAmount; ++i)
+	{
+		if ((static_cast<quint64>(styleSheetRules[i].domain.offset) + styleSheetRules[i].domain.length) > stringsLength || (static_cast<quint64>(styleSheetRules[i].rule.offset) + styleSheetRules[i].rule.length) > stringsLength)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ContentBlockingIndex::isTokenCharacter(const QChar &character)
+{
+	const ushort value(character.unicode());
+
+	return ((value >= 'a' && value <= 'z') || (value >= 'A' && value <= 'Z') || (value >= '0' && value <= '9') || value == '%');
+}
+
+int ContentBlockingIndex::checkUrl(const QString &baseUrlHost, const QUrl &requestUrl, ContentBlockingManager::ResourceType resourceType) const
+{
+	if (!m_header)
+	{
+		return -1;
+	}
+
+	QString url(requestUrl.url(QUrl::RemoveScheme));
+
+	if (url.startsWith(QLatin1String("//")))
+	{
+		url = url.mid(2);
+	}
+
+	if (url.isEmpty())
+	{
+		return -1;
+	}
+
+	const QStringList requestSubdomainList(ContentBlockingManager::createSubdomainList(requestUrl.host()));
+	int profile(-1);
+
+///NOTE Rules of every list are sorted by profile, so once match was found only rules from preceding profiles need to be checked
+	for (quint32 i = 0; i < m_header->untokenizedRulesAmount; ++i)
+	{
+		const RuleRecord &rule(m_rulesRecords[m_ruleIndexes[i]]);
+
+		if (profile >= 0 && rule.profile >= profile)
+		{
+			break;
+		}
+
+		if (checkRuleMatch(rule, baseUrlHost, url, requestSubdomainList, resourceType))
+		{
+			profile = rule.profile;
+
+			break;
+		}
+	}
+
+	if (profile == 0 || m_header->bucketsAmount == 0)
+	{
+		return profile;
+	}
+
+	QVarLengthArray<uint, 64> checkedTokens;
+	const QChar *data(url.constData());
+	const int urlLength(url.length());
+	int tokenStart(-1);
+
+	for (int i = 0; i <= urlLength; ++i)
+	{
+		if (i < urlLength && isTokenCharacter(data[i]))
+		{
+			if (tokenStart < 0)
+			{
+				tokenStart = i;
+			}
+
+			continue;
+		}
+
+		if (tokenStart < 0)
+		{
+			continue;
+		}
+
+		const uint token(hashToken((data + tokenStart), (i - tokenStart)));
+		bool wasChecked(false);
+
+		tokenStart = -1;
+
+		for (int j = 0; j < checkedTokens.count(); ++j)
+		{
+			if (checkedTokens.at(j) == token)
+			{
+				wasChecked = true;
+
+				break;
+			}
+		}
+
+		if (wasChecked)
+		{
+			continue;
+		}
+
+		checkedTokens.append(token);
+
+		const BucketRecord *bucket(getBucket(token));
+
+		if (!bucket)
+		{
+			continue;
+		}
+
+		for (quint32 j = 0; j < bucket->rulesAmount; ++j)
+		{
+			const RuleRecord &rule(m_rulesRecords[m_ruleIndexes[bucket->rulesOffset + j]]);
+
+			if (profile >= 0 && rule.profile >= profile)
+			{
+				break;
+			}
+
+			if (checkRuleMatch(rule, baseUrlHost, url, requestSubdomainList, resourceType))
+			{
+				profile = rule.profile;
+
+				break;
+			}
+		}
+
+		if (profile == 0)
+		{
+			return profile;
+		}
+	}
+
+	return profile;
+}
+
+bool ContentBlockingIndex::save(const QString &path) const
+{
+	if (!m_header)
+	{
+		return false;
+	}
+
+	QSaveFile file(path);
+
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return false;
+	}
+
+	file.write(m_data, m_header->size);
+
+	return file.commit();
+}
+
+bool ContentBlockingIndex::resolveDomainExceptions(const QString &url, const StringRecord *domains, int amount) const
+{
+	for (int i = 0; i < amount; ++i)
+	{
+		if (findString(url.constData(), url.length(), getString(domains[i]), domains[i].length) >= 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ContentBlockingIndex::checkRuleMatch(const RuleRecord &rule, const QString &baseUrlHost, const QString &requestUrl, const QStringList &requestSubdomainList, ContentBlockingManager::ResourceType resourceType) const
+{
+	if (!checkPatternMatch(rule, requestUrl, requestSubdomainList))
+	{
+		return false;
+	}
+
+	bool isBlocked(true);
+
+	resolveRuleOptions(rule, baseUrlHost, requestSubdomainList, resourceType, isBlocked);
+
+	return (isBlocked && !rule.isException);
+}
+
+bool ContentBlockingIndex::checkPatternMatch(const RuleRecord &rule, const QString &requestUrl, const QStringList &requestSubdomainList) const
+{
+	const QChar *pattern(getString(rule.pattern));
+	const int patternLength(rule.pattern.length);
+
+	if (!rule.hasWildcard)
+	{
+		return (findString(requestUrl.constData(), requestUrl.length(), pattern, patternLength) >= 0 && (!rule.needsDomainCheck || checkDomainMatch(pattern, patternLength, requestSubdomainList)));
+	}
+
+	for (int i = 0; i < requestUrl.length(); ++i)
+	{
+		if (checkWildcardMatch(pattern, patternLength, rule.needsDomainCheck, requestUrl, requestSubdomainList, 0, i, i))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ContentBlockingIndex::checkWildcardMatch(const QChar *pattern, int patternLength, bool needsDomainCheck, const QString &requestUrl, const QStringList &requestSubdomainList, int patternPosition, int urlPosition, int matchPosition) const
+{
+	int wildcardPosition(-1);
+
+	for (int i = patternPosition; i < patternLength; ++i)
+	{
+		if (pattern[i] == QLatin1Char('*'))
+		{
+			wildcardPosition = i;
+
+			break;
+		}
+	}
+
+	const int partLength(((wildcardPosition < 0) ? patternLength : wildcardPosition) - patternPosition);
+
+	if ((urlPosition + partLength) > requestUrl.length() || std::memcmp((requestUrl.constData() + urlPosition), (pattern + patternPosition), (partLength * sizeof(QChar))) != 0)
+	{
+		return false;
+	}
+
+	if (wildcardPosition < 0)
+	{
+		return (!needsDomainCheck || checkDomainMatch((requestUrl.constData() + matchPosition), (urlPosition + partLength - matchPosition), requestSubdomainList));
+	}
+
+	for (int i = (urlPosition + partLength); i < requestUrl.length(); ++i)
+	{
+		if (checkWildcardMatch(pattern, patternLength, needsDomainCheck, requestUrl, requestSubdomainList, (wildcardPosition + 1), i, matchPosition))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ContentBlockingIndex::checkDomainMatch(const QChar *match, int matchLength, const QStringList &requestSubdomainList) const
+{
+	int domainLength(matchLength);
+
+	for (int i = 0; i < matchLength; ++i)
+	{
+		const QChar character(match[i]);
+
+		if (character == QLatin1Char(':') || character == QLatin1Char('?') || character == QLatin1Char('&') || character == QLatin1Char('/') || character == QLatin1Char('='))
+		{
+			domainLength = i;
+
+			break;
+		}
+	}
+
+	for (int i = 0; i < requestSubdomainList.count(); ++i)
+	{
+		if (compareStrings(requestSubdomainList.at(i).constData(), requestSubdomainList.at(i).length(), match, domainLength) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+}
@@ -0,0 +1,166 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Jan Bajer aka bajasoft <jbajer@gmail.com>
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#ifndef OTTER_CONTENTBLOCKINGINDEX_H
+#define OTTER_CONTENTBLOCKINGINDEX_H
+
+#include "ContentBlockingProfile.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+namespace Otter
+{
+
+///NOTE Index is filled and optimized by single thread before being published, afterwards it is never modified so it can be queried from any thread
+class ContentBlockingIndex
+{
+public:
+	ContentBlockingIndex();
+	~ContentBlockingIndex();
+
+	void addRule(const ContentBlockingProfile::ContentBlockingRule &rule);
+	void addStyleSheetRule(const QString &rule);
+	void addStyleSheetRule(const QStringList &domains, const QString &rule, bool isException);
+	void optimize(const QByteArray &checksum = QByteArray());
+	static ContentBlockingIndex* load(const QString &path, const QByteArray &checksum);
+	static ContentBlockingIndex* createMergedIndex(const QVector<const ContentBlockingIndex*> &indexes);
+	static ContentBlockingIndex* createUpdatedIndex(const ContentBlockingIndex *index, const ContentBlockingIndex &removedRules, const ContentBlockingIndex &addedRules, const QSet<QString> &retainedRules, const QByteArray &checksum);
+	void getStyleSheetRules(const QString &domain, QStringList &blackList, QStringList &whiteList) const;
+	QStringList getStyleSheet() const;
+	bool save(const QString &path) const;
+	int checkUrl(const QString &baseUrlHost, const QUrl &requestUrl, ContentBlockingManager::ResourceType resourceType) const;
+	int getRulesAmount() const;
+
+protected:
+	struct StringRecord
+	{
+		quint32 offset;
+		quint32 length;
+	};
+
+	struct RuleRecord
+	{
+		StringRecord pattern;
+		quint32 domainsOffset;
+		quint16 blockedDomainsAmount;
+		quint16 allowedDomainsAmount;
+		quint16 ruleOption;
+		quint16 exceptionRuleOption;
+		quint8 isException;
+		quint8 needsDomainCheck;
+		quint8 hasWildcard;
+		quint8 profile;
+	};
+
+	struct BucketRecord
+	{
+		quint32 token;
+		quint32 rulesOffset;
+		quint32 rulesAmount;
+	};
+
+	struct StyleSheetRuleRecord
+	{
+		StringRecord domain;
+		StringRecord rule;
+		quint32 isException;
+	};
+
+	struct IndexHeader
+	{
+		char magic[4];
+		quint32 version;
+		char checksum[16];
+		quint32 rulesAmount;
+		quint32 rulesOffset;
+		quint32 domainsAmount;
+		quint32 domainsOffset;
+		quint32 bucketsAmount;
+		quint32 bucketsOffset;
+		quint32 ruleIndexesAmount;
+		quint32 ruleIndexesOffset;
+		quint32 untokenizedRulesAmount;
+		quint32 styleSheetAmount;
+		quint32 styleSheetOffset;
+		quint32 styleSheetRulesAmount;
+		quint32 styleSheetRulesOffset;
+		quint32 stringsLength;
+		quint32 stringsOffset;
+		quint32 size;
+	};
+
+	struct StyleSheetRule
+	{
+		QString domain;
+		QString rule;
+		bool isException;
+	};
+
+	void addRule(const ContentBlockingProfile::ContentBlockingRule &rule, int profile);
+	void setData(const char *data);
+	void resolveRuleOptions(const RuleRecord &rule, const QString &baseUrlHost, const QStringList &requestSubdomainList, ContentBlockingManager::ResourceType resourceType, bool &isBlocked) const;
+	const QChar* getString(const StringRecord &record) const;
+	const BucketRecord* getBucket(uint token) const;
+	ContentBlockingProfile::ContentBlockingRule getRule(const RuleRecord &record) const;
+	QVector<uint> getRuleTokens(const QString &pattern) const;
+	static StringRecord createString(const QString &string, QString &strings, QHash<QString, quint32> &offsets);
+	static QString reverseDomain(const QString &domain);
+	static uint hashToken(const QChar *data, int length);
+	static int findString(const QChar *haystack, int haystackLength, const QChar *needle, int needleLength);
+	static int compareStrings(const QChar *first, int firstLength, const QChar *second, int secondLength);
+	static bool compareStyleSheetRules(const StyleSheetRule &first, const StyleSheetRule &second);
+	static bool areRulesEqual(const ContentBlockingProfile::ContentBlockingRule &first, const ContentBlockingProfile::ContentBlockingRule &second);
+	static bool isDataValid(const char *data, qint64 size, const QByteArray &checksum);
+	static bool isTokenCharacter(const QChar &character);
+	bool resolveDomainExceptions(const QString &url, const StringRecord *domains, int amount) const;
+	bool checkRuleMatch(const RuleRecord &rule, const QString &baseUrlHost, const QString &requestUrl, const QStringList &requestSubdomainList, ContentBlockingManager::ResourceType resourceType) const;
+	bool checkPatternMatch(const RuleRecord &rule, const QString &requestUrl, const QStringList &requestSubdomainList) const;
+	bool checkWildcardMatch(const QChar *pattern, int patternLength, bool needsDomainCheck, const QString &requestUrl, const QStringList &requestSubdomainList, int patternPosition, int urlPosition, int matchPosition) const;
+	bool checkDomainMatch(const QChar *match, int matchLength, const QStringList &requestSubdomainList) const;
+
+private:
+	QFile *m_file;
+	const char *m_data;
+	const IndexHeader *m_header;
+	const RuleRecord *m_rulesRecords;
+	const StringRecord *m_domainsRecords;
+	const BucketRecord *m_bucketsRecords;
+	const quint32 *m_ruleIndexes;
+	const StringRecord *m_styleSheetRecords;
+	const StyleSheetRuleRecord *m_styleSheetRulesRecords;
+	const QChar *m_strings;
+	QByteArray m_buffer;
+	QStringList m_compiledStyleSheet;
+	QVector<QString> m_compiledStyleSheetRules;
+	QVector<ContentBlockingProfile::ContentBlockingRule> m_rules;
+	QVector<int> m_rulesProfiles;
+	QVector<StyleSheetRule> m_styleSheetRules;
+	QStringList m_styleSheet;
+	QHash<QString, int> m_patterns;
+
+	static const quint32 m_version;
+};
+
+}
+
+#endif
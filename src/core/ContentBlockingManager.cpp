@@ -20,20 +20,35 @@
 
 #include "ContentBlockingManager.h"
 #include "Console.h"
+#include "ContentBlockingIndex.h"
 #include "ContentBlockingProfile.h"
 #include "SettingsManager.h"
 #include "SessionsManager.h"
 
+#include <QtConcurrent/QtConcurrentRun>
 #include <QtCore/QDir>
+#include <QtCore/QTimer>
 
 namespace Otter
 {
 
 ContentBlockingManager* ContentBlockingManager::m_instance = NULL;
 QVector<ContentBlockingProfile*> ContentBlockingManager::m_profiles;
+QAtomicPointer<ContentBlockingManager::MergedIndexesSnapshot> ContentBlockingManager::m_mergedIndexes(NULL);
+QList<ContentBlockingManager::MergedIndexesSnapshot*> ContentBlockingManager::m_retiredMergedIndexes;
+QSet<QByteArray> ContentBlockingManager::m_pendingMergedIndexes;
+QMutex ContentBlockingManager::m_mergedIndexesMutex;
+ContentBlockingManager::CheckResultsCacheShard ContentBlockingManager::m_checkResultsCacheShards[ContentBlockingManager::m_checkResultsCacheShardsAmount];
+QCache<QString, QString> ContentBlockingManager::m_styleSheetsCache(4194304);
+QHash<QString, QString> ContentBlockingManager::m_genericStyleSheets;
+int ContentBlockingManager::m_mergedIndexesRevision(0);
+QAtomicInt ContentBlockingManager::m_mergedIndexesReaders(0);
+QAtomicInt ContentBlockingManager::m_checkResultsCacheHits(0);
+QAtomicInt ContentBlockingManager::m_checkResultsCacheMisses(0);
 
 ContentBlockingManager::ContentBlockingManager(QObject *parent) : QObject(parent)
 {
+	connect(SettingsManager::getInstance(), SIGNAL(valueChanged(QString,QVariant)), this, SLOT(optionChanged(QString)));
 }
 
 void ContentBlockingManager::createInstance(QObject *parent)
@@ -77,8 +92,148 @@ void ContentBlockingManager::loadProfiles()
 
 		m_profiles.append(profile);
 
+		connect(profile, SIGNAL(profileModified(QString)), m_instance, SLOT(clearMergedIndexes()));
+		connect(profile, SIGNAL(profileModified(QString)), m_instance, SLOT(clearCheckResultsCache()));
+		connect(profile, SIGNAL(profileModified(QString)), m_instance, SLOT(clearStyleSheetsCache()));
 		connect(profile, SIGNAL(profileModified(QString)), m_instance, SIGNAL(profileModified(QString)));
 	}
+
+	m_instance->optionChanged(QLatin1String("Content/BlockingProfiles"));
+}
+
+void ContentBlockingManager::optionChanged(const QString &option)
+{
+	if (option == QLatin1String("Content/BlockingProfiles"))
+	{
+		const QVector<int> profiles(getProfileList(SettingsManager::getValue(QLatin1String("Content/BlockingProfiles")).toStringList()));
+
+		for (int i = 0; i < profiles.count(); ++i)
+		{
+			m_profiles.at(profiles.at(i))->loadRules();
+		}
+
+		clearCheckResultsCache();
+	}
+	else if (option == QLatin1String("ContentBlocking/EnableWildcards"))
+	{
+		QMetaObject::invokeMethod(this, "clearMergedIndexes", Qt::QueuedConnection);
+		QMetaObject::invokeMethod(this, "clearCheckResultsCache", Qt::QueuedConnection);
+	}
+}
+
+void ContentBlockingManager::clearCheckResultsCache()
+{
+	for (int i = 0; i < m_checkResultsCacheShardsAmount; ++i)
+	{
+		QMutexLocker locker(&m_checkResultsCacheShards[i].mutex);
+
+		m_checkResultsCacheShards[i].cache.clear();
+
+		++m_checkResultsCacheShards[i].revision;
+	}
+}
+
+void ContentBlockingManager::clearStyleSheetsCache()
+{
+	m_styleSheetsCache.clear();
+	m_genericStyleSheets.clear();
+}
+
+void ContentBlockingManager::clearMergedIndexes()
+{
+	QMutexLocker locker(&m_mergedIndexesMutex);
+
+	publishMergedIndexes(NULL);
+
+	++m_mergedIndexesRevision;
+}
+
+///NOTE Merged indexes are published as immutable snapshot, replaced one is kept until no request is looking it up anymore
+void ContentBlockingManager::publishMergedIndexes(MergedIndexesSnapshot *snapshot)
+{
+	MergedIndexesSnapshot *previousSnapshot(m_mergedIndexes.fetchAndStoreOrdered(snapshot));
+
+	if (!previousSnapshot)
+	{
+		return;
+	}
+
+	m_retiredMergedIndexes.append(previousSnapshot);
+
+	if (m_instance)
+	{
+		QMetaObject::invokeMethod(m_instance, "deleteRetiredMergedIndexes", Qt::QueuedConnection);
+	}
+}
+
+void ContentBlockingManager::deleteRetiredMergedIndexes()
+{
+	QMutexLocker locker(&m_mergedIndexesMutex);
+
+	if (m_retiredMergedIndexes.isEmpty())
+	{
+		return;
+	}
+
+///NOTE Readers are registered before loading snapshot pointer, so once there are none, nobody can still hold retired one
+	if (m_mergedIndexesReaders.loadAcquire() > 0)
+	{
+		QTimer::singleShot(1000, this, SLOT(deleteRetiredMergedIndexes()));
+
+		return;
+	}
+
+	qDeleteAll(m_retiredMergedIndexes);
+
+	m_retiredMergedIndexes.clear();
+}
+
+void ContentBlockingManager::createMergedIndex(const QVector<int> &profiles, int revision)
+{
+	const QByteArray key(reinterpret_cast<const char*>(profiles.constData()), (profiles.count() * sizeof(int)));
+	QVector<const ContentBlockingIndex*> indexes;
+	indexes.reserve(profiles.count());
+
+	for (int i = 0; i < profiles.count(); ++i)
+	{
+		const ContentBlockingIndex *index(m_profiles.at(profiles.at(i))->acquireIndex());
+
+		if (!index)
+		{
+			break;
+		}
+
+		indexes.append(index);
+	}
+
+	ContentBlockingIndex *mergedIndex((indexes.count() == profiles.count()) ? ContentBlockingIndex::createMergedIndex(indexes) : NULL);
+
+	for (int i = 0; i < indexes.count(); ++i)
+	{
+		m_profiles.at(profiles.at(i))->releaseIndex();
+	}
+
+	QMutexLocker locker(&m_mergedIndexesMutex);
+
+	m_pendingMergedIndexes.remove(key);
+
+	if (!mergedIndex)
+	{
+		return;
+	}
+
+	if (revision != m_mergedIndexesRevision)
+	{
+		delete mergedIndex;
+
+		return;
+	}
+
+	const MergedIndexesSnapshot *snapshot(m_mergedIndexes.loadAcquire());
+	MergedIndexesSnapshot *updatedSnapshot(snapshot ? new MergedIndexesSnapshot(*snapshot) : new MergedIndexesSnapshot());
+	updatedSnapshot->indexes[key] = QSharedPointer<ContentBlockingIndex>(mergedIndex);
+
+	publishMergedIndexes(updatedSnapshot);
 }
 
 ContentBlockingManager* ContentBlockingManager::getInstance()
@@ -100,6 +255,78 @@ ContentBlockingManager::CheckResult ContentBlockingManager::checkUrl(const QVect
 		return CheckResult();
 	}
 
+	QString key(baseUrl.host());
+	key.append(QLatin1Char(' '));
+	key.append(QString::number(resourceType));
+	key.append(QLatin1Char(' '));
+	key.append(createProfilesKey(profiles));
+	key.append(QLatin1Char(' '));
+	key.append(requestUrl.url());
+
+///NOTE Cache is split into shards by key hash, so concurrent lookups rarely contend for the same mutex
+	CheckResultsCacheShard &shard(m_checkResultsCacheShards[qHash(key) % m_checkResultsCacheShardsAmount]);
+
+	shard.mutex.lock();
+
+	const CheckResult *cachedResult(shard.cache.object(key));
+
+	if (cachedResult)
+	{
+		const CheckResult result(*cachedResult);
+
+		shard.mutex.unlock();
+
+		m_checkResultsCacheHits.ref();
+
+		return result;
+	}
+
+	const int revision(shard.revision);
+
+	shard.mutex.unlock();
+
+	m_checkResultsCacheMisses.ref();
+
+///NOTE Requests passed through while some profile is still loading are not cached
+	const bool isCacheable(areProfilesLoaded(profiles));
+
+	const CheckResult result(evaluateUrl(profiles, baseUrl, requestUrl, resourceType));
+
+	if (isCacheable)
+	{
+		QMutexLocker locker(&shard.mutex);
+
+		if (revision == shard.revision)
+		{
+			shard.cache.insert(key, new CheckResult(result));
+		}
+	}
+
+	return result;
+}
+
+ContentBlockingManager::CheckResult ContentBlockingManager::evaluateUrl(const QVector<int> &profiles, const QUrl &baseUrl, const QUrl &requestUrl, ResourceType resourceType)
+{
+	const QSharedPointer<ContentBlockingIndex> mergedIndex(getMergedIndex(profiles));
+
+	if (mergedIndex)
+	{
+		const int profile(mergedIndex->checkUrl(baseUrl.host(), requestUrl, resourceType));
+
+		if (profile < 0)
+		{
+			return CheckResult();
+		}
+
+		CheckResult result;
+		result.url = requestUrl;
+		result.profile = m_profiles.at(profiles.at(profile))->getInformation().name;
+		result.resourceType = resourceType;
+		result.isBlocked = true;
+
+		return result;
+	}
+
 	for (int i = 0; i < profiles.count(); ++i)
 	{
 		if (profiles[i] >= 0 && profiles[i] < m_profiles.count())
@@ -129,6 +356,87 @@ ContentBlockingInformation ContentBlockingManager::getProfile(const QString &pro
 	return ContentBlockingInformation();
 }
 
+QString ContentBlockingManager::createProfilesKey(const QVector<int> &profiles)
+{
+	QString key;
+
+	for (int i = 0; i < profiles.count(); ++i)
+	{
+		if (i > 0)
+		{
+			key.append(QLatin1Char(','));
+		}
+
+		key.append(QString::number(profiles.at(i)));
+	}
+
+	return key;
+}
+
+QString ContentBlockingManager::createStyleSheet(const QStringList &selectors, const QSet<QString> &exceptions)
+{
+	QSet<QString> addedSelectors;
+	QString styleSheet;
+
+///NOTE Every selector gets its own rule, since single invalid selector would invalidate whole group
+	for (int i = 0; i < selectors.count(); ++i)
+	{
+		if (!addedSelectors.contains(selectors.at(i)) && !exceptions.contains(selectors.at(i)))
+		{
+			addedSelectors.insert(selectors.at(i));
+
+			styleSheet.append(selectors.at(i));
+			styleSheet.append(QLatin1String("{display:none !important;}"));
+		}
+	}
+
+	return styleSheet;
+}
+
+QSharedPointer<ContentBlockingIndex> ContentBlockingManager::getMergedIndex(const QVector<int> &profiles)
+{
+	if (profiles.count() < 2 || profiles.count() > 256)
+	{
+		return QSharedPointer<ContentBlockingIndex>();
+	}
+
+	const QByteArray key(QByteArray::fromRawData(reinterpret_cast<const char*>(profiles.constData()), (profiles.count() * sizeof(int))));
+
+	m_mergedIndexesReaders.ref();
+
+	const MergedIndexesSnapshot *snapshot(m_mergedIndexes.loadAcquire());
+	const QSharedPointer<ContentBlockingIndex> mergedIndex(snapshot ? snapshot->indexes.value(key) : QSharedPointer<ContentBlockingIndex>());
+
+	m_mergedIndexesReaders.deref();
+
+	if (mergedIndex)
+	{
+		return mergedIndex;
+	}
+
+///NOTE Until all profiles of the set are loaded they are checked one by one, merged index is compiled in background afterwards
+	for (int i = 0; i < profiles.count(); ++i)
+	{
+		if (profiles.at(i) < 0 || profiles.at(i) >= m_profiles.count() || !m_profiles.at(profiles.at(i))->isLoaded())
+		{
+			return QSharedPointer<ContentBlockingIndex>();
+		}
+	}
+
+	QMutexLocker locker(&m_mergedIndexesMutex);
+
+	if (m_pendingMergedIndexes.contains(key))
+	{
+		return QSharedPointer<ContentBlockingIndex>();
+	}
+
+	m_pendingMergedIndexes.insert(QByteArray(key.constData(), key.size()));
+
+	QtConcurrent::run(&ContentBlockingManager::createMergedIndex, profiles, m_mergedIndexesRevision);
+
+	return QSharedPointer<ContentBlockingIndex>();
+}
+
 QStringList ContentBlockingManager::createSubdomainList(const QString &domain)
 {
 	QStringList subdomainList;
@@ -149,6 +457,13 @@ QStringList ContentBlockingManager::createSubdomainList(const QString &domain)
 
 QStringList ContentBlockingManager::getStyleSheet(const QVector<int> &profiles)
 {
+	const QSharedPointer<ContentBlockingIndex> mergedIndex(getMergedIndex(profiles));
+
+	if (mergedIndex)
+	{
+		return mergedIndex->getStyleSheet();
+	}
+
 	QStringList styleSheet;
 
 	for (int i = 0; i < profiles.count(); ++i)
@@ -162,34 +477,104 @@ QStringList ContentBlockingManager::getStyleSheet(const QVector<int> &profiles)
 	return styleSheet;
 }
 
-QStringList ContentBlockingManager::getStyleSheetBlackList(const QString &domain, const QVector<int> &profiles)
+QString ContentBlockingManager::getElementHidingStyleSheet(const QString &domain, const QVector<int> &profiles)
 {
-	QStringList data;
+	if (profiles.isEmpty())
+	{
+		return QString();
+	}
 
-	for (int i = 0; i < profiles.count(); ++i)
+	const bool isCacheable(areProfilesLoaded(profiles));
+
+	const QString profilesKey(createProfilesKey(profiles));
+	const QString key(profilesKey + QLatin1Char(' ') + domain);
+
+	if (isCacheable && m_styleSheetsCache.contains(key))
 	{
-		if (profiles[i] >= 0 && profiles[i] < m_profiles.count())
+		return *m_styleSheetsCache.object(key);
+	}
+
+	QStringList blackList;
+	QStringList whiteList;
+
+	getStyleSheetRules(domain, profiles, blackList, whiteList);
+
+	QString genericStyleSheet(m_genericStyleSheets.value(profilesKey));
+
+	if (genericStyleSheet.isNull() && whiteList.isEmpty())
+	{
+		genericStyleSheet = createStyleSheet(getStyleSheet(profiles), QSet<QString>());
+
+		if (isCacheable)
 		{
-			data.append(m_profiles.at(profiles[i])->getStyleSheetBlackList(domain));
+			m_genericStyleSheets[profilesKey] = genericStyleSheet;
 		}
 	}
 
-	return data;
+///NOTE Hosts without own rules share style sheet of profiles set, hosts with element hiding exceptions need generic selectors filtered
+	QString styleSheet;
+	int cost(1);
+
+	if (!whiteList.isEmpty())
+	{
+		styleSheet = createStyleSheet(getStyleSheet(profiles) + blackList, whiteList.toSet());
+		cost = styleSheet.length();
+	}
+	else if (!blackList.isEmpty())
+	{
+		styleSheet = (genericStyleSheet + createStyleSheet(blackList, QSet<QString>()));
+		cost = styleSheet.length();
+	}
+	else
+	{
+		styleSheet = genericStyleSheet;
+	}
+
+	if (isCacheable)
+	{
+		m_styleSheetsCache.insert(key, new QString(styleSheet), cost);
+	}
+
+	return styleSheet;
 }
 
-QStringList ContentBlockingManager::getStyleSheetWhiteList(const QString &domain, const QVector<int> &profiles)
+void ContentBlockingManager::getStyleSheetRules(const QString &domain, const QVector<int> &profiles, QStringList &blackList, QStringList &whiteList)
 {
-	QStringList data;
+	const QSharedPointer<ContentBlockingIndex> mergedIndex(getMergedIndex(profiles));
+
+	if (mergedIndex)
+	{
+		mergedIndex->getStyleSheetRules(domain, blackList, whiteList);
+
+		return;
+	}
 
 	for (int i = 0; i < profiles.count(); ++i)
 	{
 		if (profiles[i] >= 0 && profiles[i] < m_profiles.count())
 		{
-			data.append(m_profiles.at(profiles[i])->getStyleSheetWhiteList(domain));
+			m_profiles.at(profiles[i])->getStyleSheetRules(domain, blackList, whiteList);
 		}
 	}
+}
+
+QVariantHash ContentBlockingManager::getStatistics()
+{
+	int entries(0);
+
+	for (int i = 0; i < m_checkResultsCacheShardsAmount; ++i)
+	{
+		QMutexLocker locker(&m_checkResultsCacheShards[i].mutex);
 
-	return data;
+		entries += m_checkResultsCacheShards[i].cache.count();
+	}
+
+	QVariantHash statistics;
+	statistics[QLatin1String("contentBlockingCacheEntries")] = entries;
+	statistics[QLatin1String("contentBlockingCacheHits")] = m_checkResultsCacheHits.load();
+	statistics[QLatin1String("contentBlockingCacheMisses")] = m_checkResultsCacheMisses.load();
+
+	return statistics;
 }
 
 QVector<ContentBlockingInformation> ContentBlockingManager::getProfiles()
@@ -221,6 +606,19 @@ QVector<int> ContentBlockingManager::getProfileList(const QStringList &names)
 	return profiles;
 }
 
+bool ContentBlockingManager::areProfilesLoaded(const QVector<int> &profiles)
+{
+	for (int i = 0; i < profiles.count(); ++i)
+	{
+		if (profiles[i] >= 0 && profiles[i] < m_profiles.count() && !m_profiles.at(profiles[i])->isLoaded())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool ContentBlockingManager::updateProfile(const QString &profile)
 {
 	for (int i = 0; i < m_profiles.count(); ++i)
@@ -21,12 +21,20 @@
 #ifndef OTTER_CONTENTBLOCKINGMANAGER_H
 #define OTTER_CONTENTBLOCKINGMANAGER_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QCache>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVariant>
 #include <QtNetwork/QNetworkRequest>
 
 namespace Otter
 {
 
+class ContentBlockingIndex;
 class ContentBlockingProfile;
 struct ContentBlockingInformation;
 
@@ -62,21 +70,62 @@ public:
 	static CheckResult checkUrl(const QVector<int> &profiles, const QUrl &baseUrl, const QUrl &requestUrl, ResourceType resourceType);
 	static ContentBlockingInformation getProfile(const QString &profile);
 	static QStringList createSubdomainList(const QString &domain);
+	static QString getElementHidingStyleSheet(const QString &domain, const QVector<int> &profiles);
 	static QStringList getStyleSheet(const QVector<int> &profiles);
-	static QStringList getStyleSheetBlackList(const QString &domain, const QVector<int> &profiles);
-	static QStringList getStyleSheetWhiteList(const QString &domain, const QVector<int> &profiles);
+	static QVariantHash getStatistics();
 	static QVector<ContentBlockingInformation> getProfiles();
 	static QVector<int> getProfileList(const QStringList &names);
+	static bool areProfilesLoaded(const QVector<int> &profiles);
 	static bool updateProfile(const QString &profile);
 
 protected:
+	struct CheckResultsCacheShard
+	{
+		QCache<QString, CheckResult> cache;
+		QMutex mutex;
+		int revision;
+
+		CheckResultsCacheShard() : cache(625), revision(0) {}
+	};
+
+	struct MergedIndexesSnapshot
+	{
+		QHash<QByteArray, QSharedPointer<ContentBlockingIndex> > indexes;
+	};
+
 	explicit ContentBlockingManager(QObject *parent = NULL);
 
 	static void loadProfiles();
+	static void createMergedIndex(const QVector<int> &profiles, int revision);
+	static void publishMergedIndexes(MergedIndexesSnapshot *snapshot);
+	static QString createProfilesKey(const QVector<int> &profiles);
+	static QString createStyleSheet(const QStringList &selectors, const QSet<QString> &exceptions);
+	static void getStyleSheetRules(const QString &domain, const QVector<int> &profiles, QStringList &blackList, QStringList &whiteList);
+	static CheckResult evaluateUrl(const QVector<int> &profiles, const QUrl &baseUrl, const QUrl &requestUrl, ResourceType resourceType);
+	static QSharedPointer<ContentBlockingIndex> getMergedIndex(const QVector<int> &profiles);
+
+protected slots:
+	void optionChanged(const QString &option);
+	void clearMergedIndexes();
+	void deleteRetiredMergedIndexes();
+	void clearCheckResultsCache();
+	void clearStyleSheetsCache();
 
 private:
 	static ContentBlockingManager *m_instance;
 	static QVector<ContentBlockingProfile*> m_profiles;
+	static QAtomicPointer<MergedIndexesSnapshot> m_mergedIndexes;
+	static QList<MergedIndexesSnapshot*> m_retiredMergedIndexes;
+	static QSet<QByteArray> m_pendingMergedIndexes;
+	static QMutex m_mergedIndexesMutex;
+	static const int m_checkResultsCacheShardsAmount = 16;
+	static CheckResultsCacheShard m_checkResultsCacheShards[m_checkResultsCacheShardsAmount];
+	static QCache<QString, QString> m_styleSheetsCache;
+	static QHash<QString, QString> m_genericStyleSheets;
+	static int m_mergedIndexesRevision;
+	static QAtomicInt m_mergedIndexesReaders;
+	static QAtomicInt m_checkResultsCacheHits;
+	static QAtomicInt m_checkResultsCacheMisses;
 
 signals:
 	void profileModified(const QString &profile);
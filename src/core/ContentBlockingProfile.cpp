@@ -21,15 +21,19 @@
 
 #include "ContentBlockingProfile.h"
 #include "Console.h"
+#include "ContentBlockingIndex.h"
 #include "NetworkManager.h"
 #include "NetworkManagerFactory.h"
 #include "SessionsManager.h"
 
 #include <QtConcurrent/QtConcurrentRun>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDir>
+#include <QtCore/QSet>
 #include <QtCore/QSettings>
 #include <QtCore/QTextStream>
+#include <QtCore/QTimer>
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkRequest>
 
@@ -37,12 +41,15 @@ namespace Otter
 {
 
 ContentBlockingProfile::ContentBlockingProfile(const QString &path, QObject *parent) : QObject(parent),
-	m_root(NULL),
 	m_networkReply(NULL),
+	m_index(NULL),
+	m_activeReaders(0),
+	m_loadingRevision(0),
+	m_loadingTimeout(SettingsManager::getValue(QLatin1String("ContentBlocking/LoadingTimeout")).toInt()),
 	m_enableWildcards(SettingsManager::getValue(QLatin1String("ContentBlocking/EnableWildcards")).toBool()),
 	m_isUpdating(false),
 	m_isEmpty(true),
-	m_wasLoaded(false)
+	m_isLoading(false)
 {
 	m_information.name = QFileInfo(path).baseName();
 	m_information.title = tr("(Unknown)");
@@ -57,29 +64,40 @@ void ContentBlockingProfile::optionChanged(const QString &option)
 {
 	if (option == QLatin1String("ContentBlocking/EnableWildcards"))
 	{
+		const bool wasLoaded(isLoaded());
+
+		m_indexMutex.lock();
 		m_enableWildcards = SettingsManager::getValue(QLatin1String("ContentBlocking/EnableWildcards")).toBool();
+		m_indexMutex.unlock();
 
 		clear();
+
+		if (wasLoaded)
+		{
+			loadRules();
+		}
+	}
+	else if (option == QLatin1String("ContentBlocking/LoadingTimeout"))
+	{
+		QMutexLocker locker(&m_indexMutex);
+
+		m_loadingTimeout = SettingsManager::getValue(QLatin1String("ContentBlocking/LoadingTimeout")).toInt();
 	}
 }
 
 void ContentBlockingProfile::clear()
 {
-	if (!m_wasLoaded)
-	{
-		return;
-	}
+	QMutexLocker locker(&m_indexMutex);
+	ContentBlockingIndex *index(m_index.fetchAndStoreOrdered(NULL));
 
-	if (m_root)
-	{
-		QtConcurrent::run(this, &ContentBlockingProfile::deleteNode, m_root);
-	}
+	++m_loadingRevision;
 
-	m_styleSheet.clear();
-	m_styleSheetWhiteList.clear();
-	m_styleSheetBlackList.clear();
+	if (index)
+	{
+		m_retiredIndexes.append(index);
 
-	m_wasLoaded = false;
+		QTimer::singleShot(1000, this, SLOT(deleteRetiredIndexes()));
+	}
 }
 
 void ContentBlockingProfile::load(bool onlyHeader)
@@ -110,6 +128,8 @@ void ContentBlockingProfile::load(bool onlyHeader)
 
 		if (!line.startsWith(QLatin1Char('!')))
 		{
+			QMutexLocker locker(&m_indexMutex);
+
 			m_isEmpty = false;
 
 			break;
@@ -149,7 +169,35 @@ void ContentBlockingProfile::load(bool onlyHeader)
 	}
 }
 
-void ContentBlockingProfile::parseRuleLine(QString line)
+void ContentBlockingProfile::loadRules()
+{
+	QMutexLocker locker(&m_indexMutex);
+
+	scheduleLoading();
+}
+
+void ContentBlockingProfile::scheduleLoading()
+{
+	if (m_isLoading || m_index.loadAcquire())
+	{
+		return;
+	}
+
+	if (m_isEmpty)
+	{
+		QMetaObject::invokeMethod(this, "downloadRules", Qt::QueuedConnection);
+
+		return;
+	}
+
+	m_isLoading = true;
+
+	m_loadingTimer.start();
+
+	QtConcurrent::run(this, &ContentBlockingProfile::parseRules, m_loadingRevision, m_enableWildcards);
+}
+
+void ContentBlockingProfile::parseRuleLine(QString line, ContentBlockingIndex *index, bool enableWildcards) const
 {
 	if (line.indexOf(QLatin1Char('!')) == 0 || line.isEmpty())
 	{
@@ -158,21 +206,25 @@ void ContentBlockingProfile::parseRuleLine(QString line)
 
 	if (line.startsWith(QLatin1String("##")))
 	{
-		m_styleSheet.append(line.mid(2));
+		index->addStyleSheetRule(line.mid(2));
 
 		return;
 	}
 
 	if (line.contains(QLatin1String("##")))
 	{
-		parseStyleSheetRule(line.split(QLatin1String("##")), m_styleSheetBlackList);
+		const QStringList parts(line.split(QLatin1String("##")));
+
+		index->addStyleSheetRule(parts.at(0).split(QLatin1Char(',')), parts.at(1), false);
 
 		return;
 	}
 
 	if (line.contains(QLatin1String("#@#")))
 	{
-		parseStyleSheetRule(line.split(QLatin1String("#@#")), m_styleSheetWhiteList);
+		const QStringList parts(line.split(QLatin1String("#@#")));
+
+		index->addStyleSheetRule(parts.at(0).split(QLatin1Char(',')), parts.at(1), true);
 
 		return;
 	}
@@ -197,30 +249,30 @@ void ContentBlockingProfile::parseRuleLine(QString line)
 		line = line.mid(1);
 	}
 
-	if (line.contains(QLatin1Char('^')) || (!m_enableWildcards && line.contains(QLatin1Char('*'))))
+	if (line.contains(QLatin1Char('^')) || (!enableWildcards && line.contains(QLatin1Char('*'))))
 	{
 		// TODO - '^'
 		return;
 	}
 
-	ContentBlockingRule *rule = new ContentBlockingRule();
-	rule->ruleOption = NoOption;
-	rule->exceptionRuleOption = NoOption;
-	rule->isException = false;
-	rule->needsDomainCheck = false;
+	ContentBlockingRule rule;
+	rule.ruleOption = NoOption;
+	rule.exceptionRuleOption = NoOption;
+	rule.isException = false;
+	rule.needsDomainCheck = false;
 
 	if (line.startsWith(QLatin1String("@@")))
 	{
 		line = line.mid(2);
 
-		rule->isException = true;
+		rule.isException = true;
 	}
 
 	if (line.startsWith(QLatin1String("||")))
 	{
 		line = line.mid(2);
 
-		rule->needsDomainCheck = true;
+		rule.needsDomainCheck = true;
 	}
 
 	for (int i = 0; i < options.count(); ++i)
@@ -229,51 +281,47 @@ void ContentBlockingProfile::parseRuleLine(QString line)
 
 		if (options.at(i).contains(QLatin1String("third-party")))
 		{
-			rule->ruleOption |= ThirdPartyOption;
-			rule->exceptionRuleOption |= (optionException ? ThirdPartyOption : NoOption);
+			rule.ruleOption |= ThirdPartyOption;
+			rule.exceptionRuleOption |= (optionException ? ThirdPartyOption : NoOption);
 		}
 		else if (options.at(i).contains(QLatin1String("stylesheet")))
 		{
-			rule->ruleOption |= StyleSheetOption;
-			rule->exceptionRuleOption |= (optionException ? StyleSheetOption : NoOption);
+			rule.ruleOption |= StyleSheetOption;
+			rule.exceptionRuleOption |= (optionException ? StyleSheetOption : NoOption);
 		}
 		else if (options.at(i).contains(QLatin1String("image")))
 		{
-			rule->ruleOption |= ImageOption;
-			rule->exceptionRuleOption |= (optionException ? ImageOption : NoOption);
+			rule.ruleOption |= ImageOption;
+			rule.exceptionRuleOption |= (optionException ? ImageOption : NoOption);
 		}
 		else if (options.at(i).contains(QLatin1String("script")))
 		{
-			rule->ruleOption |= ScriptOption;
-			rule->exceptionRuleOption |= (optionException ? ScriptOption : NoOption);
+			rule.ruleOption |= ScriptOption;
+			rule.exceptionRuleOption |= (optionException ? ScriptOption : NoOption);
 		}
 		else if (options.at(i).contains(QLatin1String("object")))
 		{
-			rule->ruleOption |= ObjectOption;
-			rule->exceptionRuleOption |= (optionException ? ObjectOption : NoOption);
+			rule.ruleOption |= ObjectOption;
+			rule.exceptionRuleOption |= (optionException ? ObjectOption : NoOption);
 		}
 		else if (options.at(i).contains(QLatin1String("object-subrequest")) || options.at(i).contains(QLatin1String("object_subrequest")))
 		{
-			rule->ruleOption |= ObjectSubRequestOption;
-			rule->exceptionRuleOption |= (optionException ? ObjectSubRequestOption : NoOption);
+			rule.ruleOption |= ObjectSubRequestOption;
+			rule.exceptionRuleOption |= (optionException ? ObjectSubRequestOption : NoOption);
 			// TODO
-			delete rule;
-
 			return;
 		}
 		else if (options.at(i).contains(QLatin1String("subdocument")))
 		{
-			rule->ruleOption |= SubDocumentOption;
-			rule->exceptionRuleOption |= (optionException ? SubDocumentOption : NoOption);
+			rule.ruleOption |= SubDocumentOption;
+			rule.exceptionRuleOption |= (optionException ? SubDocumentOption : NoOption);
 			// TODO
-			delete rule;
-
 			return;
 		}
 		else if (options.at(i).contains(QLatin1String("xmlhttprequest")))
 		{
-			rule->ruleOption |= XmlHttpRequestOption;
-			rule->exceptionRuleOption |= (optionException ? XmlHttpRequestOption : NoOption);
+			rule.ruleOption |= XmlHttpRequestOption;
+			rule.exceptionRuleOption |= (optionException ? XmlHttpRequestOption : NoOption);
 		}
 		else if (options.at(i).contains(QLatin1String("domain")))
 		{
@@ -283,175 +331,69 @@ void ContentBlockingProfile::parseRuleLine(QString line)
 			{
 				if (parsedDomains.at(j).startsWith(QLatin1Char('~')))
 				{
-					rule->allowedDomains.append(parsedDomains.at(j).mid(1));
+					rule.allowedDomains.append(parsedDomains.at(j).mid(1));
 
 					continue;
 				}
 
-				rule->blockedDomains.append(parsedDomains.at(j));
+				rule.blockedDomains.append(parsedDomains.at(j));
 			}
 		}
 		else
 		{
 			// TODO - document, elemhide
-			delete rule;
-
 			return;
 		}
 	}
 
-	addRule(rule, line);
+	rule.pattern = line;
 
-	return;
+	index->addRule(rule);
 }
 
-void ContentBlockingProfile::parseStyleSheetRule(const QStringList &line, QMultiHash<QString, QString> &list)
+void ContentBlockingProfile::deleteIndex(ContentBlockingIndex *index)
 {
-	const QStringList domains = line.at(0).split(QLatin1Char(','));
-
-	for (int i = 0; i < domains.count(); ++i)
-	{
-		list.insert(domains.at(i), line.at(1));
-	}
+	delete index;
 }
 
-void ContentBlockingProfile::resolveRuleOptions(ContentBlockingRule *rule, ContentBlockingManager::ResourceType resourceType, bool &isBlocked)
+void ContentBlockingProfile::deleteRetiredIndexes()
 {
-	const bool blockedDomains = !rule->blockedDomains.isEmpty();
-	const bool allowedDomains = !rule->allowedDomains.isEmpty();
-
-	isBlocked = ((blockedDomains) ? resolveDomainExceptions(m_baseUrlHost, rule->blockedDomains) : isBlocked);
-	isBlocked = ((allowedDomains) ? !resolveDomainExceptions(m_baseUrlHost, rule->allowedDomains) : isBlocked);
-
-	if (rule->ruleOption.testFlag(ThirdPartyOption))
-	{
-		if (m_baseUrlHost.isEmpty() || m_requestSubdomainList.contains(m_baseUrlHost))
-		{
-			isBlocked = rule->exceptionRuleOption.testFlag(ThirdPartyOption);
-		}
-		else if (!blockedDomains && !allowedDomains)
-		{
-			isBlocked = !rule->exceptionRuleOption.testFlag(ThirdPartyOption);
-		}
-	}
+	QMutexLocker locker(&m_indexMutex);
 
-	if (rule->ruleOption.testFlag(ImageOption))
+	if (m_retiredIndexes.isEmpty())
 	{
-		if (resourceType == ContentBlockingManager::ImageType)
-		{
-			isBlocked = (isBlocked ? !rule->exceptionRuleOption.testFlag(ImageOption) : isBlocked);
-		}
-		else
-		{
-			isBlocked = (isBlocked ? rule->exceptionRuleOption.testFlag(ImageOption) : isBlocked);
-		}
-	}
-
-	if (rule->ruleOption.testFlag(ScriptOption))
-	{
-		if (resourceType == ContentBlockingManager::ScriptType)
-		{
-			isBlocked = (isBlocked ? !rule->exceptionRuleOption.testFlag(ScriptOption) : isBlocked);
-		}
-		else
-		{
-			isBlocked = (isBlocked ? rule->exceptionRuleOption.testFlag(ScriptOption) : isBlocked);
-		}
-	}
-
-	if (rule->ruleOption.testFlag(StyleSheetOption))
-	{
-		if (resourceType == ContentBlockingManager::StyleSheetType)
-		{
-			isBlocked = (isBlocked ? !rule->exceptionRuleOption.testFlag(StyleSheetOption) : isBlocked);
-		}
-		else
-		{
-			isBlocked = (isBlocked ? rule->exceptionRuleOption.testFlag(StyleSheetOption) : isBlocked);
-		}
+		return;
 	}
 
-	if (rule->ruleOption.testFlag(ObjectOption))
+///NOTE Readers are registered before loading index pointer, so once there are none, nobody can still hold retired one
+	if (m_activeReaders.loadAcquire() > 0)
 	{
-		if (resourceType == ContentBlockingManager::ObjectType)
-		{
-			isBlocked = (isBlocked ? !rule->exceptionRuleOption.testFlag(ObjectOption) : isBlocked);
-		}
-		else
-		{
-			isBlocked = (isBlocked ? rule->exceptionRuleOption.testFlag(ObjectOption) : isBlocked);
-		}
-	}
+		QTimer::singleShot(1000, this, SLOT(deleteRetiredIndexes()));
 
-	if (rule->ruleOption.testFlag(SubDocumentOption))
-	{
-		// TODO
+		return;
 	}
 
-	if (rule->ruleOption.testFlag(ObjectSubRequestOption))
+	for (int i = 0; i < m_retiredIndexes.count(); ++i)
 	{
-		// TODO
+		QtConcurrent::run(this, &ContentBlockingProfile::deleteIndex, m_retiredIndexes.at(i));
 	}
 
-	if (rule->ruleOption.testFlag(XmlHttpRequestOption))
-	{
-		if (resourceType == ContentBlockingManager::XmlHttpRequestType)
-		{
-			isBlocked = (isBlocked ? !rule->exceptionRuleOption.testFlag(XmlHttpRequestOption) : isBlocked);
-		}
-		else
-		{
-			isBlocked = (isBlocked ? rule->exceptionRuleOption.testFlag(XmlHttpRequestOption) : isBlocked);
-		}
-	}
+	m_retiredIndexes.clear();
 }
 
-void ContentBlockingProfile::addRule(ContentBlockingRule *rule, const QString &ruleString)
+void ContentBlockingProfile::releaseIndex()
 {
-	Node *node = m_root;
-
-	for (int i = 0; i < ruleString.length(); ++i)
-	{
-		const QChar value = ruleString.at(i);
-		bool childrenExists = false;
-
-		for (int j = 0; j < node->children.count(); ++j)
-		{
-			Node *nextNode = node->children.at(j);
-
-			if (nextNode->value == value)
-			{
-				node = nextNode;
-
-				childrenExists = true;
-
-				break;
-			}
-		}
-
-		if (!childrenExists)
-		{
-			Node *newNode = new Node;
-			newNode->value = value;
-
-			node->children.append(newNode);
-
-			node = newNode;
-		}
-	}
-
-	node->rule = rule;
+	m_activeReaders.deref();
 }
 
-void ContentBlockingProfile::deleteNode(Node *node)
+void ContentBlockingProfile::notifyRulesLoaded(const QString &message, bool wasModified)
 {
-	for (int j = 0; j < node->children.count(); ++j)
+	Console::addMessage(message, Otter::OtherMessageCategory, LogMessageLevel, m_information.path);
+
+	if (wasModified)
 	{
-		deleteNode(node->children.at(j));
+		emit profileModified(m_information.name);
 	}
-
-	delete node->rule;
-	delete node;
 }
 
 void ContentBlockingProfile::replyFinished()
@@ -479,7 +421,26 @@ void ContentBlockingProfile::replyFinished()
 	if (downloadedDataChecksum.contains(QByteArray("! Checksum: ")))
 	{
 		QByteArray checksum = downloadedDataChecksum;
-		const QByteArray verifiedChecksum = QCryptographicHash::hash(downloadedDataHeader + QString(downloadedData).replace(QRegExp("^*\n{2,}"), QString("\n")).toStdString().c_str(), QCryptographicHash::Md5);
+		QCryptographicHash hash(QCryptographicHash::Md5);
+		hash.addData(downloadedDataHeader);
+
+///NOTE Runs of empty lines are collapsed, data is hashed in chunks between skipped line breaks, without making copy of it
+		const char *data(downloadedData.constData());
+		int chunkStart(0);
+
+		for (int i = 1; i < downloadedData.size(); ++i)
+		{
+			if (data[i] == '\n' && data[i - 1] == '\n')
+			{
+				hash.addData((data + chunkStart), (i - chunkStart));
+
+				chunkStart = (i + 1);
+			}
+		}
+
+		hash.addData((data + chunkStart), (downloadedData.size() - chunkStart));
+
+		const QByteArray verifiedChecksum = hash.result();
 
 		if (verifiedChecksum.toBase64().replace(QByteArray("="), QByteArray()) != checksum.replace(QByteArray("! Checksum: "), QByteArray()).replace(QByteArray("\n"), QByteArray()))
 		{
@@ -490,6 +451,14 @@ void ContentBlockingProfile::replyFinished()
 	}
 
 	QFile file(m_information.path);
+	QByteArray previousData;
+
+	if (file.open(QIODevice::ReadOnly))
+	{
+		previousData = file.readAll();
+
+		file.close();
+	}
 
 	if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate))
 	{
@@ -512,54 +481,205 @@ void ContentBlockingProfile::replyFinished()
 // TODO
 	}
 
-	const bool wasLoaded = m_wasLoaded;
+	load(true);
+
+///NOTE Current rules stay in use until updated index replaces them, profile is reported as modified afterwards
+	if (isLoaded())
+	{
+		QMutexLocker locker(&m_indexMutex);
+
+		++m_loadingRevision;
+
+		m_isLoading = true;
+
+		m_loadingTimer.start();
+
+		QtConcurrent::run(this, &ContentBlockingProfile::updateRules, m_loadingRevision, m_enableWildcards, previousData);
+
+		return;
+	}
 
 	clear();
-	load(wasLoaded);
 
 	emit profileModified(m_information.name);
 }
 
+QString ContentBlockingProfile::getCachePath() const
+{
+	const QFileInfo fileInformation(m_information.path);
+
+	return fileInformation.absoluteDir().filePath(fileInformation.completeBaseName() + QLatin1String(".dat"));
+}
+
+ContentBlockingIndex* ContentBlockingProfile::createIndex(const QByteArray &data, const QByteArray &checksum, bool enableWildcards) const
+{
+	QTextStream stream(data);
+	stream.readLine(); // header
+
+	ContentBlockingIndex *index(new ContentBlockingIndex());
+
+	while (!stream.atEnd())
+	{
+		parseRuleLine(stream.readLine(), index, enableWildcards);
+	}
+
+	index->optimize(checksum);
+
+	return cacheIndex(index, checksum);
+}
+
+ContentBlockingIndex* ContentBlockingProfile::cacheIndex(ContentBlockingIndex *index, const QByteArray &checksum) const
+{
+	const QString cachePath(getCachePath());
+
+	if (!index->save(cachePath))
+	{
+		return index;
+	}
+
+	ContentBlockingIndex *mappedIndex(ContentBlockingIndex::load(cachePath, checksum));
+
+	if (!mappedIndex)
+	{
+		return index;
+	}
+
+	delete index;
+
+	return mappedIndex;
+}
+
+QByteArray ContentBlockingProfile::createChecksum(const QByteArray &data, bool enableWildcards)
+{
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	hash.addData(data);
+	hash.addData(enableWildcards ? QByteArray("wildcards") : QByteArray());
+
+	return hash.result();
+}
+
+QString ContentBlockingProfile::getRuleKey(QString line)
+{
+///NOTE Mirrors normalization done by parseRuleLine(), but skips options, so it can be cheaply computed for every unchanged line
+	if (line.indexOf(QLatin1Char('!')) == 0 || line.isEmpty())
+	{
+		return QString();
+	}
+
+	if (line.startsWith(QLatin1String("##")))
+	{
+		return line.mid(2);
+	}
+
+	if (line.contains(QLatin1String("##")))
+	{
+		return line.section(QLatin1String("##"), 1, 1);
+	}
+
+	if (line.contains(QLatin1String("#@#")))
+	{
+		return line.section(QLatin1String("#@#"), 1, 1);
+	}
+
+	const int optionSeparator(line.indexOf(QLatin1Char('$')));
+
+	if (optionSeparator >= 0)
+	{
+		line = line.left(optionSeparator);
+	}
+
+	while (line.endsWith(QLatin1Char('|')) || line.endsWith(QLatin1Char('*')) || line.endsWith(QLatin1Char('^')))
+	{
+		line = line.left(line.length() - 1);
+	}
+
+	if (line.startsWith(QLatin1Char('*')))
+	{
+		line = line.mid(1);
+	}
+
+	if (line.startsWith(QLatin1String("@@")))
+	{
+		line = line.mid(2);
+	}
+
+	if (line.startsWith(QLatin1String("||")))
+	{
+		line = line.mid(2);
+	}
+
+	return line;
+}
+
 ContentBlockingInformation ContentBlockingProfile::getInformation() const
 {
 	return m_information;
 }
 
-ContentBlockingManager::CheckResult ContentBlockingProfile::checkUrl(const QUrl &baseUrl, const QUrl &requestUrl, ContentBlockingManager::ResourceType resourceType)
+const ContentBlockingIndex* ContentBlockingProfile::acquireIndex()
 {
-	if (!m_wasLoaded)
+	m_activeReaders.ref();
+
+	const ContentBlockingIndex *index(m_index.loadAcquire());
+
+	if (index)
+	{
+		return index;
+	}
+
+	m_activeReaders.deref();
+
+	QMutexLocker locker(&m_indexMutex);
+
+	scheduleLoading();
+
+///NOTE Waiting for rules is opt-in, by default requests pass through until rules are ready
+	while (m_isLoading && m_loadingTimeout > 0)
 	{
-		if (!loadRules())
+		const qint64 remainingTime(m_loadingTimeout - m_loadingTimer.elapsed());
+
+		if (remainingTime <= 0)
 		{
-			return ContentBlockingManager::CheckResult();
+			break;
 		}
+
+		m_loadingCondition.wait(&m_indexMutex, remainingTime);
 	}
 
-	m_baseUrlHost = baseUrl.host();
-	m_requestUrl = requestUrl.url(QUrl::RemoveScheme);
-	m_requestHost = requestUrl.host();
+	m_activeReaders.ref();
+
+	index = m_index.loadAcquire();
 
-	if (m_requestUrl.startsWith(QLatin1String("//")))
+	if (!index)
 	{
-		m_requestUrl = m_requestUrl.mid(2);
+		m_activeReaders.deref();
 	}
 
-	const int urlLenght = m_requestUrl.length();
+	return index;
+}
+
+ContentBlockingManager::CheckResult ContentBlockingProfile::checkUrl(const QUrl &baseUrl, const QUrl &requestUrl, ContentBlockingManager::ResourceType resourceType)
+{
+	const ContentBlockingIndex *index(acquireIndex());
 
-	for (int i = 0; i < urlLenght; ++i)
+	if (!index)
 	{
-		const QString urlSubstring = m_requestUrl.right(urlLenght - i);
+		return ContentBlockingManager::CheckResult();
+	}
 
-		if (checkUrlSubstring(m_root, urlSubstring, QString(), resourceType))
-		{
-			ContentBlockingManager::CheckResult result;
-			result.url = requestUrl;
-			result.profile = m_information.name;
-			result.resourceType = resourceType;
-			result.isBlocked = true;
+	const bool isBlocked(index->checkUrl(baseUrl.host(), requestUrl, resourceType) >= 0);
 
-			return result;
-		}
+	releaseIndex();
+
+	if (isBlocked)
+	{
+		ContentBlockingManager::CheckResult result;
+		result.url = requestUrl;
+		result.profile = m_information.name;
+		result.resourceType = resourceType;
+		result.isBlocked = true;
+
+		return result;
 	}
 
 	return ContentBlockingManager::CheckResult();
@@ -567,32 +687,32 @@ ContentBlockingManager::CheckResult ContentBlockingProfile::checkUrl(const QUrl
 
 QStringList ContentBlockingProfile::getStyleSheet()
 {
-	if (!m_wasLoaded)
+	const ContentBlockingIndex *index(acquireIndex());
+
+	if (!index)
 	{
-		loadRules();
+		return QStringList();
 	}
 
-	return m_styleSheet;
-}
+	const QStringList styleSheet(index->getStyleSheet());
 
-QStringList ContentBlockingProfile::getStyleSheetBlackList(const QString &domain)
-{
-	if (!m_wasLoaded)
-	{
-		loadRules();
-	}
+	releaseIndex();
 
-	return m_styleSheetBlackList.values(domain);
+	return styleSheet;
 }
 
-QStringList ContentBlockingProfile::getStyleSheetWhiteList(const QString &domain)
+void ContentBlockingProfile::getStyleSheetRules(const QString &domain, QStringList &blackList, QStringList &whiteList)
 {
-	if (!m_wasLoaded)
+	const ContentBlockingIndex *index(acquireIndex());
+
+	if (!index)
 	{
-		loadRules();
+		return;
 	}
 
-	return m_styleSheetWhiteList.values(domain);
+	index->getStyleSheetRules(domain, blackList, whiteList);
+
+	releaseIndex();
 }
 
 bool ContentBlockingProfile::downloadRules()
@@ -628,145 +748,163 @@ bool ContentBlockingProfile::downloadRules()
 	return true;
 }
 
-bool ContentBlockingProfile::loadRules()
+void ContentBlockingProfile::parseRules(int revision, bool enableWildcards)
 {
-	if (m_isEmpty)
-	{
-		downloadRules();
+	QElapsedTimer timer;
+	timer.start();
 
-		return false;
-	}
+	QFile file(m_information.path);
+	file.open(QIODevice::ReadOnly);
 
-	m_wasLoaded = true;
+	const QByteArray data(file.readAll());
 
-	if (m_domainExpression.pattern().isEmpty())
+	file.close();
+
+	const QByteArray checksum(createChecksum(data, enableWildcards));
+	ContentBlockingIndex *index(ContentBlockingIndex::load(getCachePath(), checksum));
+
+	if (index)
 	{
-		m_domainExpression = QRegularExpression(QLatin1String("[:\?&/=]"));
-#if QT_VERSION >= 0x050400
-		m_domainExpression.optimize();
-#endif
+		publishIndex(index, revision, QCoreApplication::translate("main", "Loaded %n content blocking rule(s) from cache in %1 ms", "", index->getRulesAmount()).arg(timer.elapsed()), false);
+
+		return;
 	}
 
-	QFile file(m_information.path);
-	file.open(QIODevice::ReadOnly | QIODevice::Text);
+	index = createIndex(data, checksum, enableWildcards);
 
-	QTextStream stream(&file);
-	stream.readLine(); // header
+	publishIndex(index, revision, QCoreApplication::translate("main", "Parsed %n content blocking rule(s) in %1 ms", "", index->getRulesAmount()).arg(timer.elapsed()), false);
+}
 
-	m_root = new Node();
+void ContentBlockingProfile::updateRules(int revision, bool enableWildcards, const QByteArray &previousData)
+{
+	QElapsedTimer timer;
+	timer.start();
 
-	while (!stream.atEnd())
-	{
-		parseRuleLine(stream.readLine());
-	}
+	QFile file(m_information.path);
+	file.open(QIODevice::ReadOnly);
+
+	const QByteArray data(file.readAll());
 
 	file.close();
 
-	return true;
-}
+	QList<QByteArray> previousLines(previousData.split('\n'));
+	QList<QByteArray> lines(data.split('\n'));
+	QSet<QByteArray> previousRules;
+	QSet<QByteArray> rules;
+	QSet<QString> retainedRules;
+	ContentBlockingIndex removedRules;
+	ContentBlockingIndex addedRules;
+	int changedLines(0);
 
-bool ContentBlockingProfile::resolveDomainExceptions(const QString &url, const QStringList &ruleList)
-{
-	for (int i = 0; i < ruleList.count(); ++i)
+///NOTE First line is header, changes of comments are ignored when parsed
+	for (int i = 1; i < previousLines.count(); ++i)
 	{
-		if (url.contains(ruleList.at(i)))
+		if (previousLines.at(i).endsWith('\r'))
 		{
-			return true;
+			previousLines[i].chop(1);
 		}
-	}
 
-	return false;
-}
+		previousRules.insert(previousLines.at(i));
+	}
 
-bool ContentBlockingProfile::checkUrlSubstring(Node *node, const QString &subString, QString currentRule, ContentBlockingManager::ResourceType resourceType)
-{
-	for (int i = 0; i < subString.length(); ++i)
+	for (int i = 1; i < lines.count(); ++i)
 	{
-		const QChar treeChar = subString.at(i);
-
-		if (node->rule && checkRuleMatch(node->rule, currentRule, resourceType))
+		if (lines.at(i).endsWith('\r'))
 		{
-			return true;
+			lines[i].chop(1);
 		}
 
-		bool childrenExists = false;
+		rules.insert(lines.at(i));
 
-		for (int j = 0; j < node->children.count(); ++j)
+		if (previousRules.contains(lines.at(i)))
 		{
-			Node *nextNode = node->children.at(j);
-
-			if (nextNode->value == QLatin1Char('*'))
-			{
-				const QString wildcardSubString = subString.mid(i);
+			retainedRules.insert(getRuleKey(QString::fromUtf8(lines.at(i))));
+		}
+		else
+		{
+			parseRuleLine(QString::fromUtf8(lines.at(i)), &addedRules, enableWildcards);
 
-				for (int k = 0; k < wildcardSubString.length(); ++k)
-				{
-					if (checkUrlSubstring(nextNode, wildcardSubString.right(wildcardSubString.length() - k), currentRule + wildcardSubString.left(k), resourceType))
-					{
-						return true;
-					}
-				}
-			}
+			++changedLines;
+		}
+	}
 
-			if (nextNode->value == treeChar)
-			{
-				node = nextNode;
+	QSet<QByteArray>::const_iterator iterator;
 
-				childrenExists = true;
+	for (iterator = previousRules.constBegin(); iterator != previousRules.constEnd(); ++iterator)
+	{
+		if (!rules.contains(*iterator))
+		{
+			parseRuleLine(QString::fromUtf8(*iterator), &removedRules, enableWildcards);
 
-				break;
-			}
+			++changedLines;
 		}
+	}
+
+	const QByteArray checksum(createChecksum(data, enableWildcards));
+	ContentBlockingIndex *index(NULL);
 
-		if (!childrenExists)
+	if (changedLines < (lines.count() / 2))
+	{
+		m_activeReaders.ref();
+
+		const ContentBlockingIndex *currentIndex(m_index.loadAcquire());
+
+		if (currentIndex)
 		{
-			return false;
+			index = ContentBlockingIndex::createUpdatedIndex(currentIndex, removedRules, addedRules, retainedRules, checksum);
 		}
 
-		currentRule += treeChar;
+		m_activeReaders.deref();
 	}
 
-	if (node->rule && checkRuleMatch(node->rule, currentRule, resourceType))
+	if (index)
 	{
-		return true;
+		index = cacheIndex(index, checksum);
+
+		publishIndex(index, revision, QCoreApplication::translate("main", "Updated %n content blocking rule(s) from %1 changed line(s) in %2 ms", "", index->getRulesAmount()).arg(changedLines).arg(timer.elapsed()), true);
+
+		return;
 	}
 
-	return false;
+	index = createIndex(data, checksum, enableWildcards);
+
+	publishIndex(index, revision, QCoreApplication::translate("main", "Parsed %n content blocking rule(s) in %1 ms", "", index->getRulesAmount()).arg(timer.elapsed()), true);
 }
 
-bool ContentBlockingProfile::checkRuleMatch(ContentBlockingRule *rule, const QString &currentRule, ContentBlockingManager::ResourceType resourceType)
+void ContentBlockingProfile::publishIndex(ContentBlockingIndex *index, int revision, const QString &message, bool wasModified)
 {
-	bool isBlocked = false;
+	QMutexLocker locker(&m_indexMutex);
 
-	if (m_requestUrl.contains(currentRule))
+	if (revision != m_loadingRevision)
 	{
-		m_requestSubdomainList = ContentBlockingManager::createSubdomainList(m_requestHost);
+		delete index;
 
-		if (rule->needsDomainCheck)
-		{
-			if (!m_requestSubdomainList.contains(currentRule.left(currentRule.indexOf(m_domainExpression))))
-			{
-				return false;
-			}
-			else
-			{
-				isBlocked = true;
-			}
-		}
-		else
-		{
-			isBlocked = true;
-		}
+		m_loadingTimer.start();
 
-		resolveRuleOptions(rule, resourceType, isBlocked);
+		QtConcurrent::run(this, &ContentBlockingProfile::parseRules, m_loadingRevision, m_enableWildcards);
 
-		if (isBlocked)
-		{
-			isBlocked = !rule->isException;
-		}
+		return;
 	}
 
-	return isBlocked;
+	ContentBlockingIndex *previousIndex(m_index.fetchAndStoreOrdered(index));
+
+	if (previousIndex)
+	{
+		m_retiredIndexes.append(previousIndex);
+
+		QMetaObject::invokeMethod(this, "deleteRetiredIndexes", Qt::QueuedConnection);
+	}
+
+	m_isLoading = false;
+
+	m_loadingCondition.wakeAll();
+
+	QMetaObject::invokeMethod(this, "notifyRulesLoaded", Qt::QueuedConnection, Q_ARG(QString, message), Q_ARG(bool, wasModified));
+}
+
+bool ContentBlockingProfile::isLoaded() const
+{
+	return (m_index.loadAcquire() != NULL);
 }
 
 }
@@ -24,14 +24,19 @@
 
 #include "ContentBlockingManager.h"
 
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
-#include <QtCore/QRegularExpression>
 #include <QtCore/QUrl>
+#include <QtCore/QWaitCondition>
 #include <QtNetwork/QNetworkReply>
 
 namespace Otter
 {
 
+class ContentBlockingIndex;
+
 struct ContentBlockingInformation
 {
 	QString name;
@@ -62,6 +67,7 @@ public:
 
 	struct ContentBlockingRule
 	{
+		QString pattern;
 		QStringList blockedDomains;
 		QStringList allowedDomains;
 		RuleOptions ruleOption;
@@ -74,56 +80,55 @@ public:
 
 	ContentBlockingInformation getInformation() const;
 	ContentBlockingManager::CheckResult checkUrl(const QUrl &baseUrl, const QUrl &requestUrl, ContentBlockingManager::ResourceType resourceType);
+	void getStyleSheetRules(const QString &domain, QStringList &blackList, QStringList &whiteList);
 	QStringList getStyleSheet();
-	QStringList getStyleSheetBlackList(const QString &domain);
-	QStringList getStyleSheetWhiteList(const QString &domain);
-	bool downloadRules();
+	void loadRules();
+	Q_INVOKABLE bool downloadRules();
 
 protected:
-	struct Node
-	{
-		ContentBlockingRule *rule;
-		QChar value;
-		QVarLengthArray<Node*, 5> children;
-
-		Node() : rule(NULL), value(0) {}
-	};
-
 	void clear();
 	void load(bool onlyHeader = false);
-	void parseRuleLine(QString line);
-	void resolveRuleOptions(ContentBlockingRule *rule, ContentBlockingManager::ResourceType resourceType, bool &isBlocked);
-	void parseStyleSheetRule(const QStringList &line, QMultiHash<QString, QString> &list);
-	void addRule(ContentBlockingRule *rule, const QString &ruleString);
-	void deleteNode(Node *node);
-	bool loadRules();
-	bool resolveDomainExceptions(const QString &url, const QStringList &ruleList);
-	bool checkUrlSubstring(Node *node, const QString &subString, QString currentRule, ContentBlockingManager::ResourceType resourceType);
-	bool checkRuleMatch(ContentBlockingRule *rule, const QString &currentRule, ContentBlockingManager::ResourceType resourceType);
+	void scheduleLoading();
+	void parseRules(int revision, bool enableWildcards);
+	void updateRules(int revision, bool enableWildcards, const QByteArray &previousData);
+	void publishIndex(ContentBlockingIndex *index, int revision, const QString &message, bool wasModified);
+	void parseRuleLine(QString line, ContentBlockingIndex *index, bool enableWildcards) const;
+	void deleteIndex(ContentBlockingIndex *index);
+	void releaseIndex();
+	QString getCachePath() const;
+	ContentBlockingIndex* createIndex(const QByteArray &data, const QByteArray &checksum, bool enableWildcards) const;
+	ContentBlockingIndex* cacheIndex(ContentBlockingIndex *index, const QByteArray &checksum) const;
+	static QByteArray createChecksum(const QByteArray &data, bool enableWildcards);
+	static QString getRuleKey(QString line);
+	const ContentBlockingIndex* acquireIndex();
+	bool isLoaded() const;
 
 protected slots:
 	void optionChanged(const QString &option);
+	void notifyRulesLoaded(const QString &message, bool wasModified);
 	void replyFinished();
+	void deleteRetiredIndexes();
 
 private:
-	Node *m_root;
 	QNetworkReply *m_networkReply;
-	QString m_requestUrl;
-	QString m_requestHost;
-	QString m_baseUrlHost;
-	QRegularExpression m_domainExpression;
 	ContentBlockingInformation m_information;
-	QStringList m_requestSubdomainList;
-	QStringList m_styleSheet;
-	QMultiHash<QString, QString> m_styleSheetBlackList;
-	QMultiHash<QString, QString> m_styleSheetWhiteList;
+	QAtomicPointer<ContentBlockingIndex> m_index;
+	QAtomicInt m_activeReaders;
+	QMutex m_indexMutex;
+	QWaitCondition m_loadingCondition;
+	QElapsedTimer m_loadingTimer;
+	QList<ContentBlockingIndex*> m_retiredIndexes;
+	int m_loadingRevision;
+	int m_loadingTimeout;
 	bool m_enableWildcards;
 	bool m_isUpdating;
 	bool m_isEmpty;
-	bool m_wasLoaded;
+	bool m_isLoading;
 
 signals:
 	void profileModified(const QString &profile);
+
+friend class ContentBlockingManager;
 };
 
 }
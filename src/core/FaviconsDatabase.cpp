@@ -0,0 +1,535 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#include "FaviconsDatabase.h"
+#include "Console.h"
+#include "SessionsManager.h"
+#include "Utils.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QSaveFile>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+
+namespace Otter
+{
+
+const quint32 FaviconsDatabase::m_version(2);
+const int FaviconsDatabase::m_streamVersion(QDataStream::Qt_5_3);
+
+FaviconsDatabase::FaviconsDatabase(const QString &path, QObject *parent) : QObject(parent),
+	m_path(path),
+	m_file(NULL),
+	m_data(NULL),
+	m_pixmaps(1048576),
+	m_mappingRecords(0),
+	m_fileStreamVersion(m_streamVersion)
+{
+	load();
+
+	if (m_file && m_mappingRecords > (((m_urls.count() + m_hosts.count()) * 2) + 1000) && !SessionsManager::isReadOnly())
+	{
+		compact();
+	}
+
+	if (m_file)
+	{
+		m_data = m_file->map(0, m_file->size());
+	}
+}
+
+FaviconsDatabase::~FaviconsDatabase()
+{
+	save();
+
+	if (m_file)
+	{
+		m_file->close();
+
+		delete m_file;
+	}
+}
+
+///NOTE Database is single file with records appended to it, image data is only read from mapped file when icon is painted at size which was not cached yet
+void FaviconsDatabase::load()
+{
+	m_file = new QFile(m_path);
+
+	if (!m_file->open(QIODevice::ReadOnly))
+	{
+		delete m_file;
+
+		m_file = NULL;
+
+		return;
+	}
+
+	QDataStream stream(m_file);
+	QByteArray magic;
+	quint32 version(0);
+	qint32 streamVersion(0);
+
+	stream >> magic >> version >> streamVersion;
+
+	if (magic != QByteArray("OTFD") || version != m_version || streamVersion <= 0 || streamVersion > QDataStream::Qt_DefaultCompiledVersion)
+	{
+		if (m_file->size() > 0)
+		{
+			Console::addMessage(tr("Failed to load favicons database: %1").arg(tr("unsupported format")), OtherMessageCategory, ErrorMessageLevel, m_path);
+		}
+
+		m_file->close();
+
+		delete m_file;
+
+		m_file = NULL;
+
+		if (!SessionsManager::isReadOnly())
+		{
+			QFile::remove(m_path);
+		}
+
+		return;
+	}
+
+///NOTE Records are always read and appended in format stored in header, so they are decoded the same way after upgrade of Qt
+	stream.setVersion(streamVersion);
+
+	m_fileStreamVersion = streamVersion;
+
+	qint64 validLength(m_file->pos());
+
+	while (!stream.atEnd())
+	{
+		quint8 type(0);
+
+		stream >> type;
+
+		if (type == IconRecord)
+		{
+			IconData icon;
+
+			stream >> icon.hash >> icon.length;
+
+			icon.offset = m_file->pos();
+
+			if (stream.status() != QDataStream::Ok || icon.length > static_cast<quint64>(m_file->size() - icon.offset) || stream.skipRawData(icon.length) != static_cast<int>(icon.length))
+			{
+				break;
+			}
+
+			if (!m_hashes.contains(icon.hash))
+			{
+				m_hashes[icon.hash] = m_icons.count();
+
+				m_icons.append(icon);
+			}
+		}
+		else if (type == UrlRecord || type == HostRecord)
+		{
+			QString key;
+			QByteArray hash;
+
+			stream >> key >> hash;
+
+			if (stream.status() != QDataStream::Ok)
+			{
+				break;
+			}
+
+			QHash<QString, int> &mappings((type == UrlRecord) ? m_urls : m_hosts);
+			const int icon(m_hashes.value(hash, -1));
+
+			if (icon < 0)
+			{
+				mappings.remove(key);
+			}
+			else
+			{
+				mappings[key] = icon;
+			}
+
+			++m_mappingRecords;
+		}
+		else
+		{
+			break;
+		}
+
+		validLength = m_file->pos();
+	}
+
+///NOTE Incomplete record left by interrupted write is cut off, otherwise records appended after it would be unreadable
+	if (validLength < m_file->size() && !SessionsManager::isReadOnly())
+	{
+		Console::addMessage(tr("Favicons database was damaged, discarding %n byte(s) of invalid data", "", (m_file->size() - validLength)), OtherMessageCategory, ErrorMessageLevel, m_path);
+
+		m_file->close();
+
+		if (!QFile::resize(m_path, validLength) || !m_file->open(QIODevice::ReadOnly))
+		{
+			delete m_file;
+
+			m_file = NULL;
+
+			m_icons.clear();
+			m_hashes.clear();
+			m_urls.clear();
+			m_hosts.clear();
+
+			m_mappingRecords = 0;
+
+			QFile::remove(m_path);
+		}
+	}
+}
+
+void FaviconsDatabase::compact()
+{
+	QVector<bool> isReferenced(m_icons.count(), false);
+	QHash<QString, int>::const_iterator iterator;
+
+	for (iterator = m_urls.constBegin(); iterator != m_urls.constEnd(); ++iterator)
+	{
+		isReferenced[iterator.value()] = true;
+	}
+
+	for (iterator = m_hosts.constBegin(); iterator != m_hosts.constEnd(); ++iterator)
+	{
+		isReferenced[iterator.value()] = true;
+	}
+
+	QSaveFile file(m_path);
+
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(m_streamVersion);
+	stream << QByteArray("OTFD") << m_version << qint32(m_streamVersion);
+
+	for (int i = 0; i < m_icons.count(); ++i)
+	{
+		if (isReferenced.at(i))
+		{
+			const QByteArray data(getData(i));
+
+			stream << quint8(IconRecord) << m_icons.at(i).hash << quint32(data.size());
+			stream.writeRawData(data.constData(), data.size());
+		}
+	}
+
+	for (iterator = m_urls.constBegin(); iterator != m_urls.constEnd(); ++iterator)
+	{
+		stream << quint8(UrlRecord) << iterator.key() << m_icons.at(iterator.value()).hash;
+	}
+
+	for (iterator = m_hosts.constBegin(); iterator != m_hosts.constEnd(); ++iterator)
+	{
+		stream << quint8(HostRecord) << iterator.key() << m_icons.at(iterator.value()).hash;
+	}
+
+	m_file->close();
+
+	delete m_file;
+
+	m_file = NULL;
+
+	m_icons.clear();
+	m_hashes.clear();
+	m_urls.clear();
+	m_hosts.clear();
+
+	m_mappingRecords = 0;
+
+	file.commit();
+
+	load();
+}
+
+void FaviconsDatabase::setIcon(const QUrl &url, const QIcon &icon)
+{
+	if (!url.isValid() || icon.isNull())
+	{
+		return;
+	}
+
+	const QList<QSize> sizes(icon.availableSizes());
+	QSize size(16, 16);
+
+	for (int i = 0; i < sizes.count(); ++i)
+	{
+		if (sizes.at(i).width() > size.width() && sizes.at(i).width() <= 64)
+		{
+			size = sizes.at(i);
+		}
+	}
+
+	QByteArray data;
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+
+	if (!icon.pixmap(size).save(&buffer, "PNG"))
+	{
+		return;
+	}
+
+///NOTE Sites often share the same icon, so it is stored only once
+	const QByteArray hash(QCryptographicHash::hash(data, QCryptographicHash::Sha1));
+	int index(m_hashes.value(hash, -1));
+
+	if (index < 0)
+	{
+		IconData iconData;
+		iconData.hash = hash;
+		iconData.data = data;
+		iconData.length = data.size();
+
+		index = m_icons.count();
+
+		m_icons.append(iconData);
+
+		m_hashes[hash] = index;
+
+		QDataStream stream(&m_pendingRecords, (QIODevice::WriteOnly | QIODevice::Append));
+		stream.setVersion(m_fileStreamVersion);
+		stream << quint8(IconRecord) << hash << quint32(data.size());
+		stream.writeRawData(data.constData(), data.size());
+	}
+
+	setMapping(UrlRecord, getUrlKey(url), index);
+
+	if (!url.host().isEmpty())
+	{
+		setMapping(HostRecord, url.host(), index);
+	}
+}
+
+void FaviconsDatabase::setMapping(RecordType type, const QString &key, int icon)
+{
+	QHash<QString, int> &mappings((type == UrlRecord) ? m_urls : m_hosts);
+
+	if (mappings.value(key, -1) == icon)
+	{
+		return;
+	}
+
+	mappings[key] = icon;
+
+	QDataStream stream(&m_pendingRecords, (QIODevice::WriteOnly | QIODevice::Append));
+	stream.setVersion(m_fileStreamVersion);
+	stream << quint8(type) << key << m_icons.at(icon).hash;
+
+	++m_mappingRecords;
+}
+
+void FaviconsDatabase::clear()
+{
+	if (m_file)
+	{
+		m_file->close();
+
+		delete m_file;
+
+		m_file = NULL;
+	}
+
+	m_data = NULL;
+
+	m_pendingRecords.clear();
+	m_icons.clear();
+	m_hashes.clear();
+	m_urls.clear();
+	m_hosts.clear();
+	m_pixmaps.clear();
+
+	m_mappingRecords = 0;
+	m_fileStreamVersion = m_streamVersion;
+
+	QFile::remove(m_path);
+}
+
+QString FaviconsDatabase::getUrlKey(const QUrl &url)
+{
+	return Utils::normalizeUrl(url).toString(QUrl::RemoveUserInfo | QUrl::RemoveFragment);
+}
+
+QPixmap FaviconsDatabase::getPixmap(const QByteArray &hash, const QSize &size)
+{
+	const int icon(m_hashes.value(hash, -1));
+
+	if (icon < 0 || size.isEmpty())
+	{
+		return QPixmap();
+	}
+
+	const QPair<QByteArray, quint32> key(hash, ((static_cast<quint32>(size.width()) << 16) | static_cast<quint32>(size.height() & 0xFFFF)));
+
+	if (m_pixmaps.contains(key))
+	{
+		return *m_pixmaps.object(key);
+	}
+
+	QImage image;
+
+	if (!image.loadFromData(getData(icon)))
+	{
+		return QPixmap();
+	}
+
+	if (image.size() != size)
+	{
+		image = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	}
+
+	const QPixmap pixmap(QPixmap::fromImage(image));
+
+	m_pixmaps.insert(key, new QPixmap(pixmap), (pixmap.width() * pixmap.height() * 4));
+
+	return pixmap;
+}
+
+QByteArray FaviconsDatabase::getData(int icon)
+{
+	const IconData &iconData(m_icons.at(icon));
+
+	if (!iconData.data.isEmpty())
+	{
+		return iconData.data;
+	}
+
+	if (m_data)
+	{
+		return QByteArray::fromRawData(reinterpret_cast<const char*>(m_data + iconData.offset), iconData.length);
+	}
+
+	if (m_file && m_file->seek(iconData.offset))
+	{
+		return m_file->read(iconData.length);
+	}
+
+	return QByteArray();
+}
+
+QIcon FaviconsDatabase::getIcon(const QUrl &url)
+{
+	int icon(m_urls.value(getUrlKey(url), -1));
+
+	if (icon < 0 && !url.host().isEmpty())
+	{
+		icon = m_hosts.value(url.host(), -1);
+	}
+
+	if (icon < 0)
+	{
+		return QIcon();
+	}
+
+///NOTE The same icon is returned for each request, so views can reuse pixmaps cached for its key
+	if (m_icons.at(icon).icon.isNull())
+	{
+		m_icons[icon].icon = QIcon(new FaviconIconEngine(this, m_icons.at(icon).hash));
+	}
+
+	return m_icons.at(icon).icon;
+}
+
+bool FaviconsDatabase::save()
+{
+	if (m_pendingRecords.isEmpty() || SessionsManager::isReadOnly())
+	{
+		return true;
+	}
+
+	QFile file(m_path);
+	const bool needsHeader(!file.exists() || file.size() == 0);
+
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+	{
+		Console::addMessage(tr("Failed to save favicons database: %1").arg(file.errorString()), OtherMessageCategory, ErrorMessageLevel, m_path);
+
+		return false;
+	}
+
+	if (needsHeader)
+	{
+		QDataStream stream(&file);
+		stream.setVersion(m_fileStreamVersion);
+		stream << QByteArray("OTFD") << m_version << qint32(m_fileStreamVersion);
+	}
+
+	const bool isSuccess(file.write(m_pendingRecords) == m_pendingRecords.size());
+
+	file.close();
+
+	if (isSuccess)
+	{
+		m_pendingRecords.clear();
+	}
+
+	return isSuccess;
+}
+
+FaviconIconEngine::FaviconIconEngine(FaviconsDatabase *database, const QByteArray &hash) : QIconEngine(),
+	m_database(database),
+	m_hash(hash)
+{
+}
+
+void FaviconIconEngine::paint(QPainter *painter, const QRect &rectangle, QIcon::Mode mode, QIcon::State state)
+{
+	const QPixmap pixmap(this->pixmap(rectangle.size(), mode, state));
+
+	if (!pixmap.isNull())
+	{
+		painter->drawPixmap(QRect(QPoint((rectangle.x() + ((rectangle.width() - pixmap.width()) / 2)), (rectangle.y() + ((rectangle.height() - pixmap.height()) / 2))), pixmap.size()), pixmap);
+	}
+}
+
+QIconEngine* FaviconIconEngine::clone() const
+{
+	return new FaviconIconEngine(m_database, m_hash);
+}
+
+QPixmap FaviconIconEngine::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
+{
+	Q_UNUSED(mode)
+	Q_UNUSED(state)
+
+	return (m_database ? m_database->getPixmap(m_hash, size) : QPixmap());
+}
+
+QSize FaviconIconEngine::actualSize(const QSize &size, QIcon::Mode mode, QIcon::State state)
+{
+	Q_UNUSED(mode)
+	Q_UNUSED(state)
+
+	return size;
+}
+
+QString FaviconIconEngine::key() const
+{
+	return QLatin1String("FaviconIconEngine");
+}
+
+}
@@ -0,0 +1,109 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#ifndef OTTER_FAVICONSDATABASE_H
+#define OTTER_FAVICONSDATABASE_H
+
+#include <QtCore/QCache>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
+#include <QtCore/QUrl>
+#include <QtCore/QVector>
+#include <QtGui/QIcon>
+#include <QtGui/QIconEngine>
+
+namespace Otter
+{
+
+class FaviconsDatabase : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit FaviconsDatabase(const QString &path, QObject *parent = NULL);
+	~FaviconsDatabase();
+
+	void setIcon(const QUrl &url, const QIcon &icon);
+	void clear();
+	QPixmap getPixmap(const QByteArray &hash, const QSize &size);
+	QIcon getIcon(const QUrl &url);
+	bool save();
+
+protected:
+	enum RecordType
+	{
+		IconRecord = 1,
+		UrlRecord = 2,
+		HostRecord = 3
+	};
+
+	struct IconData
+	{
+		QByteArray hash;
+		QByteArray data;
+		QIcon icon;
+		qint64 offset;
+		quint32 length;
+
+		IconData() : offset(-1), length(0) {}
+	};
+
+	void load();
+	void compact();
+	void setMapping(RecordType type, const QString &key, int icon);
+	QByteArray getData(int icon);
+	static QString getUrlKey(const QUrl &url);
+
+private:
+	QString m_path;
+	QFile *m_file;
+	uchar *m_data;
+	QByteArray m_pendingRecords;
+	QVector<IconData> m_icons;
+	QHash<QByteArray, int> m_hashes;
+	QHash<QString, int> m_urls;
+	QHash<QString, int> m_hosts;
+	QCache<QPair<QByteArray, quint32>, QPixmap> m_pixmaps;
+	int m_mappingRecords;
+	int m_fileStreamVersion;
+
+	static const quint32 m_version;
+	static const int m_streamVersion;
+};
+
+class FaviconIconEngine : public QIconEngine
+{
+public:
+	explicit FaviconIconEngine(FaviconsDatabase *database, const QByteArray &hash);
+
+	void paint(QPainter *painter, const QRect &rectangle, QIcon::Mode mode, QIcon::State state);
+	QIconEngine* clone() const;
+	QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state);
+	QSize actualSize(const QSize &size, QIcon::Mode mode, QIcon::State state);
+	QString key() const;
+
+private:
+	QPointer<FaviconsDatabase> m_database;
+	QByteArray m_hash;
+};
+
+}
+
+#endif
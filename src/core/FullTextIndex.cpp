@@ -0,0 +1,709 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#include "FullTextIndex.h"
+#include "SessionsManager.h"
+#include "Utils.h"
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QMultiMap>
+#include <QtCore/QSaveFile>
+#include <QtCore/QSet>
+#include <QtCore/QTextStream>
+
+namespace Otter
+{
+
+const quint32 FullTextIndex::m_version(2);
+const int FullTextIndex::m_streamVersion(QDataStream::Qt_5_3);
+const int FullTextIndex::m_bucketsAmount(256);
+const int FullTextIndex::m_maximumTextLength(65536);
+const int FullTextIndex::m_maximumPendingLength(4194304);
+
+///NOTE Index is directory with list of documents and buckets of terms, with all terms sharing first two characters in the same bucket, so prefix of each word can be found by reading single bucket
+FullTextIndex::FullTextIndex(const QString &path, QObject *parent) : QObject(parent),
+	m_path(path),
+	m_identifier(0),
+	m_revision(0),
+	m_pendingLength(0),
+	m_removedDocuments(0),
+	m_isProcessing(false)
+{
+	load();
+}
+
+FullTextIndex::~FullTextIndex()
+{
+	m_processingFuture.waitForFinished();
+}
+
+void FullTextIndex::load()
+{
+	QFile file(QDir(m_path).filePath(QLatin1String("documents.dat")));
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+///NOTE Buckets without list of documents would refer to identifiers which will be assigned again
+		if (!SessionsManager::isReadOnly() && QDir(m_path).exists())
+		{
+			QDir(m_path).removeRecursively();
+		}
+
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(m_streamVersion);
+
+	QByteArray magic;
+	quint32 version(0);
+	qint32 streamVersion(0);
+
+	stream >> magic >> version >> streamVersion;
+
+///NOTE Index written by another version may place terms in different buckets, so it is rebuilt from scratch
+	if (magic != QByteArray("OTFI") || version != m_version || streamVersion != m_streamVersion)
+	{
+		file.close();
+
+		if (!SessionsManager::isReadOnly())
+		{
+			QDir(m_path).removeRecursively();
+		}
+
+		return;
+	}
+
+	while (!stream.atEnd())
+	{
+		quint8 type(0);
+		quint32 identifier(0);
+
+		stream >> type >> identifier;
+
+		if (type == AddRecord)
+		{
+			DocumentRecord record;
+
+			stream >> record.url >> record.title >> record.time;
+
+			if (stream.status() != QDataStream::Ok)
+			{
+				break;
+			}
+
+			if (m_urls.contains(record.url))
+			{
+				m_documents.remove(m_urls.value(record.url));
+
+				++m_removedDocuments;
+			}
+
+			m_documents[identifier] = record;
+			m_urls[record.url] = identifier;
+		}
+		else if (type == RemoveRecord && stream.status() == QDataStream::Ok)
+		{
+			if (m_documents.contains(identifier))
+			{
+				m_urls.remove(m_documents.take(identifier).url);
+
+				++m_removedDocuments;
+			}
+		}
+		else
+		{
+			break;
+		}
+
+		m_identifier = qMax(m_identifier, identifier);
+	}
+
+	file.close();
+}
+
+void FullTextIndex::addDocument(const QUrl &url, const QString &title, const QString &text, const QDateTime &time)
+{
+	if (SessionsManager::isReadOnly())
+	{
+		return;
+	}
+
+	Document document;
+	document.url = Utils::normalizeUrl(url);
+	document.title = title;
+	document.text = text.left(m_maximumTextLength);
+	document.time = time;
+
+	QMutexLocker locker(&m_documentsMutex);
+
+///NOTE Documents queued faster than they can be indexed are dropped, so memory usage stays bounded
+	if ((m_pendingLength + document.text.length()) > m_maximumPendingLength)
+	{
+		return;
+	}
+
+	m_pendingLength += document.text.length();
+
+	m_pendingDocuments.enqueue(document);
+
+	if (!m_isProcessing)
+	{
+		m_isProcessing = true;
+		m_processingFuture = QtConcurrent::run(this, &FullTextIndex::processDocuments);
+	}
+}
+
+void FullTextIndex::processDocuments()
+{
+	forever
+	{
+		QList<Document> documents;
+		int revision(0);
+
+		m_documentsMutex.lock();
+
+		if (m_pendingDocuments.isEmpty())
+		{
+			m_isProcessing = false;
+
+			m_documentsMutex.unlock();
+
+			return;
+		}
+
+		while (!m_pendingDocuments.isEmpty() && documents.count() < 50)
+		{
+			const Document document(m_pendingDocuments.dequeue());
+
+			m_pendingLength -= document.text.length();
+
+			documents.append(document);
+		}
+
+		revision = m_revision;
+
+		m_documentsMutex.unlock();
+
+		QVector<QHash<QString, QVector<quint32> > > buckets(m_bucketsAmount);
+		QList<QPair<quint32, DocumentRecord> > records;
+
+		for (int i = 0; i < documents.count(); ++i)
+		{
+			const Document &document(documents.at(i));
+			const QStringList terms(createTerms(document.title + QLatin1Char(' ') + document.url.host() + QLatin1Char(' ') + document.text));
+			DocumentRecord record;
+			record.url = document.url;
+			record.title = document.title;
+			record.time = document.time;
+
+			m_documentsMutex.lock();
+
+			const quint32 identifier(++m_identifier);
+
+			m_documentsMutex.unlock();
+
+			for (int j = 0; j < terms.count(); ++j)
+			{
+				buckets[getBucket(terms.at(j))][terms.at(j)].append(identifier);
+			}
+
+			records.append(qMakePair(identifier, record));
+		}
+
+		m_filesMutex.lock();
+
+		if (!isCurrent(revision))
+		{
+			m_filesMutex.unlock();
+
+			continue;
+		}
+
+		QDir().mkpath(m_path);
+
+		for (int i = 0; i < m_bucketsAmount; ++i)
+		{
+			if (buckets.at(i).isEmpty())
+			{
+				continue;
+			}
+
+			QFile file(getBucketPath(i));
+
+			if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+			{
+				continue;
+			}
+
+			QTextStream stream(&file);
+			stream.setCodec("UTF-8");
+
+			QHash<QString, QVector<quint32> >::const_iterator iterator;
+
+			for (iterator = buckets.at(i).constBegin(); iterator != buckets.at(i).constEnd(); ++iterator)
+			{
+				stream << iterator.key() << QLatin1Char('\t');
+
+				for (int j = 0; j < iterator.value().count(); ++j)
+				{
+					stream << ((j > 0) ? QLatin1String(" ") : QLatin1String("")) << iterator.value().at(j);
+				}
+
+				stream << QLatin1Char('\n');
+			}
+		}
+
+		for (int i = 0; i < records.count(); ++i)
+		{
+			m_documentsMutex.lock();
+
+			if (m_urls.contains(records.at(i).second.url))
+			{
+				const quint32 identifier(m_urls.value(records.at(i).second.url));
+
+				m_documents.remove(identifier);
+
+				++m_removedDocuments;
+
+				m_documentsMutex.unlock();
+
+				appendRecord(RemoveRecord, identifier);
+
+				m_documentsMutex.lock();
+			}
+
+			m_documents[records.at(i).first] = records.at(i).second;
+			m_urls[records.at(i).second.url] = records.at(i).first;
+
+			m_documentsMutex.unlock();
+
+			appendRecord(AddRecord, records.at(i).first, records.at(i).second);
+		}
+
+		m_filesMutex.unlock();
+
+		m_documentsMutex.lock();
+
+		const bool needsCompaction(m_removedDocuments > qMax(1000, m_documents.count()));
+
+		m_documentsMutex.unlock();
+
+		if (needsCompaction)
+		{
+			compact(revision);
+		}
+	}
+}
+
+void FullTextIndex::compact(int revision)
+{
+	m_documentsMutex.lock();
+
+	const QHash<quint32, DocumentRecord> documents(m_documents);
+
+	m_removedDocuments = 0;
+
+	m_documentsMutex.unlock();
+
+///NOTE Buckets are rewritten one by one into new files, so only single bucket needs to be kept in memory and searches are blocked only while new file replaces old one
+	for (int i = 0; i < m_bucketsAmount; ++i)
+	{
+		if (!QFile::exists(getBucketPath(i)))
+		{
+			continue;
+		}
+
+		const QHash<QString, QVector<quint32> > terms(readBucket(i));
+		QSaveFile file(getBucketPath(i));
+
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+		{
+			continue;
+		}
+
+		QTextStream stream(&file);
+		stream.setCodec("UTF-8");
+
+		QHash<QString, QVector<quint32> >::const_iterator iterator;
+
+		for (iterator = terms.constBegin(); iterator != terms.constEnd(); ++iterator)
+		{
+			QStringList identifiers;
+
+			for (int j = 0; j < iterator.value().count(); ++j)
+			{
+				if (documents.contains(iterator.value().at(j)))
+				{
+					identifiers.append(QString::number(iterator.value().at(j)));
+				}
+			}
+
+			if (!identifiers.isEmpty())
+			{
+				stream << iterator.key() << QLatin1Char('\t') << identifiers.join(QLatin1Char(' ')) << QLatin1Char('\n');
+			}
+		}
+
+		stream.flush();
+
+		QMutexLocker filesLocker(&m_filesMutex);
+
+		if (!isCurrent(revision))
+		{
+			file.cancelWriting();
+
+			return;
+		}
+
+		file.commit();
+	}
+
+///NOTE Documents removed while buckets were rewritten are still referenced by them, they are skipped when matches are looked up
+	QMutexLocker filesLocker(&m_filesMutex);
+
+	if (!isCurrent(revision))
+	{
+		return;
+	}
+
+	QSaveFile file(QDir(m_path).filePath(QLatin1String("documents.dat")));
+
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return;
+	}
+
+	m_documentsMutex.lock();
+
+	const QHash<quint32, DocumentRecord> currentDocuments(m_documents);
+
+	m_documentsMutex.unlock();
+
+	QDataStream stream(&file);
+	stream.setVersion(m_streamVersion);
+	stream << QByteArray("OTFI") << m_version << qint32(m_streamVersion);
+
+	QHash<quint32, DocumentRecord>::const_iterator iterator;
+
+	for (iterator = currentDocuments.constBegin(); iterator != currentDocuments.constEnd(); ++iterator)
+	{
+		stream << quint8(AddRecord) << iterator.key() << iterator.value().url << iterator.value().title << iterator.value().time;
+	}
+
+	file.commit();
+}
+
+void FullTextIndex::appendRecord(RecordType type, quint32 identifier, const DocumentRecord &record)
+{
+	QFile file(QDir(m_path).filePath(QLatin1String("documents.dat")));
+	const bool needsHeader(!file.exists() || file.size() == 0);
+
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+	{
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(m_streamVersion);
+
+	if (needsHeader)
+	{
+		stream << QByteArray("OTFI") << m_version << qint32(m_streamVersion);
+	}
+
+	stream << quint8(type) << identifier;
+
+	if (type == AddRecord)
+	{
+		stream << record.url << record.title << record.time;
+	}
+
+	file.close();
+}
+
+void FullTextIndex::removeDocuments(const QDateTime &from, const QDateTime &to)
+{
+	QMutexLocker filesLocker(&m_filesMutex);
+	QList<quint32> identifiers;
+
+	m_documentsMutex.lock();
+
+	QHash<quint32, DocumentRecord>::iterator iterator(m_documents.begin());
+
+	while (iterator != m_documents.end())
+	{
+		if ((!from.isValid() || iterator.value().time >= from) && (!to.isValid() || iterator.value().time < to))
+		{
+			identifiers.append(iterator.key());
+
+			m_urls.remove(iterator.value().url);
+
+			iterator = m_documents.erase(iterator);
+		}
+		else
+		{
+			++iterator;
+		}
+	}
+
+	m_removedDocuments += identifiers.count();
+
+	m_documentsMutex.unlock();
+
+	if (SessionsManager::isReadOnly())
+	{
+		return;
+	}
+
+	for (int i = 0; i < identifiers.count(); ++i)
+	{
+		appendRecord(RemoveRecord, identifiers.at(i));
+	}
+}
+
+void FullTextIndex::clear()
+{
+	QMutexLocker filesLocker(&m_filesMutex);
+
+	m_documentsMutex.lock();
+
+	++m_revision;
+
+	m_pendingDocuments.clear();
+	m_documents.clear();
+	m_urls.clear();
+
+	m_pendingLength = 0;
+	m_removedDocuments = 0;
+
+	m_documentsMutex.unlock();
+
+	if (!SessionsManager::isReadOnly())
+	{
+		QDir(m_path).removeRecursively();
+	}
+}
+
+QString FullTextIndex::getBucketPath(int bucket) const
+{
+	return QDir(m_path).filePath(QStringLiteral("bucket-%1.txt").arg(bucket, 3, 10, QLatin1Char('0')));
+}
+
+QHash<QString, QVector<quint32> > FullTextIndex::readBucket(int bucket) const
+{
+	QHash<QString, QVector<quint32> > terms;
+	QFile file(getBucketPath(bucket));
+
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		return terms;
+	}
+
+	QTextStream stream(&file);
+	stream.setCodec("UTF-8");
+
+	while (!stream.atEnd())
+	{
+		const QString line(stream.readLine());
+		const int position(line.indexOf(QLatin1Char('\t')));
+
+		if (position < 0)
+		{
+			continue;
+		}
+
+		QVector<quint32> &identifiers(terms[line.left(position)]);
+		const QVector<QStringRef> values(line.midRef(position + 1).split(QLatin1Char(' '), QString::SkipEmptyParts));
+
+		for (int i = 0; i < values.count(); ++i)
+		{
+			identifiers.append(values.at(i).toUInt());
+		}
+	}
+
+	file.close();
+
+	return terms;
+}
+
+QList<FullTextIndex::DocumentMatch> FullTextIndex::findDocuments(const QString &query, int limit)
+{
+	QList<DocumentMatch> matches;
+	const QStringList words(createTerms(query));
+
+	if (words.isEmpty())
+	{
+		return matches;
+	}
+
+	QSet<quint32> identifiers;
+
+	m_filesMutex.lock();
+
+	for (int i = 0; i < words.count(); ++i)
+	{
+		QFile file(getBucketPath(getBucket(words.at(i))));
+		QSet<quint32> wordIdentifiers;
+
+		if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+		{
+			QTextStream stream(&file);
+			stream.setCodec("UTF-8");
+
+			while (!stream.atEnd())
+			{
+				const QString line(stream.readLine());
+
+				if (!line.startsWith(words.at(i)))
+				{
+					continue;
+				}
+
+				const int position(line.indexOf(QLatin1Char('\t')));
+
+				if (position < words.at(i).length())
+				{
+					continue;
+				}
+
+				const QVector<QStringRef> values(line.midRef(position + 1).split(QLatin1Char(' '), QString::SkipEmptyParts));
+
+				for (int j = 0; j < values.count(); ++j)
+				{
+					wordIdentifiers.insert(values.at(j).toUInt());
+				}
+			}
+
+			file.close();
+		}
+
+		if (i == 0)
+		{
+			identifiers = wordIdentifiers;
+		}
+		else
+		{
+			identifiers.intersect(wordIdentifiers);
+		}
+
+		if (identifiers.isEmpty())
+		{
+			break;
+		}
+	}
+
+	m_filesMutex.unlock();
+
+	QMultiMap<QDateTime, DocumentMatch> sortedMatches;
+	QSet<quint32>::const_iterator iterator;
+
+	m_documentsMutex.lock();
+
+	for (iterator = identifiers.constBegin(); iterator != identifiers.constEnd(); ++iterator)
+	{
+		if (m_documents.contains(*iterator))
+		{
+			const DocumentRecord &record(m_documents[*iterator]);
+			DocumentMatch match;
+			match.url = record.url;
+			match.title = record.title;
+			match.time = record.time;
+
+			sortedMatches.insert(record.time, match);
+		}
+	}
+
+	m_documentsMutex.unlock();
+
+	QMultiMap<QDateTime, DocumentMatch>::const_iterator matchesIterator(sortedMatches.constEnd());
+
+	while (matchesIterator != sortedMatches.constBegin() && (limit <= 0 || matches.count() < limit))
+	{
+		--matchesIterator;
+
+		matches.append(matchesIterator.value());
+	}
+
+	return matches;
+}
+
+QStringList FullTextIndex::createTerms(const QString &text)
+{
+	QStringList terms;
+	QSet<QString> uniqueTerms;
+	const QString lowerCaseText(text.toLower());
+	int start(-1);
+
+	for (int i = 0; i <= lowerCaseText.length(); ++i)
+	{
+		const bool isWordCharacter(i < lowerCaseText.length() && lowerCaseText.at(i).isLetterOrNumber());
+
+		if (isWordCharacter && start < 0)
+		{
+			start = i;
+		}
+		else if (!isWordCharacter && start >= 0)
+		{
+			const int length(i - start);
+
+			if (length >= 2 && length <= 32)
+			{
+				const QString term(lowerCaseText.mid(start, length));
+
+				if (!uniqueTerms.contains(term))
+				{
+					uniqueTerms.insert(term);
+					terms.append(term);
+				}
+			}
+
+			start = -1;
+		}
+	}
+
+	return terms;
+}
+
+bool FullTextIndex::isCurrent(int revision)
+{
+	QMutexLocker locker(&m_documentsMutex);
+
+	return (revision == m_revision);
+}
+
+///NOTE Bucket is chosen with FNV-1a hash of first two characters, unlike qHash() it does not depend on Qt version or processor, so index stays valid when profile is moved
+int FullTextIndex::getBucket(const QString &term)
+{
+	const int length(qMin(term.length(), 2));
+	quint64 hash(Q_UINT64_C(14695981039346656037));
+
+	for (int i = 0; i < length; ++i)
+	{
+		hash ^= term.at(i).unicode();
+		hash *= Q_UINT64_C(1099511628211);
+	}
+
+	return static_cast<int>(hash % m_bucketsAmount);
+}
+
+}
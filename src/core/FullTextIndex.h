@@ -0,0 +1,108 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#ifndef OTTER_FULLTEXTINDEX_H
+#define OTTER_FULLTEXTINDEX_H
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFuture>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QUrl>
+
+namespace Otter
+{
+
+class FullTextIndex : public QObject
+{
+	Q_OBJECT
+
+public:
+	struct DocumentMatch
+	{
+		QUrl url;
+		QString title;
+		QDateTime time;
+	};
+
+	explicit FullTextIndex(const QString &path, QObject *parent = NULL);
+	~FullTextIndex();
+
+	void addDocument(const QUrl &url, const QString &title, const QString &text, const QDateTime &time = QDateTime::currentDateTime());
+	void removeDocuments(const QDateTime &from, const QDateTime &to);
+	void clear();
+	QList<DocumentMatch> findDocuments(const QString &query, int limit = 0);
+
+protected:
+	enum RecordType
+	{
+		AddRecord = 1,
+		RemoveRecord = 2
+	};
+
+	struct Document
+	{
+		QUrl url;
+		QString title;
+		QString text;
+		QDateTime time;
+	};
+
+	struct DocumentRecord
+	{
+		QUrl url;
+		QString title;
+		QDateTime time;
+	};
+
+	void load();
+	void processDocuments();
+	void compact(int revision);
+	void appendRecord(RecordType type, quint32 identifier, const DocumentRecord &record = DocumentRecord());
+	QString getBucketPath(int bucket) const;
+	QHash<QString, QVector<quint32> > readBucket(int bucket) const;
+	bool isCurrent(int revision);
+	static QStringList createTerms(const QString &text);
+	static int getBucket(const QString &term);
+
+private:
+	QString m_path;
+	QMutex m_filesMutex;
+	QMutex m_documentsMutex;
+	QFuture<void> m_processingFuture;
+	QQueue<Document> m_pendingDocuments;
+	QHash<quint32, DocumentRecord> m_documents;
+	QHash<QUrl, quint32> m_urls;
+	quint32 m_identifier;
+	int m_revision;
+	int m_pendingLength;
+	int m_removedDocuments;
+	bool m_isProcessing;
+
+	static const quint32 m_version;
+	static const int m_streamVersion;
+	static const int m_bucketsAmount;
+	static const int m_maximumTextLength;
+	static const int m_maximumPendingLength;
+};
+
+}
+
+#endif
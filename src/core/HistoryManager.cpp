@@ -18,22 +18,29 @@
 **************************************************************************/
 
 #include "HistoryManager.h"
+#include "FaviconsDatabase.h"
 #include "SessionsManager.h"
 #include "SettingsManager.h"
 #include "ThemesManager.h"
+#include "Utils.h"
 
 #include <QtCore/QBuffer>
 #include <QtCore/QFile>
 #include <QtCore/QTextStream>
 #include <QtCore/QTimerEvent>
 
+#include <algorithm>
+
 namespace Otter
 {
 
 HistoryManager* HistoryManager::m_instance = NULL;
 HistoryModel* HistoryManager::m_browsingHistoryModel = NULL;
 HistoryModel* HistoryManager::m_typedHistoryModel = NULL;
+FaviconsDatabase* HistoryManager::m_faviconsDatabase = NULL;
+FullTextIndex* HistoryManager::m_fullTextIndex = NULL;
 bool HistoryManager::m_isEnabled = false;
+bool HistoryManager::m_isIndexingPages = true;
 bool HistoryManager::m_isStoringFavicons = true;
 
 HistoryManager::HistoryManager(QObject *parent) : QObject(parent),
@@ -41,6 +48,7 @@ HistoryManager::HistoryManager(QObject *parent) : QObject(parent),
 {
 	m_dayTimer = startTimer(QTime::currentTime().msecsTo(QTime(23, 59, 59, 999)));
 
+	optionChanged(QLatin1String("History/IndexPageContents"));
 	optionChanged(QLatin1String("History/RememberBrowsing"));
 	optionChanged(QLatin1String("History/StoreFavicons"));
 
@@ -65,12 +73,17 @@ void HistoryManager::timerEvent(QTimerEvent *event)
 
 		if (m_browsingHistoryModel)
 		{
-			m_browsingHistoryModel->save(SessionsManager::getWritableDataPath(QLatin1String("browsingHistory.json")));
+			m_browsingHistoryModel->save();
 		}
 
 		if (m_typedHistoryModel)
 		{
-			m_typedHistoryModel->save(SessionsManager::getWritableDataPath(QLatin1String("typedHistory.json")));
+			m_typedHistoryModel->save();
+		}
+
+		if (m_faviconsDatabase)
+		{
+			m_faviconsDatabase->save();
 		}
 	}
 	else if (event->timerId() == m_dayTimer)
@@ -92,6 +105,11 @@ void HistoryManager::timerEvent(QTimerEvent *event)
 		m_browsingHistoryModel->clearOldestEntries(period);
 		m_typedHistoryModel->clearOldestEntries(period);
 
+		if (period >= 0 && m_fullTextIndex)
+		{
+			m_fullTextIndex->removeDocuments(QDateTime(), QDateTime::currentDateTime().addDays(-period));
+		}
+
 		scheduleSave();
 
 		emit dayChanged();
@@ -106,6 +124,10 @@ void HistoryManager::optionChanged(const QString &option)
 	{
 		m_isEnabled =  (SettingsManager::getValue(QLatin1String("History/RememberBrowsing")).toBool() && !SettingsManager::getValue(QLatin1String("Browser/PrivateMode")).toBool());
 	}
+	else if (option == QLatin1String("History/IndexPageContents"))
+	{
+		m_isIndexingPages = SettingsManager::getValue(option).toBool();
+	}
 	else if (option == QLatin1String("History/StoreFavicons"))
 	{
 		m_isStoringFavicons = SettingsManager::getValue(option).toBool();
@@ -146,6 +168,11 @@ void HistoryManager::optionChanged(const QString &option)
 		m_browsingHistoryModel->clearOldestEntries(period);
 		m_typedHistoryModel->clearOldestEntries(period);
 
+		if (period >= 0 && getFullTextIndex())
+		{
+			m_fullTextIndex->removeDocuments(QDateTime(), QDateTime::currentDateTime().addDays(-period));
+		}
+
 		scheduleSave();
 	}
 }
@@ -173,6 +200,23 @@ void HistoryManager::clearHistory(uint period)
 	m_browsingHistoryModel->clearRecentEntries(period);
 	m_typedHistoryModel->clearRecentEntries(period);
 
+	if (period == 0 && getFaviconsDatabase())
+	{
+		m_faviconsDatabase->clear();
+	}
+
+	if (getFullTextIndex())
+	{
+		if (period == 0)
+		{
+			m_fullTextIndex->clear();
+		}
+		else
+		{
+			m_fullTextIndex->removeDocuments(QDateTime::currentDateTime().addSecs(-(static_cast<qint64>(period) * 3600)), QDateTime());
+		}
+	}
+
 	m_instance->scheduleSave();
 }
 
@@ -205,10 +249,7 @@ void HistoryManager::removeEntries(const QList<quint64> &identifiers)
 		getBrowsingHistoryModel();
 	}
 
-	for (int i = 0; i < identifiers.count(); ++i)
-	{
-		m_browsingHistoryModel->removeEntry(identifiers.at(i));
-	}
+	m_browsingHistoryModel->removeEntries(identifiers);
 
 	m_instance->scheduleSave();
 }
@@ -232,18 +273,26 @@ void HistoryManager::updateEntry(quint64 identifier, const QUrl &url, const QStr
 		getBrowsingHistoryModel();
 	}
 
-	HistoryEntryItem *item(m_browsingHistoryModel->getEntry(identifier));
+	m_browsingHistoryModel->updateEntry(identifier, url, title, icon);
 
-	if (item)
+	if (m_isStoringFavicons && !icon.isNull() && getFaviconsDatabase())
 	{
-		item->setData(url, HistoryModel::UrlRole);
-		item->setData(title, HistoryModel::TitleRole);
-		item->setIcon(icon);
+		m_faviconsDatabase->setIcon(url, icon);
 	}
 
 	m_instance->scheduleSave();
 }
 
+void HistoryManager::indexPage(const QUrl &url, const QString &title, const QString &text)
+{
+	if (!m_isEnabled || !m_isIndexingPages || !url.isValid() || url.scheme() == QLatin1String("about") || !SettingsManager::getValue(QLatin1String("History/RememberBrowsing"), url).toBool() || !getFullTextIndex())
+	{
+		return;
+	}
+
+	m_fullTextIndex->addDocument(url, title, text);
+}
+
 HistoryManager* HistoryManager::getInstance()
 {
 	return m_instance;
@@ -253,7 +302,7 @@ HistoryModel* HistoryManager::getBrowsingHistoryModel()
 {
 	if (!m_browsingHistoryModel)
 	{
-		m_browsingHistoryModel = new HistoryModel(SessionsManager::getWritableDataPath(QLatin1String("browsingHistory.json")), m_instance);
+		m_browsingHistoryModel = new HistoryModel(SessionsManager::getWritableDataPath(QLatin1String("browsingHistory.journal")), m_instance);
 	}
 
 	return m_browsingHistoryModel;
@@ -263,7 +312,7 @@ HistoryModel* HistoryManager::getTypedHistoryModel()
 {
 	if (!m_typedHistoryModel && m_instance)
 	{
-		m_typedHistoryModel = new HistoryModel(SessionsManager::getWritableDataPath(QLatin1String("typedHistory.json")), m_instance);
+		m_typedHistoryModel = new HistoryModel(SessionsManager::getWritableDataPath(QLatin1String("typedHistory.journal")), m_instance);
 	}
 
 	return m_typedHistoryModel;
@@ -311,22 +360,67 @@ QIcon HistoryManager::getIcon(const QUrl &url)
 		return ThemesManager::getIcon(QLatin1String("text-html"));
 	}
 
-///TODO
+	if (getFaviconsDatabase())
+	{
+		const QIcon icon(m_faviconsDatabase->getIcon(url));
+
+		if (!icon.isNull())
+		{
+			return icon;
+		}
+	}
 
 	return ThemesManager::getIcon(QLatin1String("text-html"));
 }
 
-HistoryEntryItem* HistoryManager::getEntry(quint64 identifier)
+FaviconsDatabase* HistoryManager::getFaviconsDatabase()
+{
+	if (!m_faviconsDatabase && m_instance)
+	{
+		m_faviconsDatabase = new FaviconsDatabase(SessionsManager::getWritableDataPath(QLatin1String("favicons.dat")), m_instance);
+	}
+
+	return m_faviconsDatabase;
+}
+
+FullTextIndex* HistoryManager::getFullTextIndex()
+{
+	if (!m_fullTextIndex && m_instance)
+	{
+		m_fullTextIndex = new FullTextIndex(SessionsManager::getWritableDataPath(QLatin1String("fullTextIndex")), m_instance);
+	}
+
+	return m_fullTextIndex;
+}
+
+HistoryModel::HistoryEntry HistoryManager::getEntry(quint64 identifier)
 {
 	if (!m_browsingHistoryModel)
 	{
 		getBrowsingHistoryModel();
 	}
 
-	return m_browsingHistoryModel->getEntry(identifier);
+	HistoryModel::HistoryEntry entry(m_browsingHistoryModel->getEntry(identifier));
+
+	if (entry.icon.isNull() && entry.identifier > 0)
+	{
+		entry.icon = getIcon(entry.url);
+	}
+
+	return entry;
+}
+
+bool HistoryManager::compareMatches(const HistoryModel::HistoryEntryMatch &first, const HistoryModel::HistoryEntryMatch &second)
+{
+	if (first.score != second.score)
+	{
+		return (first.score > second.score);
+	}
+
+	return (first.entry.time > second.entry.time);
 }
 
-QList<HistoryModel::HistoryEntryMatch> HistoryManager::findEntries(const QString &prefix)
+QList<HistoryModel::HistoryEntryMatch> HistoryManager::findEntries(const QString &prefix, int limit)
 {
 	if (!m_typedHistoryModel)
 	{
@@ -338,11 +432,82 @@ QList<HistoryModel::HistoryEntryMatch> HistoryManager::findEntries(const QString
 		getBrowsingHistoryModel();
 	}
 
-	QList<HistoryModel::HistoryEntryMatch> entries;
-	entries.append(m_typedHistoryModel->findEntries(prefix, true));
-	entries.append(m_browsingHistoryModel->findEntries(prefix));
+	const QList<HistoryModel::HistoryEntryMatch> typedMatches(m_typedHistoryModel->findEntries(prefix, true, limit));
+	const QList<HistoryModel::HistoryEntryMatch> browsingMatches(m_browsingHistoryModel->findEntries(prefix, false, limit));
+	QVector<HistoryModel::HistoryEntryMatch> matches;
+	QHash<QUrl, int> urls;
+
+	matches.reserve(typedMatches.count() + browsingMatches.count());
+
+///NOTE Typed in addresses are present in both models, visits which were typed in are weighted more
+	for (int i = 0; i < typedMatches.count(); ++i)
+	{
+		HistoryModel::HistoryEntryMatch match(typedMatches.at(i));
+		match.score = ((match.score * 2) + m_browsingHistoryModel->getStatistics(match.entry.url).score);
+
+		urls[Utils::normalizeUrl(match.entry.url)] = matches.count();
+
+		matches.append(match);
+	}
+
+	for (int i = 0; i < browsingMatches.count(); ++i)
+	{
+		const QUrl url(Utils::normalizeUrl(browsingMatches.at(i).entry.url));
+
+		if (urls.contains(url))
+		{
+			HistoryModel::HistoryEntryMatch &match(matches[urls[url]]);
+
+			if (match.match.isEmpty())
+			{
+				match.match = browsingMatches.at(i).match;
+			}
+
+			continue;
+		}
+
+		const HistoryModel::UrlStatistics statistics(m_typedHistoryModel->getStatistics(url));
+		HistoryModel::HistoryEntryMatch match(browsingMatches.at(i));
+
+		if (statistics.visitsAmount > 0)
+		{
+			match.score += (statistics.score * 2);
+			match.isTypedIn = true;
+		}
+
+		matches.append(match);
+	}
+
+	if (limit > 0 && limit < matches.count())
+	{
+		std::partial_sort(matches.begin(), (matches.begin() + limit), matches.end(), compareMatches);
+
+		matches.resize(limit);
+	}
+	else
+	{
+		std::sort(matches.begin(), matches.end(), compareMatches);
+	}
+
+	for (int i = 0; i < matches.count(); ++i)
+	{
+		if (matches.at(i).entry.icon.isNull())
+		{
+			matches[i].entry.icon = getIcon(matches.at(i).entry.url);
+		}
+	}
+
+	return matches.toList();
+}
 
-	return entries;
+QList<FullTextIndex::DocumentMatch> HistoryManager::findPages(const QString &query, int limit)
+{
+	if (!getFullTextIndex())
+	{
+		return QList<FullTextIndex::DocumentMatch>();
+	}
+
+	return m_fullTextIndex->findDocuments(query, limit);
 }
 
 quint64 HistoryManager::addEntry(const QUrl &url, const QString &title, const QIcon &icon, bool isTypedIn)
@@ -357,7 +522,7 @@ quint64 HistoryManager::addEntry(const QUrl &url, const QString &title, const QI
 		getBrowsingHistoryModel();
 	}
 
-	const quint64 identifier(m_browsingHistoryModel->addEntry(url, title, icon, QDateTime::currentDateTime())->data(HistoryModel::IdentifierRole).toULongLong());
+	const quint64 identifier(m_browsingHistoryModel->addEntry(url, title, icon, QDateTime::currentDateTime()));
 
 	if (isTypedIn)
 	{
@@ -369,14 +534,11 @@ quint64 HistoryManager::addEntry(const QUrl &url, const QString &title, const QI
 		m_typedHistoryModel->addEntry(url, title, icon, QDateTime::currentDateTime());
 	}
 
-	const int limit(SettingsManager::getValue(QLatin1String("History/BrowsingLimitAmountGlobal")).toInt());
+	m_browsingHistoryModel->clearExcessEntries(SettingsManager::getValue(QLatin1String("History/BrowsingLimitAmountGlobal")).toInt());
 
-	if (limit > 0 && m_browsingHistoryModel->rowCount() > limit)
+	if (m_isStoringFavicons && !icon.isNull() && getFaviconsDatabase())
 	{
-		for (int i = (m_browsingHistoryModel->rowCount() - 1); i >= limit; --i)
-		{
-			m_browsingHistoryModel->removeEntry(m_browsingHistoryModel->index(i, 0).data(HistoryModel::IdentifierRole).toULongLong());
-		}
+		m_faviconsDatabase->setIcon(url, icon);
 	}
 
 	m_instance->scheduleSave();
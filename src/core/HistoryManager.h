@@ -20,6 +20,7 @@
 #ifndef OTTER_HISTORYMANAGER_H
 #define OTTER_HISTORYMANAGER_H
 
+#include "FullTextIndex.h"
 #include "HistoryModel.h"
 
 #include <QtCore/QDateTime>
@@ -29,6 +30,8 @@
 namespace Otter
 {
 
+class FaviconsDatabase;
+
 class HistoryManager : public QObject
 {
 	Q_OBJECT
@@ -39,12 +42,15 @@ public:
 	static void removeEntry(quint64 identifier);
 	static void removeEntries(const QList<quint64> &identifiers);
 	static void updateEntry(quint64 identifier, const QUrl &url, const QString &title, const QIcon &icon);
+	static void indexPage(const QUrl &url, const QString &title, const QString &text);
 	static HistoryManager* getInstance();
 	static HistoryModel* getBrowsingHistoryModel();
 	static HistoryModel* getTypedHistoryModel();
+	static FullTextIndex* getFullTextIndex();
 	static QIcon getIcon(const QUrl &url);
-	static HistoryEntryItem* getEntry(quint64 identifier);
-	static QList<HistoryModel::HistoryEntryMatch> findEntries(const QString &prefix);
+	static HistoryModel::HistoryEntry getEntry(quint64 identifier);
+	static QList<HistoryModel::HistoryEntryMatch> findEntries(const QString &prefix, int limit = 0);
+	static QList<FullTextIndex::DocumentMatch> findPages(const QString &query, int limit = 0);
 	static quint64 addEntry(const QUrl &url, const QString &title, const QIcon &icon, bool isTypedIn = false);
 	static bool hasEntry(const QUrl &url);
 
@@ -53,6 +59,8 @@ protected:
 
 	void timerEvent(QTimerEvent *event);
 	void scheduleSave();
+	static FaviconsDatabase* getFaviconsDatabase();
+	static bool compareMatches(const HistoryModel::HistoryEntryMatch &first, const HistoryModel::HistoryEntryMatch &second);
 
 protected slots:
 	void optionChanged(const QString &option);
@@ -64,7 +72,10 @@ private:
 	static HistoryManager *m_instance;
 	static HistoryModel *m_browsingHistoryModel;
 	static HistoryModel *m_typedHistoryModel;
+	static FaviconsDatabase *m_faviconsDatabase;
+	static FullTextIndex *m_fullTextIndex;
 	static bool m_isEnabled;
+	static bool m_isIndexingPages;
 	static bool m_isStoringFavicons;
 
 signals:
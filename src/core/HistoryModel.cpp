@@ -19,47 +19,105 @@
 
 #include "HistoryModel.h"
 #include "Console.h"
+#include "HistoryManager.h"
 #include "SessionsManager.h"
 #include "Utils.h"
 
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QDir>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QJsonArray>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QSaveFile>
 
+#include <cmath>
+
 namespace Otter
 {
 
-HistoryEntryItem::HistoryEntryItem() : QStandardItem()
+const int HistoryModel::m_pageSize(500);
+
+HistoryModel::HistoryModel(const QString &path, QObject *parent) : QAbstractListModel(parent),
+	m_path(path),
+	m_scanRevision(0),
+	m_unloadedLength(0),
+	m_identifier(0),
+	m_journalRecords(0),
+	m_needsCompaction(false),
+	m_isCompacting(false),
+	m_isJournalScanned(false)
 {
-}
+	const QFileInfo information(path);
 
-void HistoryEntryItem::setData(const QVariant &value, int role)
-{
-	if (model() && qobject_cast<HistoryModel*>(model()))
+///NOTE Only most recent entries are read from the end of journal, older ones are paged in when requested
+	if (information.exists())
 	{
-		model()->setData(index(), value, role);
+		m_unloadedLength = information.size();
+		m_entries = readEntries(m_pageSize);
 	}
 	else
 	{
-		QStandardItem::setData(value, role);
+		importEntries(information.dir().filePath(information.completeBaseName() + QLatin1String(".json")));
+	}
+
+	connect(this, SIGNAL(cleared()), this, SLOT(handleCleared()));
+	connect(this, SIGNAL(entryAdded(quint64)), this, SLOT(handleEntryAdded(quint64)));
+	connect(this, SIGNAL(entryModified(quint64)), this, SLOT(handleEntryModified(quint64)));
+	connect(this, SIGNAL(entryRemoved(quint64)), this, SLOT(handleEntryRemoved(quint64)));
+
+	if (m_needsCompaction)
+	{
+		save();
+	}
+
+	if (canFetchMore(QModelIndex()))
+	{
+		scanJournal();
 	}
 }
 
-void HistoryEntryItem::setItemData(const QVariant &value, int role)
+HistoryModel::~HistoryModel()
 {
-	QStandardItem::setData(value, role);
+	m_scanRevision.ref();
+	m_scanFuture.waitForFinished();
+
+	if (m_isCompacting)
+	{
+		m_compactionFuture.waitForFinished();
+
+		m_isCompacting = false;
+
+		if (!m_compactionFuture.result())
+		{
+			m_needsCompaction = true;
+		}
+	}
+
+	if (!SessionsManager::isReadOnly())
+	{
+		if (m_needsCompaction)
+		{
+			compactJournal();
+
+			m_compactionFuture.waitForFinished();
+		}
+		else
+		{
+			writePendingRecords();
+		}
+	}
+
+	qDeleteAll(m_entries);
 }
 
-HistoryModel::HistoryModel(const QString &path, QObject *parent) : QStandardItemModel(parent)
+void HistoryModel::importEntries(const QString &path)
 {
 	QFile file(path);
 
 	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
 	{
-		Console::addMessage(tr("Failed to open history file: %1").arg(file.errorString()), OtherMessageCategory, ErrorMessageLevel, path);
-
 		return;
 	}
 
@@ -74,270 +132,1201 @@ HistoryModel::HistoryModel(const QString &path, QObject *parent) : QStandardItem
 		addEntry(QUrl(object.value(QLatin1String("url")).toString()), object.value(QLatin1String("title")).toString(), QIcon(), QDateTime::fromString(object.value(QLatin1String("time")).toString(), QLatin1String("yyyy-MM-dd hh:mm:ss")));
 	}
 
-	setSortRole(TimeVisitedRole);
-	sort(0, Qt::DescendingOrder);
+	m_needsCompaction = !array.isEmpty();
 }
 
-void HistoryModel::clearExcessEntries(int limit)
+void HistoryModel::registerEntry(HistoryEntry *entry)
 {
-	if (limit > 0 && rowCount() > limit)
+	m_identifiers[entry->identifier] = entry;
+
+	const QUrl url(Utils::normalizeUrl(entry->url));
+
+	if (!url.isEmpty())
 	{
-		for (int i = (rowCount() - 1); i >= limit; --i)
+		QList<HistoryEntry*> &entries(m_urls[url]);
+
+///NOTE Each address is indexed once, with its first entry
+		if (entries.isEmpty())
 		{
-			removeEntry(index(i, 0).data(HistoryModel::IdentifierRole).toULongLong());
+			m_index.addUrl(entry->identifier, url, entry->title);
 		}
-	}
-}
 
-void HistoryModel::clearRecentEntries(uint period)
-{
-	if (period == 0)
-	{
-		clear();
+		entries.append(entry);
 
-		emit cleared();
+		UrlStatistics &statistics(m_statistics[url]);
+		statistics.score += calculateScore(entry->time);
 
-		return;
-	}
+		++statistics.visitsAmount;
 
-	for (int i = (rowCount() - 1); i >= 0; --i)
-	{
-		if (index(i, 0).data(TimeVisitedRole).toDateTime().secsTo(QDateTime::currentDateTime()) < (period * 3600))
+		if (!statistics.lastVisit.isValid() || entry->time > statistics.lastVisit)
 		{
-			removeEntry(index(i, 0).data(IdentifierRole).toULongLong());
+			statistics.lastVisit = entry->time;
 		}
 	}
 }
 
-void HistoryModel::clearOldestEntries(int period)
+void HistoryModel::unregisterEntry(HistoryEntry *entry)
 {
-	if (period < 0)
+	unregisterEntries(QList<HistoryEntry*>({entry}));
+}
+
+void HistoryModel::unregisterEntries(const QList<HistoryEntry*> &entries)
+{
+	QHash<QUrl, QSet<HistoryEntry*> > removedEntries;
+
+	for (int i = 0; i < entries.count(); ++i)
 	{
-		return;
+		m_identifiers.remove(entries.at(i)->identifier);
+
+		removedEntries[Utils::normalizeUrl(entries.at(i)->url)].insert(entries.at(i));
 	}
 
-	const QDateTime currentDateTime(QDateTime::currentDateTime());
+	QHash<QUrl, QSet<HistoryEntry*> >::const_iterator iterator;
 
-	for (int i = (rowCount() - 1); i >= 0; --i)
+	for (iterator = removedEntries.constBegin(); iterator != removedEntries.constEnd(); ++iterator)
 	{
-		if (index(i, 0).data(TimeVisitedRole).toDateTime().daysTo(currentDateTime) > period)
+		const QUrl url(iterator.key());
+
+		if (!m_urls.contains(url))
 		{
-			removeEntry(index(i, 0).data(IdentifierRole).toULongLong());
+			continue;
 		}
-	}
-}
 
-void HistoryModel::removeEntry(quint64 identifier)
-{
-	HistoryEntryItem *entry(getEntry(identifier));
+		QList<HistoryEntry*> &urlEntries(m_urls[url]);
+		QList<HistoryEntry*> remainingEntries;
+		UrlStatistics &statistics(m_statistics[url]);
+		HistoryEntry *indexedEntry(urlEntries.isEmpty() ? NULL : urlEntries.first());
+		bool needsLastVisit(false);
 
-	if (!entry)
-	{
-		return;
-	}
+		for (int i = 0; i < urlEntries.count(); ++i)
+		{
+			HistoryEntry *entry(urlEntries.at(i));
 
-	const QUrl url(Utils::normalizeUrl(entry->data(UrlRole).toUrl()));
+			if (!iterator.value().contains(entry))
+			{
+				remainingEntries.append(entry);
 
-	if (m_urls.contains(url))
-	{
-		m_urls[url].removeAll(entry);
+				continue;
+			}
 
-		if (m_urls[url].isEmpty())
+			statistics.score -= calculateScore(entry->time);
+
+			--statistics.visitsAmount;
+
+			if (entry->time == statistics.lastVisit)
+			{
+				needsLastVisit = true;
+			}
+		}
+
+		urlEntries = remainingEntries;
+
+		if (indexedEntry && iterator.value().contains(indexedEntry))
+		{
+			m_index.removeUrl(indexedEntry->identifier);
+
+			if (!urlEntries.isEmpty())
+			{
+				m_index.addUrl(urlEntries.first()->identifier, url, urlEntries.first()->title);
+			}
+		}
+
+		if (urlEntries.isEmpty())
 		{
 			m_urls.remove(url);
+			m_statistics.remove(url);
+
+			continue;
+		}
+
+		statistics.score = qMax(0.0, statistics.score);
+
+		if (needsLastVisit)
+		{
+			statistics.lastVisit = QDateTime();
+
+			for (int i = 0; i < urlEntries.count(); ++i)
+			{
+				if (!statistics.lastVisit.isValid() || urlEntries.at(i)->time > statistics.lastVisit)
+				{
+					statistics.lastVisit = urlEntries.at(i)->time;
+				}
+			}
 		}
 	}
+}
 
-	if (identifier > 0 && m_identifiers.contains(identifier))
+void HistoryModel::discardUnloadedEntries()
+{
+///NOTE Journal only needs to be rewritten when it still contains entries which were not loaded
+	if (canFetchMore(QModelIndex()))
 	{
-		m_identifiers.remove(identifier);
+		m_needsCompaction = true;
 	}
 
-	emit entryRemoved(entry);
+	m_unloadedLength = 0;
 
-	removeRow(entry->row());
+	m_unloadedRemainder.clear();
+	m_unloadedUpdates.clear();
+	m_unloadedRemovals.clear();
 
-	emit modelModified();
+	m_scanRevision.ref();
+
+	m_isJournalScanned = false;
+
+	if (m_unloadedEntries.isEmpty())
+	{
+		return;
+	}
+
+	m_unloadedIndex.clear();
+	m_unloadedEntries.clear();
+	m_unloadedOrder.clear();
+	m_unloadedStatistics.clear();
+	m_unloadedIdentifiers.clear();
+
+	emit unloadedEntriesChanged();
 }
 
-HistoryEntryItem* HistoryModel::addEntry(const QUrl &url, const QString &title, const QIcon &icon, const QDateTime &date, quint64 identifier)
+void HistoryModel::unregisterUnloadedEntry(const HistoryEntry *entry)
 {
-	blockSignals(true);
+	if (!m_unloadedIdentifiers.remove(entry->identifier))
+	{
+		return;
+	}
+
+	QHash<QUrl, UrlStatistics>::iterator iterator(m_unloadedStatistics.find(Utils::normalizeUrl(entry->url)));
 
-	HistoryEntryItem *entry(new HistoryEntryItem());
-	entry->setIcon(icon);
+	if (iterator == m_unloadedStatistics.end())
+	{
+		return;
+	}
 
-	insertRow(0, entry);
-	setData(entry->index(), url, UrlRole);
-	setData(entry->index(), title, TitleRole);
-	setData(entry->index(), date, TimeVisitedRole);
+	iterator.value().score = qMax(0.0, (iterator.value().score - calculateScore(entry->time)));
 
-	if (identifier == 0 || m_identifiers.contains(identifier))
+	--iterator.value().visitsAmount;
+
+	if (iterator.value().visitsAmount <= 0)
 	{
-		identifier = (m_identifiers.isEmpty() ? 1 : (m_identifiers.keys().last() + 1));
+		m_unloadedStatistics.erase(iterator);
 	}
+}
 
-	setData(entry->index(), identifier, IdentifierRole);
+///NOTE Entries which were not loaded yet are summarized in background, so looking them up does not require loading whole history
+void HistoryModel::scanJournal()
+{
+	m_scanFuture = QtConcurrent::run(this, &HistoryModel::createSummary, (m_unloadedLength + m_unloadedRemainder.size()), m_unloadedRemovals, m_unloadedUpdates, m_scanRevision.load());
+}
 
-	m_identifiers[identifier] = entry;
+void HistoryModel::appendEntries(const QList<HistoryEntry*> &entries)
+{
+	if (entries.isEmpty())
+	{
+		return;
+	}
 
-	blockSignals(false);
+	beginInsertRows(QModelIndex(), m_entries.count(), (m_entries.count() + entries.count() - 1));
 
-	emit entryAdded(entry);
+	m_entries.append(entries);
 
-	return entry;
+	endInsertRows();
 }
 
-HistoryEntryItem* HistoryModel::getEntry(quint64 identifier) const
+void HistoryModel::fetchMore(const QModelIndex &parent)
 {
-	if (m_identifiers.contains(identifier))
+	if (!parent.isValid())
 	{
-		return m_identifiers[identifier];
+		appendEntries(readEntries(m_pageSize));
 	}
+}
 
-	return NULL;
+void HistoryModel::loadAllEntries()
+{
+	appendEntries(readEntries(-1));
 }
 
-QList<HistoryModel::HistoryEntryMatch> HistoryModel::findEntries(const QString &prefix, bool markAsTypedIn) const
+void HistoryModel::clearExcessEntries(int limit)
 {
-	QList<HistoryEntryItem*> matchedEntries;
-	QList<HistoryModel::HistoryEntryMatch> allMatches;
-	QList<HistoryModel::HistoryEntryMatch> currentMatches;
-	QMultiMap<QDateTime, HistoryModel::HistoryEntryMatch> matchesMap;
-	QHash<QUrl, QList<HistoryEntryItem*> >::const_iterator urlsIterator;
+	if (limit <= 0)
+	{
+		return;
+	}
+
+///NOTE Amount of entries which were not loaded yet is known only once journal was scanned
+	if (canFetchMore(QModelIndex()) && !m_isJournalScanned)
+	{
+		return;
+	}
+
+	int excess(m_entries.count() + m_unloadedIdentifiers.count() - limit);
+
+	if (excess <= 0)
+	{
+		return;
+	}
+
+///NOTE Entries are stored in order of visits, so oldest ones are removed from journal without loading them
+	int processedAmount(0);
+	bool hasRemovedUrls(false);
 
-	for (urlsIterator = m_urls.constBegin(); urlsIterator != m_urls.constEnd(); ++urlsIterator)
+	while (processedAmount < m_unloadedOrder.count() && excess > 0)
 	{
-		if (urlsIterator.value().isEmpty() || matchedEntries.contains(urlsIterator.value().first()))
+		const UnloadedEntry unloadedEntry(m_unloadedOrder.at(processedAmount));
+
+		++processedAmount;
+
+		if (!m_unloadedIdentifiers.contains(unloadedEntry.identifier))
 		{
 			continue;
 		}
 
-		const QString result(Utils::matchUrl(urlsIterator.key(), prefix));
+		HistoryEntry removedEntry;
+		removedEntry.identifier = unloadedEntry.identifier;
+		removedEntry.time = unloadedEntry.time;
 
-		if (!result.isEmpty())
+		if (unloadedEntry.representative >= 0)
 		{
-			HistoryEntryMatch match;
-			match.entry = urlsIterator.value().first();
-			match.match = result;
-
-			if (markAsTypedIn)
-			{
-				match.isTypedIn = true;
-			}
+			removedEntry.url = m_unloadedEntries.at(unloadedEntry.representative).url;
+		}
 
-			matchesMap.insert(match.entry->data(TimeVisitedRole).toDateTime(), match);
+		unregisterUnloadedEntry(&removedEntry);
 
-			matchedEntries.append(match.entry);
+		if (!removedEntry.url.isEmpty() && !m_unloadedStatistics.contains(Utils::normalizeUrl(removedEntry.url)))
+		{
+			hasRemovedUrls = true;
 		}
+
+		m_unloadedRemovals.insert(removedEntry.identifier);
+
+		appendRecord(createRecord(QLatin1String("remove"), removedEntry));
+
+		--excess;
+	}
+
+	m_unloadedOrder.remove(0, processedAmount);
+
+	if (hasRemovedUrls)
+	{
+		emit unloadedEntriesChanged();
 	}
 
-	currentMatches = matchesMap.values();
+	if (excess <= 0)
+	{
+		return;
+	}
 
-	matchesMap.clear();
+	QList<quint64> identifiers;
+	identifiers.reserve(excess);
 
-	for (int i = (currentMatches.count() - 1); i >= 0; --i)
+	for (int i = qMax(0, (m_entries.count() - excess)); i < m_entries.count(); ++i)
 	{
-		allMatches.append(currentMatches.at(i));
+		identifiers.append(m_entries.at(i)->identifier);
 	}
 
-	return allMatches;
+	removeEntries(identifiers);
 }
 
-bool HistoryModel::save(const QString &path) const
+void HistoryModel::clearRecentEntries(uint period)
 {
-	if (SessionsManager::isReadOnly())
+	if (period == 0)
 	{
-		return false;
+		beginResetModel();
+
+		qDeleteAll(m_entries);
+
+		m_entries.clear();
+		m_urls.clear();
+		m_statistics.clear();
+		m_identifiers.clear();
+		m_index.clear();
+
+		discardUnloadedEntries();
+
+		endResetModel();
+
+		emit cleared();
+
+		return;
 	}
 
-	QSaveFile file(path);
+	const QDateTime currentDateTime(QDateTime::currentDateTime());
 
-	if (!file.open(QIODevice::WriteOnly))
+	while (canFetchMore(QModelIndex()) && (m_entries.isEmpty() || m_entries.last()->time.secsTo(currentDateTime) < (period * 3600)))
 	{
-		return false;
+		fetchMore(QModelIndex());
 	}
 
-	QJsonArray array;
+	QList<quint64> identifiers;
 
-	for (int i = 0; i < rowCount(); ++i)
+	for (int i = 0; i < m_entries.count(); ++i)
 	{
-		QStandardItem *entry(item(i));
-
-		if (entry)
+		if (m_entries.at(i)->time.secsTo(currentDateTime) < (period * 3600))
 		{
-			QJsonObject object;
-			object.insert(QLatin1String("url"), entry->data(UrlRole).toUrl().toString());
-			object.insert(QLatin1String("title"), entry->data(TitleRole).toString());
-			object.insert(QLatin1String("time"), entry->data(TimeVisitedRole).toDateTime().toString(QLatin1String("yyyy-MM-dd hh:mm:ss")));
-
-			array.prepend(object);
+			identifiers.append(m_entries.at(i)->identifier);
 		}
 	}
 
-	QJsonDocument document;
-	document.setArray(array);
+	removeEntries(identifiers);
+}
+
+void HistoryModel::clearOldestEntries(int period)
+{
+	if (period < 0)
+	{
+		return;
+	}
+
+	const QDateTime currentDateTime(QDateTime::currentDateTime());
+
+	while (canFetchMore(QModelIndex()) && (m_entries.isEmpty() || m_entries.last()->time.daysTo(currentDateTime) <= period))
+	{
+		fetchMore(QModelIndex());
+	}
+
+///NOTE Entries are stored in order of visits, so everything not loaded yet is older than last loaded one
+	if (canFetchMore(QModelIndex()))
+	{
+		discardUnloadedEntries();
+	}
+
+	QList<quint64> identifiers;
 
-	file.write(document.toJson(QJsonDocument::Indented));
+	for (int i = 0; i < m_entries.count(); ++i)
+	{
+		if (m_entries.at(i)->time.daysTo(currentDateTime) > period)
+		{
+			identifiers.append(m_entries.at(i)->identifier);
+		}
+	}
 
-	return file.commit();
+	removeEntries(identifiers);
 }
 
-bool HistoryModel::setData(const QModelIndex &index, const QVariant &value, int role)
+void HistoryModel::removeEntry(quint64 identifier)
 {
-	HistoryEntryItem *entry(dynamic_cast<HistoryEntryItem*>(itemFromIndex(index)));
+	HistoryEntry *entry(m_identifiers.value(identifier, NULL));
 
 	if (!entry)
 	{
-		return QStandardItemModel::setData(index, value, role);
+		return;
 	}
 
-	if (role == UrlRole && value.toUrl() != index.data(UrlRole).toUrl())
+	emit entryRemoved(identifier);
+
+	const int row(m_entries.indexOf(entry));
+
+	beginRemoveRows(QModelIndex(), row, row);
+
+	m_entries.removeAt(row);
+
+	unregisterEntry(entry);
+
+	endRemoveRows();
+
+	delete entry;
+
+	emit modelModified();
+}
+
+void HistoryModel::removeEntries(const QList<quint64> &identifiers)
+{
+	QSet<HistoryEntry*> removedEntries;
+	QList<quint64> removedIdentifiers;
+
+	for (int i = 0; i < identifiers.count(); ++i)
 	{
-		const QUrl oldUrl(Utils::normalizeUrl(index.data(UrlRole).toUrl()));
-		const QUrl newUrl(Utils::normalizeUrl(value.toUrl()));
+		HistoryEntry *entry(m_identifiers.value(identifiers.at(i), NULL));
 
-		if (!oldUrl.isEmpty() && m_urls.contains(oldUrl))
+		if (entry && !removedEntries.contains(entry))
 		{
-			m_urls[oldUrl].removeAll(entry);
+			removedEntries.insert(entry);
+			removedIdentifiers.append(entry->identifier);
+		}
+	}
 
-			if (m_urls[oldUrl].isEmpty())
-			{
-				m_urls.remove(oldUrl);
-			}
+	if (removedEntries.count() < 2)
+	{
+		if (!removedIdentifiers.isEmpty())
+		{
+			removeEntry(removedIdentifiers.first());
 		}
 
-		if (!newUrl.isEmpty())
+		return;
+	}
+
+	emit entriesRemoved(removedIdentifiers);
+
+	QList<HistoryEntry*> entries;
+	QList<HistoryEntry*> unregisteredEntries;
+	int firstRow(-1);
+	int lastRow(-1);
+	bool isContinuous(true);
+
+	entries.reserve(m_entries.count() - removedEntries.count());
+	unregisteredEntries.reserve(removedEntries.count());
+
+	for (int i = 0; i < m_entries.count(); ++i)
+	{
+		if (!removedEntries.contains(m_entries.at(i)))
 		{
-			if (!m_urls.contains(newUrl))
-			{
-				m_urls[newUrl] = QList<HistoryEntryItem*>();
-			}
+			entries.append(m_entries.at(i));
+
+			continue;
+		}
 
-			m_urls[newUrl].append(entry);
+		if (firstRow < 0)
+		{
+			firstRow = i;
+		}
+		else if (lastRow != (i - 1))
+		{
+			isContinuous = false;
 		}
+
+		lastRow = i;
+
+		unregisteredEntries.append(m_entries.at(i));
+	}
+
+	if (isContinuous)
+	{
+		beginRemoveRows(QModelIndex(), firstRow, lastRow);
+	}
+	else
+	{
+		beginResetModel();
 	}
 
-	entry->setItemData(value, role);
+	m_entries = entries;
 
-	switch (role)
+	unregisterEntries(unregisteredEntries);
+
+	if (isContinuous)
 	{
-		case TitleRole:
-		case UrlRole:
-		case IdentifierRole:
-		case TimeVisitedRole:
-			emit entryModified(entry);
-			emit modelModified();
+		endRemoveRows();
+	}
+	else
+	{
+		endResetModel();
+	}
 
-			break;
+	qDeleteAll(unregisteredEntries);
+
+	HistoryEntry removedEntry;
+
+	for (int i = 0; i < removedIdentifiers.count(); ++i)
+	{
+		removedEntry.identifier = removedIdentifiers.at(i);
+
+		appendRecord(createRecord(QLatin1String("remove"), removedEntry));
 	}
 
-	return true;
+	emit modelModified();
+}
+
+void HistoryModel::updateEntry(quint64 identifier, const QUrl &url, const QString &title, const QIcon &icon)
+{
+	HistoryEntry *entry(m_identifiers.value(identifier, NULL));
+
+	if (!entry)
+	{
+		return;
+	}
+
+	unregisterEntry(entry);
+
+	entry->url = url;
+	entry->title = title;
+	entry->icon = icon;
+
+	registerEntry(entry);
+
+	const QModelIndex index(this->index(m_entries.indexOf(entry), 0));
+
+	emit dataChanged(index, index);
+	emit entryModified(identifier);
+	emit modelModified();
 }
 
-bool HistoryModel::hasEntry(const QUrl &url) const
+quint64 HistoryModel::addEntry(const QUrl &url, const QString &title, const QIcon &icon, const QDateTime &date, quint64 identifier)
 {
-	return m_urls.contains(url);
+	if (identifier == 0 || m_identifiers.contains(identifier))
+	{
+		identifier = (m_identifier + 1);
+	}
+
+	m_identifier = qMax(m_identifier, identifier);
+
+	HistoryEntry *entry(new HistoryEntry());
+	entry->url = url;
+	entry->title = title;
+	entry->icon = icon;
+	entry->time = date;
+	entry->identifier = identifier;
+
+	beginInsertRows(QModelIndex(), 0, 0);
+
+	m_entries.prepend(entry);
+
+	registerEntry(entry);
+
+	endInsertRows();
+
+	emit entryAdded(identifier);
+
+	return identifier;
+}
+
+///NOTE Each change is stored as single line JSON record appended to journal, it is rewritten in background once most of its records became obsolete
+void HistoryModel::appendRecord(const QByteArray &record)
+{
+	m_pendingRecords.append(record);
+
+	++m_journalRecords;
+}
+
+void HistoryModel::compactJournal()
+{
+	QByteArray unloadedRecords;
+	HistoryEntry removedEntry;
+	QSet<quint64>::const_iterator removalsIterator;
+
+	for (removalsIterator = m_unloadedRemovals.constBegin(); removalsIterator != m_unloadedRemovals.constEnd(); ++removalsIterator)
+	{
+		removedEntry.identifier = *removalsIterator;
+
+		unloadedRecords.append(createRecord(QLatin1String("remove"), removedEntry));
+	}
+
+	QHash<quint64, QByteArray>::const_iterator updatesIterator;
+
+	for (updatesIterator = m_unloadedUpdates.constBegin(); updatesIterator != m_unloadedUpdates.constEnd(); ++updatesIterator)
+	{
+		unloadedRecords.append(updatesIterator.value());
+		unloadedRecords.append('\n');
+	}
+
+	const QVector<HistoryEntry> entries(createSnapshot());
+
+	m_pendingRecords.clear();
+
+	m_journalRecords = (entries.count() + m_unloadedRemovals.count() + m_unloadedUpdates.count());
+	m_needsCompaction = false;
+	m_isCompacting = true;
+	m_compactionFuture = QtConcurrent::run(this, &HistoryModel::writeJournal, entries, (m_unloadedLength + m_unloadedRemainder.size()), unloadedRecords);
+}
+
+void HistoryModel::handleEntryAdded(quint64 identifier)
+{
+	appendRecord(createRecord(QLatin1String("add"), getEntry(identifier)));
+}
+
+void HistoryModel::handleEntryModified(quint64 identifier)
+{
+	appendRecord(createRecord(QLatin1String("update"), getEntry(identifier)));
+}
+
+void HistoryModel::handleEntryRemoved(quint64 identifier)
+{
+	HistoryEntry removedEntry;
+	removedEntry.identifier = identifier;
+
+	appendRecord(createRecord(QLatin1String("remove"), removedEntry));
+}
+
+void HistoryModel::handleCleared()
+{
+	m_pendingRecords.clear();
+
+	m_needsCompaction = true;
+}
+
+void HistoryModel::handleJournalScanned()
+{
+	const JournalSummary summary(m_scanFuture.result());
+
+	if (summary.revision != m_scanRevision.load())
+	{
+		return;
+	}
+
+	m_unloadedIndex = summary.index;
+	m_unloadedEntries = summary.entries;
+	m_unloadedOrder = summary.order;
+	m_unloadedStatistics = summary.statistics;
+	m_unloadedIdentifiers = summary.identifiers;
+	m_isJournalScanned = true;
+
+///NOTE Entries paged in while journal was scanned are already counted as loaded ones
+	QHash<quint64, HistoryEntry*>::const_iterator iterator;
+
+	for (iterator = m_identifiers.constBegin(); iterator != m_identifiers.constEnd(); ++iterator)
+	{
+		unregisterUnloadedEntry(iterator.value());
+	}
+
+	emit unloadedEntriesChanged();
+}
+
+void HistoryModel::handleJournalCompacted(bool isSuccess)
+{
+	if (!m_isCompacting)
+	{
+		return;
+	}
+
+	m_isCompacting = false;
+
+	if (isSuccess)
+	{
+		writePendingRecords();
+	}
+	else
+	{
+		m_needsCompaction = true;
+	}
+}
+
+HistoryModel::HistoryEntry HistoryModel::getEntry(quint64 identifier) const
+{
+	const HistoryEntry *entry(m_identifiers.value(identifier, NULL));
+
+	return (entry ? *entry : HistoryEntry());
+}
+
+HistoryModel::UrlStatistics HistoryModel::getStatistics(const QUrl &url) const
+{
+	const QUrl normalizedUrl(Utils::normalizeUrl(url));
+	UrlStatistics statistics(m_statistics.value(normalizedUrl));
+
+	if (m_unloadedStatistics.contains(normalizedUrl))
+	{
+		const UrlStatistics &unloadedStatistics(m_unloadedStatistics[normalizedUrl]);
+
+		statistics.score += unloadedStatistics.score;
+		statistics.visitsAmount += unloadedStatistics.visitsAmount;
+
+		if (!statistics.lastVisit.isValid() || unloadedStatistics.lastVisit > statistics.lastVisit)
+		{
+			statistics.lastVisit = unloadedStatistics.lastVisit;
+		}
+	}
+
+	return statistics;
+}
+
+QList<QUrl> HistoryModel::getUnloadedUrls() const
+{
+	QList<QUrl> urls;
+	urls.reserve(m_unloadedEntries.count());
+
+	for (int i = 0; i < m_unloadedEntries.count(); ++i)
+	{
+		urls.append(m_unloadedEntries.at(i).url);
+	}
+
+	return urls;
+}
+
+QVariant HistoryModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid() || index.parent().isValid() || index.row() >= m_entries.count())
+	{
+		return QVariant();
+	}
+
+	const HistoryEntry *entry(m_entries.at(index.row()));
+
+	switch (role)
+	{
+		case TitleRole:
+			return entry->title;
+		case UrlRole:
+			return entry->url;
+		case IdentifierRole:
+			return entry->identifier;
+		case TimeVisitedRole:
+			return entry->time;
+		case Qt::DecorationRole:
+			return (entry->icon.isNull() ? HistoryManager::getIcon(entry->url) : entry->icon);
+		default:
+			break;
+	}
+
+	return QVariant();
+}
+
+QList<HistoryModel::HistoryEntry*> HistoryModel::readEntries(int amount)
+{
+	QList<HistoryEntry*> entries;
+
+	if (!canFetchMore(QModelIndex()))
+	{
+		return entries;
+	}
+
+	QFile file(m_path);
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		Console::addMessage(tr("Failed to open history file: %1").arg(file.errorString()), OtherMessageCategory, ErrorMessageLevel, m_path);
+
+		discardUnloadedEntries();
+
+		return entries;
+	}
+
+///NOTE Journal is read backwards, so removals and updates are seen before entries they refer to
+	while ((amount < 0 || entries.count() < amount) && canFetchMore(QModelIndex()))
+	{
+		const qint64 chunkSize(qMin(m_unloadedLength, static_cast<qint64>(65536)));
+
+		m_unloadedLength -= chunkSize;
+
+		file.seek(m_unloadedLength);
+
+		QByteArray data(file.read(chunkSize) + m_unloadedRemainder);
+
+		m_unloadedRemainder.clear();
+
+		if (m_unloadedLength > 0)
+		{
+			const int position(data.indexOf('\n'));
+
+			if (position < 0)
+			{
+				m_unloadedRemainder = data;
+
+				continue;
+			}
+
+			m_unloadedRemainder = data.left(position);
+
+			data.remove(0, (position + 1));
+		}
+
+		const QList<QByteArray> lines(data.split('\n'));
+
+		for (int i = (lines.count() - 1); i >= 0; --i)
+		{
+			const QJsonObject record(QJsonDocument::fromJson(lines.at(i)).object());
+
+///NOTE Incomplete record left by interrupted write is not valid JSON object and is skipped
+			if (record.isEmpty())
+			{
+				continue;
+			}
+
+			const QString action(record.value(QLatin1String("action")).toString());
+			const quint64 identifier(static_cast<quint64>(record.value(QLatin1String("identifier")).toDouble()));
+
+			m_identifier = qMax(m_identifier, identifier);
+
+			++m_journalRecords;
+
+			if (action == QLatin1String("remove"))
+			{
+				m_unloadedRemovals.insert(identifier);
+			}
+			else if (action == QLatin1String("update"))
+			{
+				if (!m_unloadedRemovals.contains(identifier) && !m_unloadedUpdates.contains(identifier))
+				{
+					m_unloadedUpdates[identifier] = lines.at(i);
+				}
+			}
+			else if (action == QLatin1String("add"))
+			{
+				if (m_unloadedRemovals.remove(identifier) || m_identifiers.contains(identifier))
+				{
+					continue;
+				}
+
+				const QJsonObject latestRecord(m_unloadedUpdates.contains(identifier) ? QJsonDocument::fromJson(m_unloadedUpdates.take(identifier)).object() : record);
+				HistoryEntry *entry(new HistoryEntry());
+				entry->url = QUrl(latestRecord.value(QLatin1String("url")).toString());
+				entry->title = latestRecord.value(QLatin1String("title")).toString();
+				entry->time = QDateTime::fromString(latestRecord.value(QLatin1String("time")).toString(), QLatin1String("yyyy-MM-dd hh:mm:ss"));
+				entry->identifier = identifier;
+
+				registerEntry(entry);
+				unregisterUnloadedEntry(entry);
+
+				entries.append(entry);
+			}
+		}
+	}
+
+	file.close();
+
+	return entries;
+}
+
+HistoryModel::JournalSummary HistoryModel::createSummary(qint64 length, const QSet<quint64> &removals, const QHash<quint64, QByteArray> &updates, int revision)
+{
+	JournalSummary summary;
+	QFile file(m_path);
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return summary;
+	}
+
+	QHash<quint64, HistoryEntry> entries;
+	QVector<quint64> identifiers;
+	qint64 position(0);
+
+	while (position < length && !file.atEnd())
+	{
+		if (revision != m_scanRevision.load())
+		{
+			return summary;
+		}
+
+		QByteArray line(file.readLine());
+
+		if (line.isEmpty())
+		{
+			break;
+		}
+
+		if (line.size() > (length - position))
+		{
+			line.truncate(length - position);
+		}
+
+		position += line.size();
+
+		const QJsonObject record(QJsonDocument::fromJson(line).object());
+
+		if (record.isEmpty())
+		{
+			continue;
+		}
+
+		const QString action(record.value(QLatin1String("action")).toString());
+		const quint64 identifier(static_cast<quint64>(record.value(QLatin1String("identifier")).toDouble()));
+
+		if (action == QLatin1String("remove"))
+		{
+			entries.remove(identifier);
+		}
+		else if (action == QLatin1String("add") || (action == QLatin1String("update") && entries.contains(identifier)))
+		{
+			if (action == QLatin1String("add"))
+			{
+				identifiers.append(identifier);
+			}
+
+			HistoryEntry &entry(entries[identifier]);
+			entry.url = QUrl(record.value(QLatin1String("url")).toString());
+			entry.title = record.value(QLatin1String("title")).toString();
+			entry.time = QDateTime::fromString(record.value(QLatin1String("time")).toString(), QLatin1String("yyyy-MM-dd hh:mm:ss"));
+			entry.identifier = identifier;
+		}
+	}
+
+	file.close();
+
+///NOTE Removals and updates found in already loaded part of journal refer to entries from scanned part
+	QSet<quint64>::const_iterator removalsIterator;
+
+	for (removalsIterator = removals.constBegin(); removalsIterator != removals.constEnd(); ++removalsIterator)
+	{
+		entries.remove(*removalsIterator);
+	}
+
+	QHash<quint64, QByteArray>::const_iterator updatesIterator;
+
+	for (updatesIterator = updates.constBegin(); updatesIterator != updates.constEnd(); ++updatesIterator)
+	{
+		if (entries.contains(updatesIterator.key()))
+		{
+			const QJsonObject record(QJsonDocument::fromJson(updatesIterator.value()).object());
+			HistoryEntry &entry(entries[updatesIterator.key()]);
+			entry.url = QUrl(record.value(QLatin1String("url")).toString());
+			entry.title = record.value(QLatin1String("title")).toString();
+			entry.time = QDateTime::fromString(record.value(QLatin1String("time")).toString(), QLatin1String("yyyy-MM-dd hh:mm:ss"));
+		}
+	}
+
+	QHash<QUrl, int> urls;
+	QHash<quint64, HistoryEntry>::const_iterator entriesIterator;
+
+	for (entriesIterator = entries.constBegin(); entriesIterator != entries.constEnd(); ++entriesIterator)
+	{
+		const HistoryEntry &entry(entriesIterator.value());
+		const QUrl url(Utils::normalizeUrl(entry.url));
+
+		summary.identifiers.insert(entry.identifier);
+
+		if (url.isEmpty())
+		{
+			continue;
+		}
+
+		UrlStatistics &statistics(summary.statistics[url]);
+		statistics.score += calculateScore(entry.time);
+
+		++statistics.visitsAmount;
+
+		if (!statistics.lastVisit.isValid() || entry.time > statistics.lastVisit)
+		{
+			statistics.lastVisit = entry.time;
+		}
+
+		if (!urls.contains(url))
+		{
+			urls[url] = summary.entries.count();
+
+			summary.entries.append(entry);
+		}
+		else if (entry.time > summary.entries.at(urls[url]).time)
+		{
+			summary.entries[urls[url]] = entry;
+		}
+	}
+
+	for (int i = 0; i < summary.entries.count(); ++i)
+	{
+		summary.index.addUrl(i, Utils::normalizeUrl(summary.entries.at(i).url), summary.entries.at(i).title);
+	}
+
+	summary.order.reserve(entries.count());
+
+	for (int i = 0; i < identifiers.count(); ++i)
+	{
+		if (!entries.contains(identifiers.at(i)))
+		{
+			continue;
+		}
+
+		const HistoryEntry &entry(entries[identifiers.at(i)]);
+		UnloadedEntry unloadedEntry;
+		unloadedEntry.time = entry.time;
+		unloadedEntry.identifier = entry.identifier;
+		unloadedEntry.representative = urls.value(Utils::normalizeUrl(entry.url), -1);
+
+		summary.order.append(unloadedEntry);
+	}
+
+	summary.revision = revision;
+
+	QMetaObject::invokeMethod(this, "handleJournalScanned", Qt::QueuedConnection);
+
+	return summary;
+}
+
+QVector<HistoryModel::HistoryEntry> HistoryModel::createSnapshot() const
+{
+	QVector<HistoryEntry> entries;
+	entries.reserve(m_entries.count());
+
+	for (int i = (m_entries.count() - 1); i >= 0; --i)
+	{
+		entries.append(*m_entries.at(i));
+	}
+
+	return entries;
+}
+
+QByteArray HistoryModel::createRecord(const QString &action, const HistoryEntry &entry)
+{
+	QJsonObject record;
+	record.insert(QLatin1String("action"), action);
+	record.insert(QLatin1String("identifier"), static_cast<double>(entry.identifier));
+
+	if (action != QLatin1String("remove"))
+	{
+		record.insert(QLatin1String("url"), entry.url.toString());
+		record.insert(QLatin1String("title"), entry.title);
+		record.insert(QLatin1String("time"), entry.time.toString(QLatin1String("yyyy-MM-dd hh:mm:ss")));
+	}
+
+	return (QJsonDocument(record).toJson(QJsonDocument::Compact) + '\n');
+}
+
+///NOTE Visits lose half of their weight every 30 days, scores are kept relative to fixed point in time, so they never need to be recalculated when time passes
+double HistoryModel::calculateScore(const QDateTime &time)
+{
+	if (!time.isValid())
+	{
+		return 0;
+	}
+
+	return std::pow(2.0, (static_cast<double>(time.toMSecsSinceEpoch() / 1000) - 1451606400.0) / (30.0 * SECONDS_IN_DAY));
+}
+
+QList<HistoryModel::HistoryEntryMatch> HistoryModel::findEntries(const QString &prefix, bool markAsTypedIn, int limit)
+{
+	const QList<UrlIndex::UrlMatch> urlMatches(m_index.findUrls(prefix, true, limit));
+	QList<HistoryModel::HistoryEntryMatch> matches;
+	matches.reserve(urlMatches.count());
+
+	for (int i = 0; i < urlMatches.count(); ++i)
+	{
+		const HistoryEntry *entry(m_identifiers.value(urlMatches.at(i).identifier, NULL));
+
+		if (!entry)
+		{
+			continue;
+		}
+
+		HistoryEntryMatch match;
+		match.entry = *entry;
+		match.match = urlMatches.at(i).match;
+		match.score = getStatistics(entry->url).score;
+		match.isTypedIn = markAsTypedIn;
+
+		matches.append(match);
+	}
+
+	if (m_unloadedStatistics.isEmpty() || (limit > 0 && matches.count() >= limit))
+	{
+		return matches;
+	}
+
+	const QList<UrlIndex::UrlMatch> unloadedMatches(m_unloadedIndex.findUrls(prefix, true, ((limit > 0) ? (limit - matches.count()) : 0)));
+
+	for (int i = 0; i < unloadedMatches.count(); ++i)
+	{
+		const HistoryEntry &entry(m_unloadedEntries.at(unloadedMatches.at(i).identifier));
+		const QUrl url(Utils::normalizeUrl(entry.url));
+
+		if (m_urls.contains(url) || !m_unloadedStatistics.contains(url))
+		{
+			continue;
+		}
+
+		HistoryEntryMatch match;
+		match.entry = entry;
+		match.match = unloadedMatches.at(i).match;
+		match.score = getStatistics(url).score;
+		match.isTypedIn = markAsTypedIn;
+
+		matches.append(match);
+	}
+
+	return matches;
+}
+
+bool HistoryModel::writeJournal(const QVector<HistoryEntry> &entries, qint64 unloadedLength, const QByteArray &unloadedRecords)
+{
+	QSaveFile file(m_path);
+	bool isSuccess(file.open(QIODevice::WriteOnly));
+
+///NOTE Part of journal which was not loaded yet is copied verbatim, so positions of its records stay valid
+	if (isSuccess && unloadedLength > 0)
+	{
+		QFile journalFile(m_path);
+
+		isSuccess = journalFile.open(QIODevice::ReadOnly);
+
+		while (isSuccess && unloadedLength > 0)
+		{
+			const QByteArray data(journalFile.read(qMin(unloadedLength, static_cast<qint64>(65536))));
+
+			if (data.isEmpty())
+			{
+				isSuccess = false;
+
+				break;
+			}
+
+			file.write(data);
+
+			unloadedLength -= data.size();
+		}
+
+		journalFile.close();
+
+		file.write("\n");
+	}
+
+	if (isSuccess)
+	{
+		file.write(unloadedRecords);
+
+		for (int i = 0; i < entries.count(); ++i)
+		{
+			file.write(createRecord(QLatin1String("add"), entries.at(i)));
+		}
+
+		isSuccess = file.commit();
+	}
+	else
+	{
+		file.cancelWriting();
+	}
+
+	QMetaObject::invokeMethod(this, "handleJournalCompacted", Qt::QueuedConnection, Q_ARG(bool, isSuccess));
+
+	return isSuccess;
+}
+
+bool HistoryModel::writePendingRecords()
+{
+	if (m_pendingRecords.isEmpty())
+	{
+		return true;
+	}
+
+	QFile file(m_path);
+
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+	{
+		return false;
+	}
+
+	const bool isSuccess(file.write(m_pendingRecords) == m_pendingRecords.size());
+
+	file.close();
+
+	if (isSuccess)
+	{
+		m_pendingRecords.clear();
+	}
+
+	return isSuccess;
+}
+
+bool HistoryModel::save()
+{
+	if (SessionsManager::isReadOnly())
+	{
+		return false;
+	}
+
+	if (m_isCompacting)
+	{
+		return true;
+	}
+
+	if (m_needsCompaction || m_journalRecords > ((m_entries.count() * 2) + 1000))
+	{
+		compactJournal();
+
+		return true;
+	}
+
+	return writePendingRecords();
+}
+
+int HistoryModel::rowCount(const QModelIndex &parent) const
+{
+	return (parent.isValid() ? 0 : m_entries.count());
+}
+
+bool HistoryModel::canFetchMore(const QModelIndex &parent) const
+{
+	return (!parent.isValid() && (m_unloadedLength > 0 || !m_unloadedRemainder.isEmpty()));
+}
+
+bool HistoryModel::hasEntry(const QUrl &url)
+{
+	const QUrl normalizedUrl(Utils::normalizeUrl(url));
+
+	return (m_urls.contains(normalizedUrl) || m_unloadedStatistics.contains(normalizedUrl));
 }
 
 }
@@ -20,26 +20,20 @@
 #ifndef OTTER_HISTORYMODEL_H
 #define OTTER_HISTORYMODEL_H
 
+#include "UrlIndex.h"
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QDateTime>
+#include <QtCore/QFuture>
+#include <QtCore/QSet>
 #include <QtCore/QUrl>
-#include <QtGui/QStandardItemModel>
+#include <QtGui/QIcon>
 
 namespace Otter
 {
 
-class HistoryEntryItem : public QStandardItem
-{
-public:
-	void setData(const QVariant &value, int role);
-	void setItemData(const QVariant &value, int role);
-
-protected:
-	explicit HistoryEntryItem();
-
-friend class HistoryModel;
-};
-
-class HistoryModel : public QStandardItemModel
+class HistoryModel : public QAbstractListModel
 {
 	Q_OBJECT
 
@@ -52,37 +46,141 @@ public:
 		TimeVisitedRole = (Qt::UserRole + 1)
 	};
 
+	struct HistoryEntry
+	{
+		QUrl url;
+		QString title;
+		QIcon icon;
+		QDateTime time;
+		quint64 identifier;
+
+		HistoryEntry() : identifier(0) {}
+	};
+
 	struct HistoryEntryMatch
 	{
-		HistoryEntryItem *entry;
+		HistoryEntry entry;
 		QString match;
+		double score;
 		bool isTypedIn;
 
-		HistoryEntryMatch () : entry(NULL), isTypedIn(false) {}
+		HistoryEntryMatch () : score(0), isTypedIn(false) {}
+	};
+
+	struct UrlStatistics
+	{
+		QDateTime lastVisit;
+		double score;
+		int visitsAmount;
+
+		UrlStatistics() : score(0), visitsAmount(0) {}
 	};
 
 	explicit HistoryModel(const QString &path, QObject *parent = NULL);
+	~HistoryModel();
 
 	void clearExcessEntries(int limit);
 	void clearRecentEntries(uint period);
 	void clearOldestEntries(int period);
 	void removeEntry(quint64 identifier);
-	HistoryEntryItem* addEntry(const QUrl &url, const QString &title, const QIcon &icon, const QDateTime &date = QDateTime::currentDateTime(), quint64 identifier = 0);
-	HistoryEntryItem* getEntry(quint64 identifier) const;
-	QList<HistoryEntryMatch> findEntries(const QString &prefix, bool markAsTypedIn = false) const;
-	bool hasEntry(const QUrl &url) const;
-	bool save(const QString &path) const;
-	bool setData(const QModelIndex &index, const QVariant &value, int role);
+	void removeEntries(const QList<quint64> &identifiers);
+	void updateEntry(quint64 identifier, const QUrl &url, const QString &title, const QIcon &icon);
+	void fetchMore(const QModelIndex &parent);
+	void loadAllEntries();
+	HistoryEntry getEntry(quint64 identifier) const;
+	UrlStatistics getStatistics(const QUrl &url) const;
+	QList<QUrl> getUnloadedUrls() const;
+	QVariant data(const QModelIndex &index, int role) const;
+	QList<HistoryEntryMatch> findEntries(const QString &prefix, bool markAsTypedIn = false, int limit = 0);
+	quint64 addEntry(const QUrl &url, const QString &title, const QIcon &icon, const QDateTime &date = QDateTime::currentDateTime(), quint64 identifier = 0);
+	int rowCount(const QModelIndex &parent = QModelIndex()) const;
+	bool canFetchMore(const QModelIndex &parent) const;
+	bool hasEntry(const QUrl &url);
+	bool save();
+
+protected:
+	struct UnloadedEntry
+	{
+		QDateTime time;
+		quint64 identifier;
+		int representative;
+
+		UnloadedEntry() : identifier(0), representative(-1) {}
+	};
+
+	struct JournalSummary
+	{
+		UrlIndex index;
+		QVector<HistoryEntry> entries;
+		QVector<UnloadedEntry> order;
+		QHash<QUrl, UrlStatistics> statistics;
+		QSet<quint64> identifiers;
+		int revision;
+
+		JournalSummary() : revision(-1) {}
+	};
+
+	void importEntries(const QString &path);
+	void registerEntry(HistoryEntry *entry);
+	void unregisterEntry(HistoryEntry *entry);
+	void unregisterEntries(const QList<HistoryEntry*> &entries);
+	void discardUnloadedEntries();
+	void unregisterUnloadedEntry(const HistoryEntry *entry);
+	void scanJournal();
+	void appendEntries(const QList<HistoryEntry*> &entries);
+	void appendRecord(const QByteArray &record);
+	void compactJournal();
+	QList<HistoryEntry*> readEntries(int amount);
+	QVector<HistoryEntry> createSnapshot() const;
+	JournalSummary createSummary(qint64 length, const QSet<quint64> &removals, const QHash<quint64, QByteArray> &updates, int revision);
+	static QByteArray createRecord(const QString &action, const HistoryEntry &entry);
+	static double calculateScore(const QDateTime &time);
+	bool writeJournal(const QVector<HistoryEntry> &entries, qint64 unloadedLength, const QByteArray &unloadedRecords);
+	bool writePendingRecords();
+
+protected slots:
+	void handleEntryAdded(quint64 identifier);
+	void handleEntryModified(quint64 identifier);
+	void handleEntryRemoved(quint64 identifier);
+	void handleCleared();
+	void handleJournalCompacted(bool isSuccess);
+	void handleJournalScanned();
 
 private:
-	QHash<QUrl, QList<HistoryEntryItem*> > m_urls;
-	QMap<quint64, HistoryEntryItem*> m_identifiers;
+	QString m_path;
+	QByteArray m_pendingRecords;
+	QByteArray m_unloadedRemainder;
+	QFuture<bool> m_compactionFuture;
+	QFuture<JournalSummary> m_scanFuture;
+	QList<HistoryEntry*> m_entries;
+	QHash<QUrl, QList<HistoryEntry*> > m_urls;
+	QHash<QUrl, UrlStatistics> m_statistics;
+	QHash<quint64, HistoryEntry*> m_identifiers;
+	UrlIndex m_index;
+	UrlIndex m_unloadedIndex;
+	QVector<HistoryEntry> m_unloadedEntries;
+	QVector<UnloadedEntry> m_unloadedOrder;
+	QHash<QUrl, UrlStatistics> m_unloadedStatistics;
+	QHash<quint64, QByteArray> m_unloadedUpdates;
+	QSet<quint64> m_unloadedRemovals;
+	QSet<quint64> m_unloadedIdentifiers;
+	QAtomicInt m_scanRevision;
+	qint64 m_unloadedLength;
+	quint64 m_identifier;
+	int m_journalRecords;
+	bool m_needsCompaction;
+	bool m_isCompacting;
+	bool m_isJournalScanned;
+
+	static const int m_pageSize;
 
 signals:
 	void cleared();
-	void entryAdded(HistoryEntryItem *entry);
-	void entryModified(HistoryEntryItem *entry);
-	void entryRemoved(HistoryEntryItem *entry);
+	void entryAdded(quint64 identifier);
+	void entryModified(quint64 identifier);
+	void entryRemoved(quint64 identifier);
+	void entriesRemoved(const QList<quint64> &identifiers);
+	void unloadedEntriesChanged();
 	void modelModified();
 };
 
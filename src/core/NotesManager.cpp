@@ -51,7 +51,7 @@ void NotesManager::timerEvent(QTimerEvent *event)
 
 		if (m_model)
 		{
-			m_model->save(SessionsManager::getWritableDataPath(QLatin1String("notes.xbel")));
+			m_model->save();
 		}
 	}
 }
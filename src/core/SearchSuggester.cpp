@@ -24,21 +24,54 @@
 
 #include <QtCore/QJsonArray>
 #include <QtCore/QJsonDocument>
+#include <QtCore/QTimerEvent>
 
 namespace Otter
 {
 
+QHash<QString, QHash<QString, SearchSuggester::SuggestionsCacheEntry> > SearchSuggester::m_cache;
+QHash<QString, int> SearchSuggester::m_suggestionsLimits;
+const int SearchSuggester::m_cacheLimit(200);
+const int SearchSuggester::m_cacheTimeout(300);
+
 SearchSuggester::SearchSuggester(const QString &searchEngine, QObject *parent) : QObject(parent),
 	m_networkReply(NULL),
 	m_model(NULL),
-	m_searchEngine(searchEngine)
+	m_searchEngine(searchEngine),
+	m_keystrokeInterval(200),
+	m_replyTime(200),
+	m_updateTimer(0)
 {
 }
 
+void SearchSuggester::timerEvent(QTimerEvent *event)
+{
+	if (event->timerId() == m_updateTimer)
+	{
+		killTimer(m_updateTimer);
+
+		m_updateTimer = 0;
+
+		sendRequest();
+	}
+}
+
 void SearchSuggester::setSearchEngine(const QString &searchEngine)
 {
 	const QString query(m_query);
 
+	if (searchEngine != m_searchEngine && m_networkReply)
+	{
+		QNetworkReply *networkReply(m_networkReply);
+
+		m_networkReply = NULL;
+
+///NOTE Aborted reply emits finished() immediately, so it has to be detached before aborting it, otherwise replyFinished() would handle it and could send new request in meantime
+		networkReply->disconnect(this);
+		networkReply->abort();
+		networkReply->deleteLater();
+	}
+
 	m_searchEngine = searchEngine;
 	m_query = QString();
 
@@ -47,94 +80,212 @@ void SearchSuggester::setSearchEngine(const QString &searchEngine)
 
 void SearchSuggester::setQuery(const QString &query)
 {
-	if (query != m_query)
+	if (query == m_query)
 	{
-		m_query = query;
+		return;
+	}
 
-		if (m_networkReply)
-		{
-			m_networkReply->abort();
-			m_networkReply->deleteLater();
-			m_networkReply = NULL;
-		}
+	m_query = query;
 
-		const SearchEnginesManager::SearchEngineDefinition searchEngine(SearchEnginesManager::getSearchEngine(m_searchEngine));
+	if (m_keystrokeTimer.isValid() && m_keystrokeTimer.elapsed() < 2000)
+	{
+		m_keystrokeInterval = (((m_keystrokeInterval * 3) + m_keystrokeTimer.elapsed()) / 4);
+	}
 
-		if (searchEngine.identifier.isEmpty() || searchEngine.suggestionsUrl.url.isEmpty())
-		{
-			return;
-		}
+	m_keystrokeTimer.start();
 
-		QNetworkRequest request;
-		request.setHeader(QNetworkRequest::UserAgentHeader, NetworkManagerFactory::getUserAgent());
+	if (m_updateTimer != 0)
+	{
+		killTimer(m_updateTimer);
 
-		QNetworkAccessManager::Operation method;
-		QByteArray body;
+		m_updateTimer = 0;
+	}
 
-		SearchEnginesManager::setupQuery(query, searchEngine.suggestionsUrl, &request, &method, &body);
+	if (query.isEmpty())
+	{
+		setSuggestions(QList<SearchSuggestion>());
 
-		if (method == QNetworkAccessManager::PostOperation)
-		{
-			m_networkReply = NetworkManagerFactory::getNetworkManager()->post(request, body);
-		}
-		else
-		{
-			m_networkReply = NetworkManagerFactory::getNetworkManager()->get(request);
-		}
+		return;
+	}
+
+	QList<SearchSuggestion> suggestions;
+
+	if (findCachedSuggestions(query, suggestions))
+	{
+		setSuggestions(suggestions);
 
-		connect(m_networkReply, SIGNAL(finished()), this, SLOT(replyFinished()));
+		return;
 	}
+
+	if (!suggestions.isEmpty())
+	{
+		setSuggestions(suggestions);
+	}
+
+///NOTE Request is sent once typing pauses for a moment, shorter pause is enough when typing is fast or replies arrive quickly
+	m_updateTimer = startTimer(qBound(50, qMin(((m_keystrokeInterval * 3) / 2), m_replyTime), 500));
 }
 
-void SearchSuggester::replyFinished()
+void SearchSuggester::sendRequest()
 {
-	if (!m_networkReply)
+///NOTE Only one request is sent at time, latest query is requested once it finishes
+	if (m_networkReply || m_query.isEmpty())
 	{
 		return;
 	}
 
-	if (m_model)
+	QList<SearchSuggestion> suggestions;
+
+	if (findCachedSuggestions(m_query, suggestions))
 	{
-		m_model->clear();
+		setSuggestions(suggestions);
+
+		return;
 	}
 
-	m_networkReply->deleteLater();
+	const SearchEnginesManager::SearchEngineDefinition searchEngine(SearchEnginesManager::getSearchEngine(m_searchEngine));
 
-	if (m_networkReply->size() <= 0)
+	if (searchEngine.identifier.isEmpty() || searchEngine.suggestionsUrl.url.isEmpty())
 	{
-		m_networkReply = NULL;
+		return;
+	}
+
+	QNetworkRequest request;
+	request.setHeader(QNetworkRequest::UserAgentHeader, NetworkManagerFactory::getUserAgent());
 
+	QNetworkAccessManager::Operation method;
+	QByteArray body;
+
+	SearchEnginesManager::setupQuery(m_query, searchEngine.suggestionsUrl, &request, &method, &body);
+
+	if (method == QNetworkAccessManager::PostOperation)
+	{
+		m_networkReply = NetworkManagerFactory::getNetworkManager()->post(request, body);
+	}
+	else
+	{
+		m_networkReply = NetworkManagerFactory::getNetworkManager()->get(request);
+	}
+
+	m_requestedQuery = m_query;
+
+	m_replyTimer.start();
+
+	connect(m_networkReply, SIGNAL(finished()), this, SLOT(replyFinished()));
+}
+
+void SearchSuggester::replyFinished()
+{
+	if (!m_networkReply)
+	{
 		return;
 	}
 
-	const QJsonDocument document(QJsonDocument::fromJson(m_networkReply->readAll()));
+	m_networkReply->deleteLater();
+
+	m_replyTime = (((m_replyTime * 3) + static_cast<int>(qMin(m_replyTimer.elapsed(), static_cast<qint64>(5000)))) / 4);
 
-	if (!document.isEmpty() && document.isArray() && document.array().count() > 1 && document.array().at(0).toString() == m_query)
+	if (m_networkReply->error() == QNetworkReply::NoError && m_networkReply->size() > 0)
 	{
-		const QJsonArray completionsArray(document.array().at(1).toArray());
-		const QJsonArray descriptionsArray(document.array().at(2).toArray());
-		const QJsonArray urlsArray(document.array().at(3).toArray());
-		QList<SearchSuggestion> suggestions;
+		const QJsonDocument document(QJsonDocument::fromJson(m_networkReply->readAll()));
 
-		for (int i = 0; i < completionsArray.count(); ++i)
+		if (!document.isEmpty() && document.isArray() && document.array().count() > 1 && document.array().at(0).toString() == m_requestedQuery)
 		{
-			SearchSuggestion suggestion;
-			suggestion.completion = completionsArray.at(i).toString();
-			suggestion.description = descriptionsArray.at(i).toString();
-			suggestion.url = urlsArray.at(i).toString();
+			const QJsonArray completionsArray(document.array().at(1).toArray());
+			const QJsonArray descriptionsArray(document.array().at(2).toArray());
+			const QJsonArray urlsArray(document.array().at(3).toArray());
+			QList<SearchSuggestion> suggestions;
+			suggestions.reserve(completionsArray.count());
 
-			if (m_model)
+			for (int i = 0; i < completionsArray.count(); ++i)
 			{
-				m_model->appendRow(new QStandardItem(suggestion.completion));
+				SearchSuggestion suggestion;
+				suggestion.completion = completionsArray.at(i).toString();
+				suggestion.description = descriptionsArray.at(i).toString();
+				suggestion.url = urlsArray.at(i).toString();
+
+				suggestions.append(suggestion);
 			}
 
-			suggestions.append(suggestion);
-		}
+			addCacheEntry(m_requestedQuery, suggestions);
 
-		emit suggestionsChanged(suggestions);
+			if (m_requestedQuery == m_query)
+			{
+				setSuggestions(suggestions);
+			}
+		}
 	}
 
 	m_networkReply = NULL;
+
+	if (m_requestedQuery != m_query && m_updateTimer == 0)
+	{
+		sendRequest();
+	}
+}
+
+void SearchSuggester::addCacheEntry(const QString &query, const QList<SearchSuggestion> &suggestions)
+{
+	QHash<QString, SuggestionsCacheEntry> &cache(m_cache[m_searchEngine]);
+	const QDateTime currentDateTime(QDateTime::currentDateTime());
+
+	if (cache.count() >= m_cacheLimit)
+	{
+		QHash<QString, SuggestionsCacheEntry>::iterator iterator(cache.begin());
+		QHash<QString, SuggestionsCacheEntry>::iterator oldestIterator(cache.end());
+
+		while (iterator != cache.end())
+		{
+			if (iterator.value().time.secsTo(currentDateTime) > m_cacheTimeout)
+			{
+				iterator = cache.erase(iterator);
+			}
+			else
+			{
+				if (oldestIterator == cache.end() || iterator.value().time < oldestIterator.value().time)
+				{
+					oldestIterator = iterator;
+				}
+
+				++iterator;
+			}
+		}
+
+		if (cache.count() >= m_cacheLimit && oldestIterator != cache.end())
+		{
+			cache.erase(oldestIterator);
+		}
+	}
+
+	SuggestionsCacheEntry entry;
+	entry.suggestions = suggestions;
+	entry.time = currentDateTime;
+
+	cache[query] = entry;
+
+	if (suggestions.count() > m_suggestionsLimits.value(m_searchEngine, 0))
+	{
+		m_suggestionsLimits[m_searchEngine] = suggestions.count();
+	}
+}
+
+void SearchSuggester::setSuggestions(const QList<SearchSuggestion> &suggestions)
+{
+	if (m_model)
+	{
+		QList<QStandardItem*> items;
+		items.reserve(suggestions.count());
+
+		for (int i = 0; i < suggestions.count(); ++i)
+		{
+			items.append(new QStandardItem(suggestions.at(i).completion));
+		}
+
+		m_model->clear();
+		m_model->invisibleRootItem()->appendRows(items);
+	}
+
+	emit suggestionsChanged(suggestions);
 }
 
 QStandardItemModel* SearchSuggester::getModel()
@@ -147,4 +298,49 @@ QStandardItemModel* SearchSuggester::getModel()
 	return m_model;
 }
 
+///NOTE Suggestions for query are also taken from suggestions for its shorter prefix, if these were not cut by limit of engine they are treated as complete answer
+bool SearchSuggester::findCachedSuggestions(const QString &query, QList<SearchSuggestion> &suggestions) const
+{
+	suggestions.clear();
+
+	if (!m_cache.contains(m_searchEngine))
+	{
+		return false;
+	}
+
+	const QHash<QString, SuggestionsCacheEntry> &cache(m_cache[m_searchEngine]);
+	const QDateTime currentDateTime(QDateTime::currentDateTime());
+
+	for (int length = query.length(); length > 0; --length)
+	{
+		const QString prefix(query.left(length));
+
+		if (!cache.contains(prefix) || cache[prefix].time.secsTo(currentDateTime) > m_cacheTimeout)
+		{
+			continue;
+		}
+
+		const SuggestionsCacheEntry &entry(cache[prefix]);
+
+		if (length == query.length())
+		{
+			suggestions = entry.suggestions;
+
+			return true;
+		}
+
+		for (int i = 0; i < entry.suggestions.count(); ++i)
+		{
+			if (entry.suggestions.at(i).completion.startsWith(query, Qt::CaseInsensitive))
+			{
+				suggestions.append(entry.suggestions.at(i));
+			}
+		}
+
+		return (entry.suggestions.count() < m_suggestionsLimits.value(m_searchEngine, 0));
+	}
+
+	return false;
+}
+
 }
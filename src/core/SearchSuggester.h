@@ -20,6 +20,8 @@
 #ifndef OTTER_SEARCHSUGGESTER_H
 #define OTTER_SEARCHSUGGESTER_H
 
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 #include <QtGui/QStandardItemModel>
 #include <QtNetwork/QNetworkReply>
@@ -49,6 +51,19 @@ public slots:
 	void setSearchEngine(const QString &searchEngine);
 	void setQuery(const QString &query);
 
+protected:
+	struct SuggestionsCacheEntry
+	{
+		QList<SearchSuggestion> suggestions;
+		QDateTime time;
+	};
+
+	void timerEvent(QTimerEvent *event);
+	void sendRequest();
+	void addCacheEntry(const QString &query, const QList<SearchSuggestion> &suggestions);
+	void setSuggestions(const QList<SearchSuggestion> &suggestions);
+	bool findCachedSuggestions(const QString &query, QList<SearchSuggestion> &suggestions) const;
+
 protected slots:
 	void replyFinished();
 
@@ -57,6 +72,17 @@ private:
 	QStandardItemModel *m_model;
 	QString m_searchEngine;
 	QString m_query;
+	QString m_requestedQuery;
+	QElapsedTimer m_keystrokeTimer;
+	QElapsedTimer m_replyTimer;
+	int m_keystrokeInterval;
+	int m_replyTime;
+	int m_updateTimer;
+
+	static QHash<QString, QHash<QString, SuggestionsCacheEntry> > m_cache;
+	static QHash<QString, int> m_suggestionsLimits;
+	static const int m_cacheLimit;
+	static const int m_cacheTimeout;
 
 signals:
 	void suggestionsChanged(const QList<SearchSuggestion> &suggestions);
@@ -0,0 +1,334 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#include "UrlIndex.h"
+
+#include <QtCore/QSet>
+
+namespace Otter
+{
+
+UrlIndex::UrlIndex() : m_removedRecords(0)
+{
+}
+
+void UrlIndex::addUrl(quint64 identifier, const QUrl &url, const QString &title)
+{
+	if (m_identifiers.contains(identifier))
+	{
+		removeUrl(identifier);
+	}
+
+	const quint32 record(m_records.count());
+	const QStringList forms(createForms(url));
+	UrlRecord urlRecord;
+	urlRecord.url = url;
+	urlRecord.title = title;
+	urlRecord.forms = forms;
+	urlRecord.identifier = identifier;
+	urlRecord.isRemoved = false;
+
+	m_records.append(urlRecord);
+
+	m_identifiers[identifier] = record;
+
+///NOTE Lower two bits of value identify form which was matched
+	for (int i = 0; i < forms.count(); ++i)
+	{
+		m_forms.insert(forms.at(i).toLower(), ((record << 2) | i));
+	}
+
+	addWords((createWords(title) + createUrlWords(url)), record);
+}
+
+void UrlIndex::addWords(const QStringList &words, quint32 record)
+{
+	for (int i = 0; i < words.count(); ++i)
+	{
+		QVector<quint32> &records(m_words[words.at(i)]);
+
+		if (records.isEmpty() || records.last() != record)
+		{
+			records.append(record);
+		}
+	}
+}
+
+void UrlIndex::removeUrl(quint64 identifier)
+{
+	if (!m_identifiers.contains(identifier))
+	{
+		return;
+	}
+
+	const quint32 record(m_identifiers.take(identifier));
+	const QStringList forms(m_records.at(record).forms);
+
+	for (int i = 0; i < forms.count(); ++i)
+	{
+		m_forms.remove(forms.at(i).toLower(), ((record << 2) | i));
+	}
+
+///NOTE Words lists are not updated on removal, removed records are skipped until index is rebuilt
+	m_records[record].isRemoved = true;
+
+	++m_removedRecords;
+
+	if (m_removedRecords > qMax(1000, (m_records.count() / 2)))
+	{
+		rebuild();
+	}
+}
+
+void UrlIndex::rebuild()
+{
+	const QVector<UrlRecord> records(m_records);
+
+	clear();
+
+	for (int i = 0; i < records.count(); ++i)
+	{
+		if (!records.at(i).isRemoved)
+		{
+			addUrl(records.at(i).identifier, records.at(i).url, records.at(i).title);
+		}
+	}
+}
+
+void UrlIndex::clear()
+{
+	m_records.clear();
+	m_identifiers.clear();
+	m_forms.clear();
+	m_words.clear();
+
+	m_removedRecords = 0;
+}
+
+QStringList UrlIndex::createForms(const QUrl &url)
+{
+	QStringList forms({url.toString()});
+	const QString address(url.toString(QUrl::RemoveScheme).mid(2));
+
+	forms.append(address);
+
+	if (address.startsWith(QLatin1String("www.")) && url.host().count(QLatin1Char('.')) > 1)
+	{
+		forms.append(address.mid(4));
+	}
+
+	return forms;
+}
+
+QStringList UrlIndex::createWords(const QString &text)
+{
+	const QString lowerCaseText(text.toLower());
+	QStringList words;
+	int start(-1);
+
+	for (int i = 0; i <= lowerCaseText.length(); ++i)
+	{
+		if (i < lowerCaseText.length() && lowerCaseText.at(i).isLetterOrNumber())
+		{
+			if (start < 0)
+			{
+				start = i;
+			}
+
+			continue;
+		}
+
+		if (start >= 0 && (i - start) > 1)
+		{
+			words.append(lowerCaseText.mid(start, (i - start)));
+		}
+
+		start = -1;
+	}
+
+	return words;
+}
+
+QStringList UrlIndex::createUrlWords(const QUrl &url)
+{
+	QStringList labels(url.host().toLower().split(QLatin1Char('.'), QString::SkipEmptyParts));
+
+///NOTE Scheme, www prefix and top level domain are shared by most addresses, matching them would flood results for short filters
+	if (labels.count() > 1)
+	{
+		labels.removeLast();
+	}
+
+	if (!labels.isEmpty() && labels.first() == QLatin1String("www"))
+	{
+		labels.removeFirst();
+	}
+
+	QStringList words(createWords(labels.join(QLatin1Char(' '))));
+	const QStringList pathWords(createWords(url.toString(QUrl::RemoveScheme | QUrl::RemoveAuthority)));
+
+	for (int i = 0; i < pathWords.count(); ++i)
+	{
+		if (pathWords.at(i) != QLatin1String("http") && pathWords.at(i) != QLatin1String("https") && pathWords.at(i) != QLatin1String("www"))
+		{
+			words.append(pathWords.at(i));
+		}
+	}
+
+	return words;
+}
+
+QList<UrlIndex::UrlMatch> UrlIndex::findUrls(const QString &prefix, bool matchWords, int limit) const
+{
+	QList<UrlMatch> matches;
+
+	if (prefix.isEmpty())
+	{
+		return matches;
+	}
+
+	const QString lowerCasePrefix(prefix.toLower());
+	QHash<quint32, int> matchedForms;
+	QMultiMap<QString, quint32>::const_iterator formsIterator;
+
+///NOTE Forms are checked in the same order as by Utils::matchUrl(), first matching one is used
+	for (formsIterator = m_forms.lowerBound(lowerCasePrefix); formsIterator != m_forms.constEnd() && formsIterator.key().startsWith(lowerCasePrefix); ++formsIterator)
+	{
+		const quint32 record(formsIterator.value() >> 2);
+		const int form(formsIterator.value() & 3);
+
+		if (limit > 0 && matchedForms.count() >= limit && !matchedForms.contains(record))
+		{
+			break;
+		}
+
+		if (!matchedForms.contains(record) || form < matchedForms.value(record))
+		{
+			matchedForms[record] = form;
+		}
+	}
+
+	QHash<quint32, int>::const_iterator matchesIterator;
+
+	for (matchesIterator = matchedForms.constBegin(); matchesIterator != matchedForms.constEnd(); ++matchesIterator)
+	{
+		UrlMatch match;
+		match.identifier = m_records.at(matchesIterator.key()).identifier;
+		match.match = m_records.at(matchesIterator.key()).forms.value(matchesIterator.value());
+
+		matches.append(match);
+	}
+
+	if (!matchWords || (limit > 0 && matches.count() >= limit))
+	{
+		return matches;
+	}
+
+	for (int i = 0; i < lowerCasePrefix.length(); ++i)
+	{
+		if (!lowerCasePrefix.at(i).isLetterOrNumber())
+		{
+			return matches;
+		}
+	}
+
+	QSet<quint32> matchedWords;
+	QMap<QString, QVector<quint32> >::const_iterator wordsIterator;
+
+	for (wordsIterator = m_words.lowerBound(lowerCasePrefix); wordsIterator != m_words.constEnd() && wordsIterator.key().startsWith(lowerCasePrefix); ++wordsIterator)
+	{
+		const QVector<quint32> &records(wordsIterator.value());
+
+		for (int i = 0; i < records.count(); ++i)
+		{
+			const quint32 record(records.at(i));
+
+			if (m_records.at(record).isRemoved || matchedForms.contains(record) || matchedWords.contains(record))
+			{
+				continue;
+			}
+
+			matchedWords.insert(record);
+
+			UrlMatch match;
+			match.identifier = m_records.at(record).identifier;
+
+			matches.append(match);
+
+			if (limit > 0 && matches.count() >= limit)
+			{
+				return matches;
+			}
+		}
+	}
+
+	return matches;
+}
+
+///NOTE Checks single URL the same way as findUrls(), so earlier results can be narrowed down without querying index again
+bool UrlIndex::matchUrl(const QUrl &url, const QString &title, const QString &prefix, QString &match)
+{
+	match = QString();
+
+	if (prefix.isEmpty())
+	{
+		return false;
+	}
+
+	const QStringList forms(createForms(url));
+
+	for (int i = 0; i < forms.count(); ++i)
+	{
+		if (forms.at(i).startsWith(prefix, Qt::CaseInsensitive))
+		{
+			match = forms.at(i);
+
+			return true;
+		}
+	}
+
+	const QString lowerCasePrefix(prefix.toLower());
+
+	for (int i = 0; i < lowerCasePrefix.length(); ++i)
+	{
+		if (!lowerCasePrefix.at(i).isLetterOrNumber())
+		{
+			return false;
+		}
+	}
+
+	const QStringList words(createWords(title) + createUrlWords(url));
+
+	for (int i = 0; i < words.count(); ++i)
+	{
+		if (words.at(i).startsWith(lowerCasePrefix))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool UrlIndex::hasUrl(quint64 identifier) const
+{
+	return m_identifiers.contains(identifier);
+}
+
+}
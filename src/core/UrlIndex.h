@@ -0,0 +1,77 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#ifndef OTTER_URLINDEX_H
+#define OTTER_URLINDEX_H
+
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QUrl>
+#include <QtCore/QVector>
+
+namespace Otter
+{
+
+class UrlIndex
+{
+public:
+	struct UrlMatch
+	{
+		QString match;
+		quint64 identifier;
+
+		UrlMatch() : identifier(0) {}
+	};
+
+	UrlIndex();
+
+	void addUrl(quint64 identifier, const QUrl &url, const QString &title = QString());
+	void removeUrl(quint64 identifier);
+	void clear();
+	QList<UrlMatch> findUrls(const QString &prefix, bool matchWords = true, int limit = 0) const;
+	bool hasUrl(quint64 identifier) const;
+	static bool matchUrl(const QUrl &url, const QString &title, const QString &prefix, QString &match);
+
+protected:
+	struct UrlRecord
+	{
+		QUrl url;
+		QString title;
+		QStringList forms;
+		quint64 identifier;
+		bool isRemoved;
+	};
+
+	void addWords(const QStringList &words, quint32 record);
+	void rebuild();
+	static QStringList createForms(const QUrl &url);
+	static QStringList createWords(const QString &text);
+	static QStringList createUrlWords(const QUrl &url);
+
+private:
+	QVector<UrlRecord> m_records;
+	QHash<quint64, quint32> m_identifiers;
+	QMultiMap<QString, quint32> m_forms;
+	QMap<QString, QVector<quint32> > m_words;
+	int m_removedRecords;
+};
+
+}
+
+#endif
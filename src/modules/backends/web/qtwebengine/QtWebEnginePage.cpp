@@ -93,23 +93,15 @@ void QtWebEnginePage::handlePageLoaded(const QString &result)
 	{
 		const QVector<int> profiles(ContentBlockingManager::getProfileList(m_widget->getOption(QLatin1String("Content/BlockingProfiles"), url()).toStringList()));
 
-		if (!profiles.isEmpty())
-		{
-			const QStringList domainList(ContentBlockingManager::createSubdomainList(url().host()));
-			QStringList styleSheetBlackList(ContentBlockingManager::getStyleSheet(profiles));
-			QStringList styleSheetWhiteList;
-
-			for (int i = 0; i < domainList.count(); ++i)
-			{
-				styleSheetBlackList += ContentBlockingManager::getStyleSheetBlackList(domainList.at(i), profiles);
-				styleSheetWhiteList += ContentBlockingManager::getStyleSheetWhiteList(domainList.at(i), profiles);
-			}
+		const QString styleSheet(ContentBlockingManager::getElementHidingStyleSheet(url().host(), profiles));
 
+		if (!styleSheet.isEmpty())
+		{
 			QFile file(QLatin1String(":/modules/backends/web/qtwebengine/resources/hideElements.js"));
 
 			if (file.open(QIODevice::ReadOnly))
 			{
-				runJavaScript(QString(file.readAll()).arg(createJavaScriptList(styleSheetWhiteList)).arg(createJavaScriptList(styleSheetBlackList)));
+				runJavaScript(QString(file.readAll()).arg(createJavaScriptList(QStringList(styleSheet))));
 
 				file.close();
 			}
@@ -273,7 +265,7 @@ QString QtWebEnginePage::createJavaScriptList(QStringList rules) const
 
 	for (int i = 0; i < rules.count(); ++i)
 	{
-		rules[i] = rules[i].replace(QLatin1Char('\''), QLatin1String("\\'"));
+		rules[i] = rules[i].replace(QLatin1Char('\\'), QLatin1String("\\\\")).replace(QLatin1Char('\''), QLatin1String("\\'"));
 	}
 
 	return QStringLiteral("'%1'").arg(rules.join("','"));
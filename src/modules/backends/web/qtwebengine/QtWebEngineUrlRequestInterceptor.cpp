@@ -53,14 +53,18 @@ void QtWebEngineUrlRequestInterceptor::optionChanged(const QString &option)
 
 void QtWebEngineUrlRequestInterceptor::clearContentBlockingInformation()
 {
+	m_mutex.lock();
 	m_blockedElements.clear();
 	m_contentBlockingProfiles.clear();
+	m_mutex.unlock();
 
 	QTimer::singleShot(1800000, this, SLOT(clearContentBlockingInformation()));
 }
 
 QStringList QtWebEngineUrlRequestInterceptor::getBlockedElements(const QString &domain) const
 {
+	QMutexLocker locker(&m_mutex);
+
 	return m_blockedElements.value(domain);
 }
 
@@ -73,6 +77,8 @@ void QtWebEngineUrlRequestInterceptor::interceptRequest(QWebEngineUrlRequestInfo
 		return;
 	}
 
+	m_mutex.lock();
+
 	if (!m_contentBlockingProfiles.contains(request.firstPartyUrl().host()))
 	{
 		m_contentBlockingProfiles[request.firstPartyUrl().host()] = ContentBlockingManager::getProfileList(SettingsManager::getValue(QLatin1String("Content/BlockingProfiles"), request.firstPartyUrl()).toStringList());
@@ -80,6 +86,8 @@ void QtWebEngineUrlRequestInterceptor::interceptRequest(QWebEngineUrlRequestInfo
 
 	const QVector<int> contentBlockingProfiles(m_contentBlockingProfiles.value(request.firstPartyUrl().host()));
 
+	m_mutex.unlock();
+
 	if (contentBlockingProfiles.isEmpty())
 	{
 		const NetworkManagerFactory::DoNotTrackPolicy doNotTrackPolicy(NetworkManagerFactory::getDoNotTrackPolicy());
@@ -136,11 +144,15 @@ void QtWebEngineUrlRequestInterceptor::interceptRequest(QWebEngineUrlRequestInfo
 
 	if (result.isBlocked)
 	{
+		m_mutex.lock();
+
 		if (storeBlockedUrl && !m_blockedElements.value(request.firstPartyUrl().host()).contains(request.requestUrl().url()))
 		{
 			m_blockedElements[request.firstPartyUrl().host()].append(request.requestUrl().url());
 		}
 
+		m_mutex.unlock();
+
 		Console::addMessage(QCoreApplication::translate("main", "Blocked request"), Otter::NetworkMessageCategory, LogMessageLevel, request.requestUrl().toString(), -1);
 
 		request.block(true);
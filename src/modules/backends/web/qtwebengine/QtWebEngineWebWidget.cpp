@@ -21,6 +21,7 @@
 #include "QtWebEnginePage.h"
 #include "../../../../core/BookmarksManager.h"
 #include "../../../../core/Console.h"
+#include "../../../../core/ContentBlockingManager.h"
 #include "../../../../core/GesturesManager.h"
 #include "../../../../core/HistoryManager.h"
 #include "../../../../core/NetworkManager.h"
@@ -202,6 +203,11 @@ void QtWebEngineWebWidget::pageLoadFinished()
 	updateNavigationActions();
 	startReloadTimer();
 
+	if (!isPrivate())
+	{
+		m_webView->page()->toPlainText(invoke(this, &QtWebEngineWebWidget::handlePageText));
+	}
+
 	emit contentStateChanged(getContentState());
 	emit loadingStateChanged(WindowsManager::FinishedLoadingState);
 }
@@ -956,6 +962,11 @@ void QtWebEngineWebWidget::handleImageProperties(const QVariant &result)
 	showDialog(&dialog);
 }
 
+void QtWebEngineWebWidget::handlePageText(const QString &text)
+{
+	HistoryManager::indexPage(getUrl(), getTitle(), text);
+}
+
 void QtWebEngineWebWidget::handleFullScreenRequest(QWebEngineFullScreenRequest request)
 {
 	request.accept();
@@ -1565,7 +1576,7 @@ QHash<QByteArray, QByteArray> QtWebEngineWebWidget::getHeaders() const
 
 QVariantHash QtWebEngineWebWidget::getStatistics() const
 {
-	return QVariantHash();
+	return ContentBlockingManager::getStatistics();
 }
 
 WindowsManager::LoadingState QtWebEngineWebWidget::getLoadingState() const
@@ -83,6 +83,7 @@ protected:
 	void handleEditingCheck(const QVariant &result);
 	void handleHitTest(const QVariant &result);
 	void handleImageProperties(const QVariant &result);
+	void handlePageText(const QString &text);
 	void handleScroll(const QVariant &result);
 	void handleScrollToAnchor(const QVariant &result);
 	void updateOptions(const QUrl &url);
@@ -25,32 +25,151 @@ namespace Otter
 
 QtWebKitHistoryInterface::QtWebKitHistoryInterface(QObject *parent) : QWebHistoryInterface(parent)
 {
-	connect(HistoryManager::getBrowsingHistoryModel(), SIGNAL(cleared()), this, SLOT(clear()));
+	HistoryModel *model(HistoryManager::getBrowsingHistoryModel());
+
+	m_entries.reserve(model->rowCount());
+	m_fingerprints.reserve(model->rowCount());
+
+	addEntries(QModelIndex(), 0, (model->rowCount() - 1));
+	updateUnloadedEntries();
+
+	connect(model, SIGNAL(cleared()), this, SLOT(clear()));
+	connect(model, SIGNAL(entryAdded(quint64)), this, SLOT(addEntry(quint64)));
+	connect(model, SIGNAL(entryModified(quint64)), this, SLOT(modifyEntry(quint64)));
+	connect(model, SIGNAL(entryRemoved(quint64)), this, SLOT(removeEntry(quint64)));
+	connect(model, SIGNAL(entriesRemoved(QList<quint64>)), this, SLOT(removeEntries(QList<quint64>)));
+	connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(addEntries(QModelIndex,int,int)));
+	connect(model, SIGNAL(unloadedEntriesChanged()), this, SLOT(updateUnloadedEntries()));
 }
 
 void QtWebKitHistoryInterface::clear()
 {
-	m_urls.clear();
+	m_entries.clear();
+	m_fingerprints.clear();
+	m_unloadedFingerprints.clear();
 }
 
-void QtWebKitHistoryInterface::addHistoryEntry(const QString &url)
+void QtWebKitHistoryInterface::addEntry(quint64 identifier)
 {
-	if (m_urls.contains(url))
+	const HistoryModel::HistoryEntry entry(HistoryManager::getBrowsingHistoryModel()->getEntry(identifier));
+
+	if (entry.identifier == 0 || m_entries.contains(identifier))
 	{
 		return;
 	}
 
-	m_urls.append(url);
+	const quint64 fingerprint(createFingerprint(entry.url.toString(QUrl::FullyEncoded)));
+
+	m_entries[identifier] = fingerprint;
+
+	addFingerprint(fingerprint);
+}
+
+///NOTE Older entries are paged in on demand, so they are added as soon as they become available
+void QtWebKitHistoryInterface::addEntries(const QModelIndex &parent, int first, int last)
+{
+	HistoryModel *model(HistoryManager::getBrowsingHistoryModel());
+
+	for (int i = first; i <= last; ++i)
+	{
+		const QModelIndex index(model->index(i, 0, parent));
+		const quint64 identifier(index.data(HistoryModel::IdentifierRole).toULongLong());
+
+		if (identifier == 0 || m_entries.contains(identifier))
+		{
+			continue;
+		}
+
+		const quint64 fingerprint(createFingerprint(index.data(HistoryModel::UrlRole).toUrl().toString(QUrl::FullyEncoded)));
+
+		m_entries[identifier] = fingerprint;
+
+		addFingerprint(fingerprint);
+	}
+}
+
+void QtWebKitHistoryInterface::modifyEntry(quint64 identifier)
+{
+	removeEntry(identifier);
+	addEntry(identifier);
+}
+
+void QtWebKitHistoryInterface::removeEntry(quint64 identifier)
+{
+	if (m_entries.contains(identifier))
+	{
+		removeFingerprint(m_entries.take(identifier));
+	}
+}
+
+void QtWebKitHistoryInterface::removeEntries(const QList<quint64> &identifiers)
+{
+	for (int i = 0; i < identifiers.count(); ++i)
+	{
+		removeEntry(identifiers.at(i));
+	}
+}
+
+void QtWebKitHistoryInterface::updateUnloadedEntries()
+{
+	const QList<QUrl> urls(HistoryManager::getBrowsingHistoryModel()->getUnloadedUrls());
+
+	m_unloadedFingerprints.clear();
+	m_unloadedFingerprints.reserve(urls.count());
 
-	if (m_urls.length() > 100)
+	for (int i = 0; i < urls.count(); ++i)
 	{
-		m_urls.removeAt(0);
+		m_unloadedFingerprints.insert(createFingerprint(urls.at(i).toString(QUrl::FullyEncoded)));
 	}
 }
 
+void QtWebKitHistoryInterface::addFingerprint(quint64 fingerprint)
+{
+	++m_fingerprints[fingerprint];
+}
+
+void QtWebKitHistoryInterface::removeFingerprint(quint64 fingerprint)
+{
+	QHash<quint64, int>::iterator iterator(m_fingerprints.find(fingerprint));
+
+	if (iterator != m_fingerprints.end() && --iterator.value() <= 0)
+	{
+		m_fingerprints.erase(iterator);
+	}
+}
+
+void QtWebKitHistoryInterface::addHistoryEntry(const QString &url)
+{
+	const quint64 fingerprint(createFingerprint(url));
+
+///NOTE Visits which were not stored in history are remembered until it is cleared
+	if (!m_fingerprints.contains(fingerprint))
+	{
+		addFingerprint(fingerprint);
+	}
+}
+
+///NOTE FNV-1a hash computed directly over characters, so lookup for each rendered link does not need to parse or copy its address
+quint64 QtWebKitHistoryInterface::createFingerprint(const QString &url)
+{
+	const QChar *data(url.constData());
+	const int length(url.length());
+	quint64 fingerprint(Q_UINT64_C(14695981039346656037));
+
+	for (int i = 0; i < length; ++i)
+	{
+		fingerprint ^= data[i].unicode();
+		fingerprint *= Q_UINT64_C(1099511628211);
+	}
+
+	return fingerprint;
+}
+
 bool QtWebKitHistoryInterface::historyContains(const QString &url) const
 {
-	return (m_urls.contains(url) || HistoryManager::hasEntry(url));
+	const quint64 fingerprint(createFingerprint(url));
+
+	return (m_fingerprints.contains(fingerprint) || m_unloadedFingerprints.contains(fingerprint));
 }
 
 }
@@ -20,7 +20,9 @@
 #ifndef OTTER_QTWEBKITHISTORYINTERFACE_H
 #define OTTER_QTWEBKITHISTORYINTERFACE_H
 
-#include <QtCore/QStringList>
+#include <QtCore/QHash>
+#include <QtCore/QModelIndex>
+#include <QtCore/QSet>
 #include <QtWebKit/QWebHistoryInterface>
 
 namespace Otter
@@ -36,11 +38,24 @@ public:
 	void addHistoryEntry(const QString &url);
 	bool historyContains(const QString &url) const;
 
+protected:
+	void addFingerprint(quint64 fingerprint);
+	void removeFingerprint(quint64 fingerprint);
+	static quint64 createFingerprint(const QString &url);
+
 protected slots:
 	void clear();
+	void addEntry(quint64 identifier);
+	void addEntries(const QModelIndex &parent, int first, int last);
+	void modifyEntry(quint64 identifier);
+	void removeEntry(quint64 identifier);
+	void removeEntries(const QList<quint64> &identifiers);
+	void updateUnloadedEntries();
 
 private:
-	QStringList m_urls;
+	QHash<quint64, quint64> m_entries;
+	QHash<quint64, int> m_fingerprints;
+	QSet<quint64> m_unloadedFingerprints;
 };
 
 }
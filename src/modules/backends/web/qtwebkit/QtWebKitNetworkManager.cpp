@@ -36,6 +36,7 @@
 #include "../../../../ui/ContentsDialog.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QJsonArray>
 #include <QtCore/QJsonDocument>
@@ -615,6 +616,24 @@ QNetworkReply* QtWebKitNetworkManager::createRequest(QNetworkAccessManager::Oper
 					resourceType = ContentBlockingManager::XmlHttpRequestType;
 				}
 
+#ifndef QT_NO_DEBUG
+				static QFile corpusFile(QString::fromLocal8Bit(qgetenv("OTTER_CONTENT_BLOCKING_CORPUS")));
+				static const bool isCorpusOpen(!corpusFile.fileName().isEmpty() && corpusFile.open(QIODevice::WriteOnly | QIODevice::Append));
+				static int corpusLines(0);
+
+				if (isCorpusOpen)
+				{
+					corpusFile.write(QStringLiteral("%1\t%2\t%3\n").arg(m_widget->getUrl().url()).arg(request.url().url()).arg(resourceType).toUtf8());
+
+					++corpusLines;
+
+					if (corpusLines % 100 == 0)
+					{
+						corpusFile.flush();
+					}
+				}
+#endif
+
 				const ContentBlockingManager::CheckResult result(ContentBlockingManager::checkUrl(m_contentBlockingProfiles, m_widget->getUrl(), request.url(), resourceType));
 
 				if (result.isBlocked)
@@ -742,7 +761,7 @@ QHash<QByteArray, QByteArray> QtWebKitNetworkManager::getHeaders() const
 
 QVariantHash QtWebKitNetworkManager::getStatistics() const
 {
-	QVariantHash statistics;
+	QVariantHash statistics(ContentBlockingManager::getStatistics());
 	statistics[QLatin1String("dateDownloaded")] = m_dateDownloaded;
 	statistics[QLatin1String("bytesReceived")] = m_bytesReceived;
 	statistics[QLatin1String("bytesTotal")] = m_bytesTotal;
@@ -92,21 +92,6 @@ void QtWebKitPage::pageLoadFinished()
 
 	updateStyleSheets();
 
-	if (m_widget)
-	{
-		const QVector<int> profiles(ContentBlockingManager::getProfileList(m_widget->getOption(QLatin1String("Content/BlockingProfiles"), m_widget->getUrl()).toStringList()));
-
-		applyContentBlockingRules(ContentBlockingManager::getStyleSheet(profiles), true);
-
-		const QStringList domainList(ContentBlockingManager::createSubdomainList(m_widget->getUrl().host()));
-
-		for (int i = 0; i < domainList.count(); ++i)
-		{
-			applyContentBlockingRules(ContentBlockingManager::getStyleSheetBlackList(domainList.at(i), profiles), true);
-			applyContentBlockingRules(ContentBlockingManager::getStyleSheetWhiteList(domainList.at(i), profiles), false);
-		}
-	}
-
 	const QStringList blockedRequests(m_widget->getBlockedElements());
 
 	if (blockedRequests.count() > 0)
@@ -149,27 +134,6 @@ void QtWebKitPage::markAsPopup()
 	m_isPopup = true;
 }
 
-void QtWebKitPage::applyContentBlockingRules(const QStringList &rules, bool remove)
-{
-	const QWebElement document(mainFrame()->documentElement());
-	const QString value(remove ? QLatin1String("none !important") : QString());
-
-	for (int i = 0; i < rules.count(); ++i)
-	{
-		const QWebElementCollection elements(document.findAll(rules.at(i)));
-
-		for (int j = 0; j < elements.count(); ++j)
-		{
-			QWebElement element(elements.at(j));
-
-			if (!element.isNull())
-			{
-				element.setStyleProperty(QLatin1String("display"), value);
-			}
-		}
-	}
-}
-
 void QtWebKitPage::updateStyleSheets(const QUrl &url)
 {
 	const QUrl currentUrl(url.isEmpty() ? mainFrame()->url() : url);
@@ -199,6 +163,11 @@ void QtWebKitPage::updateStyleSheets(const QUrl &url)
 		styleSheet.append(QLatin1String("body::-webkit-scrollbar {display:none;}"));
 	}
 
+	if (m_widget)
+	{
+		styleSheet.append(ContentBlockingManager::getElementHidingStyleSheet(currentUrl.host(), ContentBlockingManager::getProfileList(m_widget->getOption(QLatin1String("Content/BlockingProfiles"), currentUrl).toStringList())));
+	}
+
 	const QString userSyleSheet(m_widget ? m_widget->getOption(QLatin1String("Content/UserStyleSheet"), currentUrl).toString() : QString());
 
 	if (!userSyleSheet.isEmpty())
@@ -303,6 +303,11 @@ void QtWebKitWebWidget::pageLoadFinished()
 	handleHistory();
 	startReloadTimer();
 
+	if (!isPrivate())
+	{
+		HistoryManager::indexPage(getUrl(), getTitle(), m_page->mainFrame()->toPlainText());
+	}
+
 	emit contentStateChanged(getContentState());
 	emit loadingStateChanged(WindowsManager::FinishedLoadingState);
 
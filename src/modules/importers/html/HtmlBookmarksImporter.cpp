@@ -192,6 +192,8 @@ bool HtmlBookmarksImporter::import(const QString &path)
 		return false;
 	}
 
+	BookmarksManager::beginBatch();
+
 	if (m_optionsWidget)
 	{
 		if (m_optionsWidget->hasToRemoveExisting())
@@ -215,6 +217,8 @@ bool HtmlBookmarksImporter::import(const QString &path)
 
 	processElement(page.mainFrame()->documentElement());
 
+	BookmarksManager::endBatch();
+
 	file.close();
 
 	return true;
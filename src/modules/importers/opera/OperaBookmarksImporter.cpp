@@ -131,6 +131,8 @@ bool OperaBookmarksImporter::import(const QString &path)
 		return false;
 	}
 
+	BookmarksManager::beginBatch();
+
 	if (m_optionsWidget)
 	{
 		if (m_optionsWidget->hasToRemoveExisting())
@@ -246,6 +248,8 @@ bool OperaBookmarksImporter::import(const QString &path)
 		}
 	}
 
+	BookmarksManager::endBatch();
+
 	file.close();
 
 	return true;
@@ -18,12 +18,13 @@
 **************************************************************************/
 
 #include "HistoryContentsWidget.h"
+#include "HistoryGroupsModel.h"
 #include "../../../core/ActionsManager.h"
 #include "../../../core/ThemesManager.h"
-#include "../../../core/Utils.h"
 
 #include "ui_HistoryContentsWidget.h"
 
+#include <QtConcurrent/QtConcurrentRun>
 #include <QtCore/QTimer>
 #include <QtGui/QClipboard>
 #include <QtGui/QMouseEvent>
@@ -33,50 +34,65 @@ namespace Otter
 {
 
 HistoryContentsWidget::HistoryContentsWidget(Window *window) : ContentsWidget(window),
-	m_model(new QStandardItemModel(this)),
+	m_model(new HistoryGroupsModel(HistoryManager::getBrowsingHistoryModel(), this)),
+	m_filterGeneration(0),
+	m_filterTimer(0),
 	m_isLoading(true),
 	m_ui(new Ui::HistoryContentsWidget)
 {
 	m_ui->setupUi(this);
-
-	const QStringList groups({tr("Today"), tr("Yesterday"), tr("Earlier This Week"), tr("Previous Week"), tr("Earlier This Month"), tr("Earlier This Year"), tr("Older")});
-
-	for (int i = 0; i < groups.count(); ++i)
-	{
-		m_model->appendRow(new QStandardItem(ThemesManager::getIcon(QLatin1String("inode-directory")), groups.at(i)));
-	}
-
-	m_model->setHorizontalHeaderLabels(QStringList({tr("Address"), tr("Title"), tr("Date")}));
-	m_model->setSortRole(Qt::DisplayRole);
-
 	m_ui->historyViewWidget->setViewMode(ItemViewWidget::TreeViewMode);
 	m_ui->historyViewWidget->setModel(m_model, true);
+	m_ui->historyViewWidget->setFilterRoles(QSet<int>({Qt::DisplayRole, HistoryGroupsModel::ContentsMatchRole}));
 	m_ui->historyViewWidget->installEventFilter(this);
 	m_ui->historyViewWidget->viewport()->installEventFilter(this);
 	m_ui->filterLineEdit->installEventFilter(this);
 
-	for (int i = 0; i < m_model->rowCount(); ++i)
-	{
-		m_ui->historyViewWidget->setRowHidden(i, m_model->invisibleRootItem()->index(), true);
-	}
+	updateGroups();
 
 	QTimer::singleShot(100, this, SLOT(populateEntries()));
 
-	connect(HistoryManager::getBrowsingHistoryModel(), SIGNAL(cleared()), this, SLOT(populateEntries()));
-	connect(HistoryManager::getBrowsingHistoryModel(), SIGNAL(entryAdded(HistoryEntryItem*)), this, SLOT(addEntry(HistoryEntryItem*)));
-	connect(HistoryManager::getBrowsingHistoryModel(), SIGNAL(entryModified(HistoryEntryItem*)), this, SLOT(modifyEntry(HistoryEntryItem*)));
-	connect(HistoryManager::getBrowsingHistoryModel(), SIGNAL(entryRemoved(HistoryEntryItem*)), this, SLOT(removeEntry(HistoryEntryItem*)));
-	connect(HistoryManager::getInstance(), SIGNAL(dayChanged()), this, SLOT(populateEntries()));
-	connect(m_ui->filterLineEdit, SIGNAL(textChanged(QString)), m_ui->historyViewWidget, SLOT(setFilterString(QString)));
+	connect(m_model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(handleEntriesInserted(QModelIndex)));
+	connect(m_model, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(updateGroups()));
+	connect(m_model, SIGNAL(modelReset()), this, SLOT(updateGroups()));
+	connect(HistoryManager::getInstance(), SIGNAL(dayChanged()), m_model, SLOT(updateGroups()));
+	connect(m_ui->filterLineEdit, SIGNAL(textChanged(QString)), this, SLOT(filterEntries(QString)));
 	connect(m_ui->historyViewWidget, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(openEntry(QModelIndex)));
 	connect(m_ui->historyViewWidget, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(showContextMenu(QPoint)));
 }
 
 HistoryContentsWidget::~HistoryContentsWidget()
 {
+	m_filterGeneration.fetchAndAddOrdered(1);
+	m_pagesFuture.waitForFinished();
+
 	delete m_ui;
 }
 
+void HistoryContentsWidget::timerEvent(QTimerEvent *event)
+{
+	if (event->timerId() == m_filterTimer)
+	{
+		killTimer(m_filterTimer);
+
+		m_filterTimer = 0;
+
+		const QString filter(m_ui->filterLineEdit->text());
+
+///NOTE Only loaded entries are matched, older ones are paged in by view as long as it is not filled yet
+		m_ui->historyViewWidget->setFilterString(filter);
+
+		if (!filter.isEmpty() && HistoryManager::getFullTextIndex())
+		{
+			m_pagesFuture = QtConcurrent::run(this, &HistoryContentsWidget::findPages, HistoryManager::getFullTextIndex(), filter, m_filterGeneration.load());
+		}
+	}
+	else
+	{
+		ContentsWidget::timerEvent(event);
+	}
+}
+
 void HistoryContentsWidget::changeEvent(QEvent *event)
 {
 	QWidget::changeEvent(event);
@@ -115,42 +131,11 @@ void HistoryContentsWidget::print(QPrinter *printer)
 
 void HistoryContentsWidget::populateEntries()
 {
-	const QDate date(QDate::currentDate());
-	const QList<QDate> dates({date, date.addDays(-1), date.addDays(-7), date.addDays(-14), date.addDays(-30), date.addDays(-365)});
-
-	for (int i = 0; i < m_model->rowCount(); ++i)
-	{
-		QStandardItem *groupItem(m_model->item(i, 0));
-
-		if (groupItem)
-		{
-			groupItem->setData(dates.value(i, QDate()), Qt::UserRole);
-			groupItem->removeRows(0, groupItem->rowCount());
-		}
-	}
-
-	HistoryModel *model(HistoryManager::getBrowsingHistoryModel());
-
-	for (int i = 0; i < model->rowCount(); ++i)
-	{
-		addEntry(dynamic_cast<HistoryEntryItem*>(model->item(i, 0)));
-	}
-
 	const QString expandBranches(SettingsManager::getValue(QLatin1String("History/ExpandBranches")).toString());
 
 	if (expandBranches == QLatin1String("first"))
 	{
-		for (int i = 0; i < m_model->rowCount(); ++i)
-		{
-			const QModelIndex index(m_model->index(i, 0));
-
-			if (m_model->rowCount(index) > 0)
-			{
-				m_ui->historyViewWidget->expand(m_ui->historyViewWidget->getProxyModel()->mapFromSource(index));
-
-				break;
-			}
-		}
+		expandFirstGroup();
 	}
 	else if (expandBranches == QLatin1String("all"))
 	{
@@ -162,102 +147,104 @@ void HistoryContentsWidget::populateEntries()
 	emit loadingStateChanged(WindowsManager::FinishedLoadingState);
 }
 
-void HistoryContentsWidget::addEntry(HistoryEntryItem *entry)
+void HistoryContentsWidget::filterEntries(const QString &filter)
 {
-	if (!entry || entry->data(HistoryModel::IdentifierRole).toULongLong() == 0 || findEntry(entry->data(HistoryModel::IdentifierRole).toULongLong()))
+	m_filterGeneration.fetchAndAddOrdered(1);
+
+	if (m_filterTimer != 0)
 	{
-		return;
+		killTimer(m_filterTimer);
+
+		m_filterTimer = 0;
 	}
 
-	QStandardItem *groupItem(NULL);
+	m_model->setContentsMatches(QString(), QSet<QUrl>());
 
-	for (int i = 0; i < m_model->rowCount(); ++i)
+	if (filter.isEmpty())
+	{
+		m_ui->historyViewWidget->setFilterString(filter);
+	}
+	else
 	{
-		groupItem = m_model->item(i, 0);
+		m_filterTimer = startTimer(200);
+	}
+}
 
-		if (groupItem && (entry->data(HistoryModel::TimeVisitedRole).toDateTime().date() >= groupItem->data(Qt::UserRole).toDate() || !groupItem->data(Qt::UserRole).toDate().isValid()))
-		{
-			break;
-		}
+void HistoryContentsWidget::findPages(FullTextIndex *index, const QString &filter, int generation)
+{
+	const QList<FullTextIndex::DocumentMatch> matches(index->findDocuments(filter));
+	QStringList urls;
 
-		groupItem = NULL;
+	if (generation != m_filterGeneration.load())
+	{
+		return;
 	}
 
-	if (!groupItem)
+	for (int i = 0; i < matches.count(); ++i)
 	{
-		return;
+		urls.append(matches.at(i).url.toString());
 	}
 
-	QList<QStandardItem*> entryItems({new QStandardItem((entry->icon().isNull() ? ThemesManager::getIcon(QLatin1String("text-html")) : entry->icon()), entry->data(HistoryModel::UrlRole).toUrl().toDisplayString().replace(QLatin1String("%23"), QString(QLatin1Char('#')))), new QStandardItem(entry->data(HistoryModel::TitleRole).isNull() ? tr("(Untitled)") : entry->data(HistoryModel::TitleRole).toString()), new QStandardItem(Utils::formatDateTime(entry->data(HistoryModel::TimeVisitedRole).toDateTime()))});
-	entryItems[0]->setData(entry->data(HistoryModel::IdentifierRole).toULongLong(), Qt::UserRole);
-	entryItems[0]->setFlags(entryItems[0]->flags() | Qt::ItemNeverHasChildren);
-	entryItems[1]->setFlags(entryItems[1]->flags() | Qt::ItemNeverHasChildren);
-	entryItems[2]->setFlags(entryItems[2]->flags() | Qt::ItemNeverHasChildren);
+	QMetaObject::invokeMethod(this, "handlePages", Qt::QueuedConnection, Q_ARG(QStringList, urls), Q_ARG(QString, filter), Q_ARG(int, generation));
+}
 
-	groupItem->appendRow(entryItems);
+void HistoryContentsWidget::handlePages(const QStringList &urls, const QString &filter, int generation)
+{
+	if (generation != m_filterGeneration.load())
+	{
+		return;
+	}
 
-	m_ui->historyViewWidget->setRowHidden(groupItem->row(), groupItem->index().parent(), false);
+///NOTE Entries whose page contents contain all words are matched too, as if filter was part of their text
+	QSet<QUrl> matches;
 
-	if (sender() && groupItem->rowCount() == 1 && SettingsManager::getValue(QLatin1String("History/ExpandBranches")).toString() == QLatin1String("first"))
+	for (int i = 0; i < urls.count(); ++i)
 	{
-		for (int i = 0; i < m_model->rowCount(); ++i)
-		{
-			const QModelIndex index(m_model->index(i, 0));
+		matches.insert(QUrl(urls.at(i)));
+	}
 
-			if (m_model->rowCount(index) > 0)
-			{
-				m_ui->historyViewWidget->expand(m_ui->historyViewWidget->getProxyModel()->mapFromSource(index));
+	m_model->setContentsMatches(filter, matches);
 
-				break;
-			}
-		}
-	}
+	m_ui->historyViewWidget->updateFilter();
 }
 
-void HistoryContentsWidget::modifyEntry(HistoryEntryItem *entry)
+void HistoryContentsWidget::expandFirstGroup()
 {
-	if (!entry || entry->data(HistoryModel::IdentifierRole).toULongLong() == 0)
+	for (int i = 0; i < m_model->rowCount(); ++i)
 	{
-		return;
-	}
+		const QModelIndex index(m_model->index(i, 0));
+
+		if (m_model->rowCount(index) > 0)
+		{
+			m_ui->historyViewWidget->expand(m_ui->historyViewWidget->getProxyModel()->mapFromSource(index));
 
-	QStandardItem *entryItem(findEntry(entry->data(HistoryModel::IdentifierRole).toULongLong()));
+			break;
+		}
+	}
+}
 
-	if (!entryItem)
+void HistoryContentsWidget::updateGroups()
+{
+	for (int i = 0; i < m_model->rowCount(); ++i)
 	{
-		addEntry(entry);
+		const QModelIndex index(m_model->index(i, 0));
 
-		return;
+		m_ui->historyViewWidget->setRowHidden(m_ui->historyViewWidget->getProxyModel()->mapFromSource(index).row(), QModelIndex(), (m_model->rowCount(index) == 0));
 	}
-
-	entryItem->setIcon(entry->icon().isNull() ? ThemesManager::getIcon(QLatin1String("text-html")) : entry->icon());
-	entryItem->setText(entry->data(HistoryModel::UrlRole).toUrl().toDisplayString());
-	entryItem->parent()->child(entryItem->row(), 1)->setText(entry->data(HistoryModel::TitleRole).isNull() ? tr("(Untitled)") : entry->data(HistoryModel::TitleRole).toString());
-	entryItem->parent()->child(entryItem->row(), 2)->setText(Utils::formatDateTime(entry->data(HistoryModel::TimeVisitedRole).toDateTime()));
 }
 
-void HistoryContentsWidget::removeEntry(HistoryEntryItem *entry)
+void HistoryContentsWidget::handleEntriesInserted(const QModelIndex &parent)
 {
-	if (!entry || entry->data(HistoryModel::IdentifierRole).toULongLong() == 0)
+	if (!parent.isValid())
 	{
 		return;
 	}
 
-	QStandardItem *entryItem(findEntry(entry->data(HistoryModel::IdentifierRole).toULongLong()));
+	updateGroups();
 
-	if (entryItem)
+	if (!m_isLoading && m_model->rowCount(parent) == 1 && SettingsManager::getValue(QLatin1String("History/ExpandBranches")).toString() == QLatin1String("first"))
 	{
-		QStandardItem *groupItem(entryItem->parent());
-
-		if (groupItem)
-		{
-			m_model->removeRow(entryItem->row(), groupItem->index());
-
-			if (groupItem->rowCount() == 0)
-			{
-				m_ui->historyViewWidget->setRowHidden(groupItem->row(), m_model->invisibleRootItem()->index(), true);
-			}
-		}
+		expandFirstGroup();
 	}
 }
 
@@ -273,33 +260,26 @@ void HistoryContentsWidget::removeEntry()
 
 void HistoryContentsWidget::removeDomainEntries()
 {
-	QStandardItem *domainItem(findEntry(getEntry(m_ui->historyViewWidget->currentIndex())));
+	const HistoryModel::HistoryEntry entry(HistoryManager::getEntry(getEntry(m_ui->historyViewWidget->currentIndex())));
 
-	if (!domainItem)
+	if (entry.identifier == 0)
 	{
 		return;
 	}
 
-	const QString host(QUrl(domainItem->text()).host());
+	HistoryModel *model(HistoryManager::getBrowsingHistoryModel());
+	model->loadAllEntries();
+
+	const QString host(entry.url.host());
 	QList<quint64> entries;
 
-	for (int i = 0; i < m_model->rowCount(); ++i)
+	for (int i = 0; i < model->rowCount(); ++i)
 	{
-		QStandardItem *groupItem(m_model->item(i, 0));
-
-		if (!groupItem)
-		{
-			continue;
-		}
+		const QModelIndex index(model->index(i, 0));
 
-		for (int j = (groupItem->rowCount() - 1); j >= 0; --j)
+		if (host == index.data(HistoryModel::UrlRole).toUrl().host())
 		{
-			QStandardItem *entryItem(groupItem->child(j, 0));
-
-			if (entryItem && host == QUrl(entryItem->text()).host())
-			{
-				entries.append(entryItem->data(Qt::UserRole).toULongLong());
-			}
+			entries.append(index.data(HistoryModel::IdentifierRole).toULongLong());
 		}
 	}
 
@@ -310,12 +290,12 @@ void HistoryContentsWidget::openEntry(const QModelIndex &index)
 {
 	const QModelIndex entryIndex(index.isValid() ? index : m_ui->historyViewWidget->currentIndex());
 
-	if (!entryIndex.isValid() || entryIndex.parent() == m_model->invisibleRootItem()->index())
+	if (!entryIndex.isValid() || !entryIndex.parent().isValid())
 	{
 		return;
 	}
 
-	const QUrl url(entryIndex.sibling(entryIndex.row(), 0).data(Qt::DisplayRole).toString());
+	const QUrl url(entryIndex.data(HistoryModel::UrlRole).toUrl());
 
 	if (url.isValid())
 	{
@@ -327,21 +307,21 @@ void HistoryContentsWidget::openEntry(const QModelIndex &index)
 
 void HistoryContentsWidget::bookmarkEntry()
 {
-	QStandardItem *entryItem(findEntry(getEntry(m_ui->historyViewWidget->currentIndex())));
+	const HistoryModel::HistoryEntry entry(HistoryManager::getEntry(getEntry(m_ui->historyViewWidget->currentIndex())));
 
-	if (entryItem)
+	if (entry.identifier > 0)
 	{
-		emit requestedAddBookmark(QUrl(entryItem->text()), m_ui->historyViewWidget->currentIndex().sibling(m_ui->historyViewWidget->currentIndex().row(), 1).data(Qt::DisplayRole).toString(), QString());
+		emit requestedAddBookmark(entry.url, entry.title, QString());
 	}
 }
 
 void HistoryContentsWidget::copyEntryLink()
 {
-	QStandardItem *entryItem(findEntry(getEntry(m_ui->historyViewWidget->currentIndex())));
+	const HistoryModel::HistoryEntry entry(HistoryManager::getEntry(getEntry(m_ui->historyViewWidget->currentIndex())));
 
-	if (entryItem)
+	if (entry.identifier > 0)
 	{
-		QApplication::clipboard()->setText(entryItem->text());
+		QApplication::clipboard()->setText(entry.url.toDisplayString());
 	}
 }
 
@@ -371,29 +351,6 @@ void HistoryContentsWidget::showContextMenu(const QPoint &point)
 	menu.exec(m_ui->historyViewWidget->mapToGlobal(point));
 }
 
-QStandardItem* HistoryContentsWidget::findEntry(quint64 identifier)
-{
-	for (int i = 0; i < m_model->rowCount(); ++i)
-	{
-		QStandardItem *groupItem(m_model->item(i, 0));
-
-		if (groupItem)
-		{
-			for (int j = 0; j < groupItem->rowCount(); ++j)
-			{
-				QStandardItem *entryItem(groupItem->child(j, 0));
-
-				if (entryItem && entryItem->data(Qt::UserRole).toULongLong() == identifier)
-				{
-					return entryItem;
-				}
-			}
-		}
-	}
-
-	return NULL;
-}
-
 QString HistoryContentsWidget::getTitle() const
 {
 	return tr("History");
@@ -421,7 +378,7 @@ WindowsManager::LoadingState HistoryContentsWidget::getLoadingState() const
 
 quint64 HistoryContentsWidget::getEntry(const QModelIndex &index) const
 {
-	return ((index.isValid() && index.parent().isValid() && index.parent().parent() == m_model->invisibleRootItem()->index()) ? index.sibling(index.row(), 0).data(Qt::UserRole).toULongLong() : -1);
+	return ((index.isValid() && index.parent().isValid()) ? index.data(HistoryModel::IdentifierRole).toULongLong() : 0);
 }
 
 bool HistoryContentsWidget::eventFilter(QObject *object, QEvent *event)
@@ -452,12 +409,12 @@ bool HistoryContentsWidget::eventFilter(QObject *object, QEvent *event)
 		{
 			const QModelIndex entryIndex(m_ui->historyViewWidget->currentIndex());
 
-			if (!entryIndex.isValid() || entryIndex.parent() == m_model->invisibleRootItem()->index())
+			if (!entryIndex.isValid() || !entryIndex.parent().isValid())
 			{
 				return ContentsWidget::eventFilter(object, event);
 			}
 
-			const QUrl url(entryIndex.sibling(entryIndex.row(), 0).data(Qt::DisplayRole).toString());
+			const QUrl url(entryIndex.data(HistoryModel::UrlRole).toUrl());
 
 			if (url.isValid())
 			{
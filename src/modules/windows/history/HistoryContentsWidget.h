@@ -23,7 +23,8 @@
 #include "../../../core/HistoryManager.h"
 #include "../../../ui/ContentsWidget.h"
 
-#include <QtGui/QStandardItemModel>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QFuture>
 
 namespace Otter
 {
@@ -33,6 +34,7 @@ namespace Ui
 	class HistoryContentsWidget;
 }
 
+class HistoryGroupsModel;
 class Window;
 
 class HistoryContentsWidget : public ContentsWidget
@@ -55,15 +57,18 @@ public slots:
 	void triggerAction(int identifier, const QVariantMap &parameters = QVariantMap());
 
 protected:
+	void timerEvent(QTimerEvent *event);
 	void changeEvent(QEvent *event);
-	QStandardItem* findEntry(quint64 identifier);
+	void findPages(FullTextIndex *index, const QString &filter, int generation);
+	void expandFirstGroup();
 	quint64 getEntry(const QModelIndex &index) const;
 
 protected slots:
 	void populateEntries();
-	void addEntry(HistoryEntryItem *entry);
-	void modifyEntry(HistoryEntryItem *entry);
-	void removeEntry(HistoryEntryItem *entry);
+	void filterEntries(const QString &filter);
+	void handlePages(const QStringList &urls, const QString &filter, int generation);
+	void updateGroups();
+	void handleEntriesInserted(const QModelIndex &parent);
 	void removeEntry();
 	void removeDomainEntries();
 	void openEntry(const QModelIndex &index = QModelIndex());
@@ -72,7 +77,10 @@ protected slots:
 	void showContextMenu(const QPoint &point);
 
 private:
-	QStandardItemModel *m_model;
+	HistoryGroupsModel *m_model;
+	QFuture<void> m_pagesFuture;
+	QAtomicInt m_filterGeneration;
+	int m_filterTimer;
 	bool m_isLoading;
 	Ui::HistoryContentsWidget *m_ui;
 };
@@ -0,0 +1,512 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#include "HistoryGroupsModel.h"
+#include "../../../core/ThemesManager.h"
+#include "../../../core/Utils.h"
+
+#include <QtCore/QCoreApplication>
+
+namespace Otter
+{
+
+///NOTE Entries of source model are ordered from newest, so each group is continuous range of its rows and only offsets of groups are stored
+HistoryGroupsModel::HistoryGroupsModel(HistoryModel *model, QObject *parent) : QAbstractItemModel(parent),
+	m_model(model),
+	m_isResetting(false)
+{
+	m_titles = QStringList({QCoreApplication::translate("Otter::HistoryContentsWidget", "Today"), QCoreApplication::translate("Otter::HistoryContentsWidget", "Yesterday"), QCoreApplication::translate("Otter::HistoryContentsWidget", "Earlier This Week"), QCoreApplication::translate("Otter::HistoryContentsWidget", "Previous Week"), QCoreApplication::translate("Otter::HistoryContentsWidget", "Earlier This Month"), QCoreApplication::translate("Otter::HistoryContentsWidget", "Earlier This Year"), QCoreApplication::translate("Otter::HistoryContentsWidget", "Older")});
+
+	updateGroups();
+
+	connect(m_model, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)), this, SLOT(handleRowsAboutToBeInserted(QModelIndex,int,int)));
+	connect(m_model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(handleRowsInserted(QModelIndex,int,int)));
+	connect(m_model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), this, SLOT(handleRowsAboutToBeRemoved(QModelIndex,int,int)));
+	connect(m_model, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(handleRowsRemoved(QModelIndex,int,int)));
+	connect(m_model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(handleDataChanged(QModelIndex,QModelIndex)));
+	connect(m_model, SIGNAL(modelAboutToBeReset()), this, SLOT(handleModelAboutToBeReset()));
+	connect(m_model, SIGNAL(modelReset()), this, SLOT(handleModelReset()));
+}
+
+void HistoryGroupsModel::handleRowsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+	Q_UNUSED(last)
+
+///NOTE Rows are only prepended when entries are added or appended when older entries are loaded, anything else is handled as reset
+	if (!parent.isValid() && first != 0 && first != m_model->rowCount())
+	{
+		beginResetModel();
+
+		m_isResetting = true;
+	}
+}
+
+void HistoryGroupsModel::handleRowsInserted(const QModelIndex &parent, int first, int last)
+{
+	if (parent.isValid())
+	{
+		return;
+	}
+
+	const int amount(last - first + 1);
+
+	if (m_isResetting || (first == 0 && amount > 1))
+	{
+		if (!m_isResetting)
+		{
+			beginResetModel();
+
+			m_isResetting = true;
+		}
+
+		updateGroups();
+
+		return;
+	}
+
+	const int groupsAmount(m_titles.count());
+
+	if (first == 0)
+	{
+		int group(getGroup(m_model->index(0, 0).data(HistoryModel::TimeVisitedRole).toDateTime()));
+
+		for (int i = 0; i < group; ++i)
+		{
+			if (m_offsets.at(i + 1) > 0)
+			{
+				group = i;
+
+				break;
+			}
+		}
+
+		beginInsertRows(index(group, 0), 0, 0);
+
+		for (int i = (group + 1); i <= groupsAmount; ++i)
+		{
+			++m_offsets[i];
+		}
+
+		endInsertRows();
+
+		return;
+	}
+
+	int group((first > 0) ? getSourceGroup(first - 1) : 0);
+	int row(first);
+
+	while (row <= last)
+	{
+		group = qMax(group, getGroup(m_model->index(row, 0).data(HistoryModel::TimeVisitedRole).toDateTime()));
+
+		int lastRow(row);
+
+		while ((lastRow + 1) <= last && getGroup(m_model->index((lastRow + 1), 0).data(HistoryModel::TimeVisitedRole).toDateTime()) <= group)
+		{
+			++lastRow;
+		}
+
+		beginInsertRows(index(group, 0), (row - m_offsets.at(group)), (lastRow - m_offsets.at(group)));
+
+		for (int i = (group + 1); i <= groupsAmount; ++i)
+		{
+			m_offsets[i] = (lastRow + 1);
+		}
+
+		endInsertRows();
+
+		row = (lastRow + 1);
+	}
+}
+
+void HistoryGroupsModel::handleRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+	if (parent.isValid())
+	{
+		return;
+	}
+
+	const int group(getSourceGroup(first));
+
+	if (group != getSourceGroup(last))
+	{
+		beginResetModel();
+
+		m_isResetting = true;
+
+		return;
+	}
+
+	beginRemoveRows(index(group, 0), (first - m_offsets.at(group)), (last - m_offsets.at(group)));
+}
+
+void HistoryGroupsModel::handleRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+	if (parent.isValid())
+	{
+		return;
+	}
+
+	if (m_isResetting)
+	{
+		updateGroups();
+
+		return;
+	}
+
+	const int group(getSourceGroup(first));
+	const int amount(last - first + 1);
+
+	for (int i = (group + 1); i < m_offsets.count(); ++i)
+	{
+		m_offsets[i] -= amount;
+	}
+
+	endRemoveRows();
+}
+
+void HistoryGroupsModel::handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+	for (int i = topLeft.row(); i <= bottomRight.row(); ++i)
+	{
+		const int group(getSourceGroup(i));
+		const QModelIndex groupIndex(index(group, 0));
+
+		emit dataChanged(index((i - m_offsets.at(group)), 0, groupIndex), index((i - m_offsets.at(group)), 2, groupIndex));
+	}
+}
+
+void HistoryGroupsModel::handleModelAboutToBeReset()
+{
+	beginResetModel();
+
+	m_isResetting = true;
+}
+
+void HistoryGroupsModel::handleModelReset()
+{
+	updateGroups();
+}
+
+void HistoryGroupsModel::updateGroups()
+{
+	if (!m_isResetting)
+	{
+		beginResetModel();
+	}
+
+	const QDate date(QDate::currentDate());
+	const int groupsAmount(m_titles.count());
+	const int rowsAmount(m_model->rowCount());
+
+	m_dates = QVector<QDate>({date, date.addDays(-1), date.addDays(-7), date.addDays(-14), date.addDays(-30), date.addDays(-365), QDate()});
+	m_offsets = QVector<int>((groupsAmount + 1), 0);
+
+	int group(0);
+
+	for (int i = 0; i < rowsAmount; ++i)
+	{
+		const int rowGroup(qMax(group, getGroup(m_model->index(i, 0).data(HistoryModel::TimeVisitedRole).toDateTime())));
+
+		while (group < rowGroup)
+		{
+			++group;
+
+			m_offsets[group] = i;
+		}
+	}
+
+	while (group < groupsAmount)
+	{
+		++group;
+
+		m_offsets[group] = rowsAmount;
+	}
+
+	m_isResetting = false;
+
+	endResetModel();
+}
+
+void HistoryGroupsModel::fetchMore(const QModelIndex &parent)
+{
+	Q_UNUSED(parent)
+
+	m_model->fetchMore(QModelIndex());
+}
+
+QModelIndex HistoryGroupsModel::mapToSource(const QModelIndex &index) const
+{
+	if (!index.isValid() || index.internalId() == 0)
+	{
+		return QModelIndex();
+	}
+
+	return m_model->index((m_offsets.at(index.internalId() - 1) + index.row()), 0);
+}
+
+void HistoryGroupsModel::setContentsMatches(const QString &filter, const QSet<QUrl> &urls)
+{
+	m_contentsFilter = filter;
+	m_contentsMatches = urls;
+}
+
+QModelIndex HistoryGroupsModel::index(int row, int column, const QModelIndex &parent) const
+{
+	if (row < 0 || column < 0 || column >= 3)
+	{
+		return QModelIndex();
+	}
+
+	if (!parent.isValid())
+	{
+		return ((row < m_titles.count()) ? createIndex(row, column, quintptr(0)) : QModelIndex());
+	}
+
+	if (parent.internalId() != 0 || parent.column() != 0 || row >= rowCount(parent))
+	{
+		return QModelIndex();
+	}
+
+	return createIndex(row, column, quintptr(parent.row() + 1));
+}
+
+QModelIndex HistoryGroupsModel::parent(const QModelIndex &index) const
+{
+	if (!index.isValid() || index.internalId() == 0)
+	{
+		return QModelIndex();
+	}
+
+	return createIndex((index.internalId() - 1), 0, quintptr(0));
+}
+
+QModelIndex HistoryGroupsModel::getIndex(quint64 identifier) const
+{
+	const HistoryModel::HistoryEntry entry(m_model->getEntry(identifier));
+
+	if (entry.identifier == 0)
+	{
+		return QModelIndex();
+	}
+
+	const int rowsAmount(m_model->rowCount());
+	int first(0);
+	int last(rowsAmount);
+
+///NOTE Entry is looked up by its identifier and then position of its visit time is found using binary search
+	while (first < last)
+	{
+		const int middle((first + last) / 2);
+
+		if (m_model->index(middle, 0).data(HistoryModel::TimeVisitedRole).toDateTime() > entry.time)
+		{
+			first = (middle + 1);
+		}
+		else
+		{
+			last = middle;
+		}
+	}
+
+	for (int i = first; i < rowsAmount; ++i)
+	{
+		const QModelIndex sourceIndex(m_model->index(i, 0));
+
+		if (sourceIndex.data(HistoryModel::IdentifierRole).toULongLong() == identifier)
+		{
+			const int group(getSourceGroup(i));
+
+			return index((i - m_offsets.at(group)), 0, index(group, 0));
+		}
+
+		if (sourceIndex.data(HistoryModel::TimeVisitedRole).toDateTime() != entry.time)
+		{
+			break;
+		}
+	}
+
+	return QModelIndex();
+}
+
+QVariant HistoryGroupsModel::data(const QModelIndex &index, int role) const
+{
+	if (!index.isValid())
+	{
+		return QVariant();
+	}
+
+	if (index.internalId() == 0)
+	{
+		if (index.column() == 0)
+		{
+			if (role == Qt::DisplayRole)
+			{
+				return m_titles.value(index.row());
+			}
+
+			if (role == Qt::DecorationRole)
+			{
+				return ThemesManager::getIcon(QLatin1String("inode-directory"));
+			}
+		}
+
+		return QVariant();
+	}
+
+	const QModelIndex sourceIndex(mapToSource(index));
+
+	switch (role)
+	{
+		case Qt::DisplayRole:
+			if (index.column() == 0)
+			{
+				return sourceIndex.data(HistoryModel::UrlRole).toUrl().toDisplayString().replace(QLatin1String("%23"), QString(QLatin1Char('#')));
+			}
+
+			if (index.column() == 1)
+			{
+				const QString title(sourceIndex.data(HistoryModel::TitleRole).toString());
+
+				return (title.isEmpty() ? QCoreApplication::translate("Otter::HistoryContentsWidget", "(Untitled)") : title);
+			}
+
+			return Utils::formatDateTime(sourceIndex.data(HistoryModel::TimeVisitedRole).toDateTime());
+		case Qt::DecorationRole:
+			return ((index.column() == 0) ? sourceIndex.data(Qt::DecorationRole) : QVariant());
+		case HistoryModel::UrlRole:
+		case HistoryModel::IdentifierRole:
+		case HistoryModel::TimeVisitedRole:
+			return sourceIndex.data(role);
+		case ContentsMatchRole:
+			if (index.column() == 0 && !m_contentsMatches.isEmpty() && m_contentsMatches.contains(Utils::normalizeUrl(sourceIndex.data(HistoryModel::UrlRole).toUrl())))
+			{
+				return m_contentsFilter;
+			}
+
+			break;
+		default:
+			break;
+	}
+
+	return QVariant();
+}
+
+QVariant HistoryGroupsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
+	{
+		switch (section)
+		{
+			case 0:
+				return QCoreApplication::translate("Otter::HistoryContentsWidget", "Address");
+			case 1:
+				return QCoreApplication::translate("Otter::HistoryContentsWidget", "Title");
+			case 2:
+				return QCoreApplication::translate("Otter::HistoryContentsWidget", "Date");
+			default:
+				break;
+		}
+	}
+
+	return QVariant();
+}
+
+Qt::ItemFlags HistoryGroupsModel::flags(const QModelIndex &index) const
+{
+	if (!index.isValid())
+	{
+		return Qt::NoItemFlags;
+	}
+
+	if (index.internalId() == 0)
+	{
+		return (Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+	}
+
+	return (Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemNeverHasChildren);
+}
+
+int HistoryGroupsModel::getGroup(const QDateTime &time) const
+{
+	const QDate date(time.date());
+
+	for (int i = 0; i < m_dates.count(); ++i)
+	{
+		if (!m_dates.at(i).isValid() || date >= m_dates.at(i))
+		{
+			return i;
+		}
+	}
+
+	return (m_dates.count() - 1);
+}
+
+int HistoryGroupsModel::getSourceGroup(int row) const
+{
+	for (int i = 0; i < (m_offsets.count() - 1); ++i)
+	{
+		if (row < m_offsets.at(i + 1))
+		{
+			return i;
+		}
+	}
+
+	return (m_offsets.count() - 2);
+}
+
+int HistoryGroupsModel::rowCount(const QModelIndex &parent) const
+{
+	if (!parent.isValid())
+	{
+		return m_titles.count();
+	}
+
+	if (parent.internalId() != 0 || parent.column() != 0 || parent.row() >= (m_offsets.count() - 1))
+	{
+		return 0;
+	}
+
+	return (m_offsets.at(parent.row() + 1) - m_offsets.at(parent.row()));
+}
+
+int HistoryGroupsModel::columnCount(const QModelIndex &parent) const
+{
+	Q_UNUSED(parent)
+
+	return 3;
+}
+
+bool HistoryGroupsModel::canFetchMore(const QModelIndex &parent) const
+{
+	if (!m_model->canFetchMore(QModelIndex()))
+	{
+		return false;
+	}
+
+///NOTE Older entries can only end up in the last group which has any entries or groups after it
+	if (parent.isValid())
+	{
+		return (parent.internalId() == 0 && m_offsets.at(parent.row() + 1) == m_offsets.last());
+	}
+
+	return true;
+}
+
+}
@@ -0,0 +1,86 @@
+/**************************************************************************
+* Otter Browser: Web browser controlled by the user, not vice-versa.
+* Copyright (C) 2016 Michal Dutkiewicz aka Emdek <michal@emdek.pl>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+**************************************************************************/
+
+#ifndef OTTER_HISTORYGROUPSMODEL_H
+#define OTTER_HISTORYGROUPSMODEL_H
+
+#include "../../../core/HistoryModel.h"
+
+#include <QtCore/QAbstractItemModel>
+#include <QtCore/QDate>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
+
+namespace Otter
+{
+
+class HistoryGroupsModel : public QAbstractItemModel
+{
+	Q_OBJECT
+
+public:
+	enum HistoryGroupRole
+	{
+		ContentsMatchRole = (Qt::UserRole + 2)
+	};
+
+	explicit HistoryGroupsModel(HistoryModel *model, QObject *parent = NULL);
+
+	void fetchMore(const QModelIndex &parent);
+	void setContentsMatches(const QString &filter, const QSet<QUrl> &urls);
+	QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+	QModelIndex parent(const QModelIndex &index) const;
+	QModelIndex getIndex(quint64 identifier) const;
+	QVariant data(const QModelIndex &index, int role) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+	Qt::ItemFlags flags(const QModelIndex &index) const;
+	int rowCount(const QModelIndex &parent = QModelIndex()) const;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const;
+	bool canFetchMore(const QModelIndex &parent) const;
+
+public slots:
+	void updateGroups();
+
+protected:
+	QModelIndex mapToSource(const QModelIndex &index) const;
+	int getGroup(const QDateTime &time) const;
+	int getSourceGroup(int row) const;
+
+protected slots:
+	void handleRowsAboutToBeInserted(const QModelIndex &parent, int first, int last);
+	void handleRowsInserted(const QModelIndex &parent, int first, int last);
+	void handleRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+	void handleRowsRemoved(const QModelIndex &parent, int first, int last);
+	void handleDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+	void handleModelAboutToBeReset();
+	void handleModelReset();
+
+private:
+	HistoryModel *m_model;
+	QString m_contentsFilter;
+	QStringList m_titles;
+	QSet<QUrl> m_contentsMatches;
+	QVector<QDate> m_dates;
+	QVector<int> m_offsets;
+	bool m_isResetting;
+};
+
+}
+
+#endif
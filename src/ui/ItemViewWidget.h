@@ -98,6 +98,7 @@ public slots:
 	void setColumnVisibility(int column, bool hide);
 	void setFilterString(const QString filter = QString());
 	void setFilterRoles(const QSet<int> &roles);
+	void updateFilter();
 
 protected:
 	void showEvent(QShowEvent *event);
@@ -112,7 +113,6 @@ protected slots:
 	void saveState();
 	void notifySelectionChanged();
 	void updateDropSelection();
-	void updateFilter();
 
 private:
 	HeaderViewWidget *m_headerWidget;
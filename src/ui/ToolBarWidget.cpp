@@ -295,6 +295,14 @@ void ToolBarWidget::bookmarkTrashed(BookmarksItem *bookmark)
 	}
 }
 
+void ToolBarWidget::bookmarksChanged(const QList<quint64> &folders)
+{
+	if (m_bookmark && folders.contains(m_bookmark->data(BookmarksModel::IdentifierRole).toULongLong()))
+	{
+		loadBookmarks();
+	}
+}
+
 void ToolBarWidget::loadBookmarks()
 {
 	clear();
@@ -405,6 +413,7 @@ void ToolBarWidget::setDefinition(const ToolBarsManager::ToolBarDefinition &defi
 		connect(BookmarksManager::getModel(), SIGNAL(bookmarkTrashed(BookmarksItem*)), this, SLOT(bookmarkTrashed(BookmarksItem*)));
 		connect(BookmarksManager::getModel(), SIGNAL(bookmarkRestored(BookmarksItem*)), this, SLOT(bookmarkTrashed(BookmarksItem*)));
 		connect(BookmarksManager::getModel(), SIGNAL(bookmarkRemoved(BookmarksItem*)), this, SLOT(bookmarkRemoved(BookmarksItem*)));
+		connect(BookmarksManager::getModel(), SIGNAL(bookmarksChanged(QList<quint64>)), this, SLOT(bookmarksChanged(QList<quint64>)));
 
 		return;
 	}
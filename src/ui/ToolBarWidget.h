@@ -80,6 +80,7 @@ protected slots:
 	void bookmarkMoved(BookmarksItem *bookmark, BookmarksItem *previousParent);
 	void bookmarkRemoved(BookmarksItem *bookmark);
 	void bookmarkTrashed(BookmarksItem *bookmark);
+	void bookmarksChanged(const QList<quint64> &folders);
 	void loadBookmarks();
 	void notifyWindowChanged(quint64 identifier);
 	void updateVisibility();
@@ -87,6 +87,11 @@ WebsiteInformationDialog::WebsiteInformationDialog(WebWidget *widget, QWidget *p
 	m_ui->elementsLabelWidget->setText((statistics.value(QLatin1String("requestsBlocked")).toInt() > 0) ? tr("%1 (%n blocked)", "", statistics.value(QLatin1String("requestsBlocked")).toInt()).arg(statistics.value(QLatin1String("requestsStarted")).toInt()) : QString::number(statistics.value(QLatin1String("requestsStarted")).toInt()));
 	m_ui->downloadDateLabelWidget->setText(Utils::formatDateTime(statistics.value(QLatin1String("dateDownloaded")).toDateTime()));
 
+	const int contentBlockingCacheHits(statistics.value(QLatin1String("contentBlockingCacheHits")).toInt());
+	const int contentBlockingCacheRequests(contentBlockingCacheHits + statistics.value(QLatin1String("contentBlockingCacheMisses")).toInt());
+
+	m_ui->contentBlockingCacheLabelWidget->setText(tr("%n entries (%1% hit rate)", "", statistics.value(QLatin1String("contentBlockingCacheEntries")).toInt()).arg((contentBlockingCacheRequests > 0) ? ((contentBlockingCacheHits * 100) / contentBlockingCacheRequests) : 0));
+
 	const QString cookiesPolicy(widget->getOption(QLatin1String("Network/CookiesPolicy")).toString());
 
 	if (cookiesPolicy == QLatin1String("acceptExisting"))